@@ -0,0 +1,261 @@
+// An interpreter for GDB agent expressions: the bytecode GDB sends with breakpoint conditions and
+// tracepoint actions, so they can be evaluated in the bridge rather than by stopping into GDB. The
+// integer bytecodes are supported; the floating-point ones, trace state variables and printf are
+// not, and an expression using them fails to evaluate.
+//
+#include <liberror.h>
+#include "agent.h"
+#include "mem.h"
+
+// The bytecodes, as numbered in GDB's ax.def
+typedef enum {
+	AX_FLOAT = 0x01, AX_ADD, AX_SUB, AX_MUL, AX_DIV_SIGNED, AX_DIV_UNSIGNED, AX_REM_SIGNED,
+	AX_REM_UNSIGNED, AX_LSH, AX_RSH_SIGNED, AX_RSH_UNSIGNED, AX_TRACE, AX_TRACE_QUICK, AX_LOG_NOT,
+	AX_BIT_AND, AX_BIT_OR, AX_BIT_XOR, AX_BIT_NOT, AX_EQUAL, AX_LESS_SIGNED, AX_LESS_UNSIGNED,
+	AX_EXT, AX_REF8, AX_REF16, AX_REF32, AX_REF64,
+	AX_IF_GOTO = 0x20, AX_GOTO, AX_CONST8, AX_CONST16, AX_CONST32, AX_CONST64, AX_REG, AX_END,
+	AX_DUP, AX_POP, AX_ZERO_EXT, AX_SWAP,
+	AX_TRACE16 = 0x30, AX_PICK = 0x32, AX_ROT
+} AgentOp;
+
+static uint64 fetch(const uint8 *code, uint32 pc, uint32 count);
+static int readMemory(
+	struct AgentEnv *env, uint32 address, uint32 count, uint64 *value, const char **error);
+static int64 extend(uint64 value, uint32 bits);
+
+// Evaluate an agent expression, leaving in *result whatever is on top of the stack when it ends (or
+// zero if the stack is empty). Memory is read from the MD, so it must be suspended at the monitor.
+//
+int agentEval(
+	const uint8 *code, uint32 length, struct AgentEnv *env, int64 *result, const char **error)
+{
+	int retVal = 0, status;
+	int64 stack[AGENT_STACK_SIZE];
+	uint32 sp = 0, pc = 0, n, size;
+	uint64 value;
+	int64 a, b;
+	uint8 op;
+
+	#define NEED(n) \
+		CHECK_STATUS(sp < (n), 2, cleanup, "agentEval(): Stack underflow at offset %u!", pc - 1)
+	#define ROOM(n) \
+		CHECK_STATUS(sp + (n) > AGENT_STACK_SIZE, 3, cleanup, "agentEval(): Stack overflow at offset %u!", pc - 1)
+	#define OPERAND(n) \
+		CHECK_STATUS(pc + (n) > length, 4, cleanup, "agentEval(): Truncated expression!"); \
+		value = fetch(code, pc, n); \
+		pc += (n)
+	#define BINARY(expr) \
+		NEED(2); \
+		a = stack[sp - 2]; \
+		b = stack[sp - 1]; \
+		stack[--sp - 1] = (expr)
+
+	for ( ;; ) {
+		CHECK_STATUS(pc >= length, 4, cleanup, "agentEval(): Expression has no end!");
+		op = code[pc++];
+		switch ( op ) {
+		case AX_ADD:
+			BINARY((int64)((uint64)a + (uint64)b));
+			break;
+		case AX_SUB:
+			BINARY((int64)((uint64)a - (uint64)b));
+			break;
+		case AX_MUL:
+			BINARY((int64)((uint64)a * (uint64)b));
+			break;
+		case AX_DIV_SIGNED:
+		case AX_DIV_UNSIGNED:
+		case AX_REM_SIGNED:
+		case AX_REM_UNSIGNED:
+			NEED(2);
+			CHECK_STATUS(stack[sp - 1] == 0, 5, cleanup, "agentEval(): Division by zero!");
+			// Dividing by -1 is done by hand, because INT64_MIN / -1 overflows and traps
+			if ( op == AX_DIV_SIGNED ) {
+				BINARY((b == -1) ? (int64)(0 - (uint64)a) : a / b);
+			} else if ( op == AX_DIV_UNSIGNED ) {
+				BINARY((int64)((uint64)a / (uint64)b));
+			} else if ( op == AX_REM_SIGNED ) {
+				BINARY((b == -1) ? 0 : a % b);
+			} else {
+				BINARY((int64)((uint64)a % (uint64)b));
+			}
+			break;
+		case AX_LSH:
+			BINARY((int64)((uint64)a << (b & 63)));
+			break;
+		case AX_RSH_SIGNED:
+			BINARY(a >> (b & 63));
+			break;
+		case AX_RSH_UNSIGNED:
+			BINARY((int64)((uint64)a >> (b & 63)));
+			break;
+		case AX_BIT_AND:
+			BINARY(a & b);
+			break;
+		case AX_BIT_OR:
+			BINARY(a | b);
+			break;
+		case AX_BIT_XOR:
+			BINARY(a ^ b);
+			break;
+		case AX_EQUAL:
+			BINARY(a == b);
+			break;
+		case AX_LESS_SIGNED:
+			BINARY(a < b);
+			break;
+		case AX_LESS_UNSIGNED:
+			BINARY((uint64)a < (uint64)b);
+			break;
+		case AX_LOG_NOT:
+			NEED(1);
+			stack[sp - 1] = !stack[sp - 1];
+			break;
+		case AX_BIT_NOT:
+			NEED(1);
+			stack[sp - 1] = ~stack[sp - 1];
+			break;
+		case AX_EXT:
+		case AX_ZERO_EXT:
+			OPERAND(1);
+			NEED(1);
+			if ( value && value < 64 ) {
+				stack[sp - 1] = (op == AX_EXT)
+					? extend((uint64)stack[sp - 1], (uint32)value)
+					: (int64)((uint64)stack[sp - 1] & ((1ULL << value) - 1));
+			}
+			break;
+		case AX_REF8:
+		case AX_REF16:
+		case AX_REF32:
+		case AX_REF64:
+			NEED(1);
+			size = 1U << (op - AX_REF8);
+			status = readMemory(env, (uint32)stack[sp - 1], size, &value, error);
+			CHECK_STATUS(status, status, cleanup);
+			stack[sp - 1] = (int64)value;
+			break;
+		case AX_TRACE:
+			NEED(2);
+			if ( env->trace ) {
+				status = env->trace(env, (uint32)stack[sp - 2], (uint32)stack[sp - 1], error);
+				CHECK_STATUS(status, status, cleanup);
+			}
+			sp -= 2;
+			break;
+		case AX_TRACE_QUICK:
+		case AX_TRACE16:
+			OPERAND(op == AX_TRACE_QUICK ? 1 : 2);
+			NEED(1);
+			if ( env->trace ) {
+				status = env->trace(env, (uint32)stack[sp - 1], (uint32)value, error);
+				CHECK_STATUS(status, status, cleanup);
+			}
+			break;
+		case AX_IF_GOTO:
+		case AX_GOTO:
+			OPERAND(2);
+			if ( op == AX_IF_GOTO ) {
+				NEED(1);
+				if ( !stack[--sp] ) {
+					break;
+				}
+			}
+			CHECK_STATUS(value >= length, 6, cleanup, "agentEval(): Jump out of expression!");
+			pc = (uint32)value;
+			break;
+		case AX_CONST8:
+		case AX_CONST16:
+		case AX_CONST32:
+		case AX_CONST64:
+			OPERAND(1U << (op - AX_CONST8));
+			ROOM(1);
+			stack[sp++] = (int64)value;
+			break;
+		case AX_REG:
+			OPERAND(2);
+			ROOM(1);
+			CHECK_STATUS(value > PC, 7, cleanup, "agentEval(): No register %u!", (uint32)value);
+			stack[sp++] = (&env->regs->d0)[value];
+			break;
+		case AX_END:
+			*result = sp ? stack[sp - 1] : 0;
+			goto cleanup;
+		case AX_DUP:
+			NEED(1);
+			ROOM(1);
+			stack[sp] = stack[sp - 1];
+			sp++;
+			break;
+		case AX_POP:
+			NEED(1);
+			sp--;
+			break;
+		case AX_SWAP:
+			NEED(2);
+			a = stack[sp - 1];
+			stack[sp - 1] = stack[sp - 2];
+			stack[sp - 2] = a;
+			break;
+		case AX_PICK:
+			OPERAND(1);
+			n = (uint32)value;
+			NEED(n + 1);
+			ROOM(1);
+			stack[sp] = stack[sp - 1 - n];
+			sp++;
+			break;
+		case AX_ROT:
+			NEED(3);
+			a = stack[sp - 1];
+			stack[sp - 1] = stack[sp - 2];
+			stack[sp - 2] = stack[sp - 3];
+			stack[sp - 3] = a;
+			break;
+		default:
+			CHECK_STATUS(
+				true, 1, cleanup,
+				"agentEval(): Unsupported bytecode 0x%02X at offset %u!", op, pc - 1);
+		}
+	}
+	#undef NEED
+	#undef ROOM
+	#undef OPERAND
+	#undef BINARY
+cleanup:
+	return retVal;
+}
+
+
+// *************************************************************************************************
+// **                               Operations private to this file                               **
+// *************************************************************************************************
+
+// Bytecode operands are big-endian
+//
+static uint64 fetch(const uint8 *code, uint32 pc, uint32 count) {
+	uint64 value = 0;
+	while ( count-- ) {
+		value = (value << 8) | code[pc++];
+	}
+	return value;
+}
+
+// So is the MD's memory
+//
+static int readMemory(
+	struct AgentEnv *env, uint32 address, uint32 count, uint64 *value, const char **error)
+{
+	uint8 buf[8];
+	const int status = umdkReadBytes(env->session, address & 0x00FFFFFF, count, buf, error);
+	if ( status == 0 ) {
+		*value = fetch(buf, 0, count);
+	}
+	return status;
+}
+
+static int64 extend(uint64 value, uint32 bits) {
+	const uint64 sign = 1ULL << (bits - 1);
+	value &= (sign << 1) - 1;
+	return (int64)((value ^ sign) - sign);
+}
@@ -0,0 +1,34 @@
+#ifndef AGENT_H
+#define AGENT_H
+
+#include <makestuff.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	struct UmdkSession;
+	struct Registers;
+
+	// The deepest the evaluation stack may get
+	#define AGENT_STACK_SIZE 64
+
+	// What an agent expression runs against: the registers the MD stopped with, its memory (read
+	// through the session), and optionally somewhere to record the memory named by trace bytecodes.
+	// If trace is NULL, the trace bytecodes are accepted but record nothing.
+	struct AgentEnv {
+		struct UmdkSession *session;
+		const struct Registers *regs;
+		int (*trace)(struct AgentEnv *env, uint32 address, uint32 length, const char **error);
+		void *traceContext;
+	};
+
+	int agentEval(
+		const uint8 *code, uint32 length, struct AgentEnv *env, int64 *result, const char **error
+	) WARN_UNUSED_RESULT;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+#include <makestuff.h>
+#include "../../codec.h"
+#include "../../args.h"
+
+// One packet's worth of binary data, and its hex representation
+#define BUF_SIZE 0x4000
+static uint8 g_bin[BUF_SIZE];
+static char g_hex[2*BUF_SIZE];
+
+static const char *const levelNames[] = {"scalar", "SSE2", "AVX2"};
+
+static uint64 nowUsec(void) {
+	#ifdef WIN32
+		LARGE_INTEGER freq, count;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&count);
+		return (uint64)(count.QuadPart * 1000000 / freq.QuadPart);
+	#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64)ts.tv_sec * 1000000 + (uint64)ts.tv_nsec / 1000;
+	#endif
+}
+
+// Print throughput in MiB/s of binary data (so encode and decode are comparable)
+static void report(const char *name, CodecLevel level, uint32 numIters, uint64 elapsed, uint32 sink) {
+	const double mib = (double)BUF_SIZE * numIters / (1024.0 * 1024.0);
+	printf(
+		"%-10s %-8s %10.1f MiB/s %10.3f us/packet   (%08X)\n",
+		name, levelNames[level], mib * 1000000.0 / (double)(elapsed ? elapsed : 1),
+		(double)elapsed / numIters, sink);
+}
+
+void usage(const char *prog) {
+	printf("Usage: %s [-h] [-n <iterations>]\n\n", prog);
+	printf("Benchmark the hex codec kernels on %d-byte packets.\n\n", BUF_SIZE);
+	printf("  -n <iterations>  number of packets to code with each kernel (default 10000)\n");
+	printf("  -h               print this help and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+	int retVal = 0;
+	const char *iterStr = NULL;
+	uint32 numIters = 10000, i, sink;
+	int level;
+	CodecLevel actual;
+	uint64 startTime;
+	const char *const prog = argv[0];
+	printf("UMDKv2 Codec Benchmark Copyright (C) 2014 Chris McClelland\n\n");
+	argv++;
+	argc--;
+	while ( argc ) {
+		if ( argv[0][0] != '-' ) {
+			unexpected(prog, *argv);
+			FAIL(1, cleanup);
+		}
+		switch ( argv[0][1] ) {
+		case 'h':
+			usage(prog);
+			FAIL(0, cleanup);
+			break;
+		case 'n':
+			GET_ARG("n", iterStr, 2, cleanup);
+			numIters = (uint32)strtoul(iterStr, NULL, 0);
+			break;
+		default:
+			invalid(prog, argv[0][1]);
+			FAIL(3, cleanup);
+		}
+		argv++;
+		argc--;
+	}
+	for ( i = 0; i < BUF_SIZE; i++ ) {
+		g_bin[i] = (uint8)(i * 7 + (i >> 8));
+	}
+	for ( level = CODEC_SCALAR; level <= CODEC_AVX2; level++ ) {
+		actual = codecSetLevel((CodecLevel)level);
+		if ( (int)actual != level ) {
+			printf("%-10s %-8s not supported on this CPU\n", "", levelNames[level]);
+			continue;
+		}
+		sink = 0;
+		startTime = nowUsec();
+		for ( i = 0; i < numIters; i++ ) {
+			sink += codecHexEncode(g_hex, g_bin, BUF_SIZE, (uint8)i);
+		}
+		report("encode", actual, numIters, nowUsec() - startTime, sink);
+
+		sink = 0;
+		startTime = nowUsec();
+		for ( i = 0; i < numIters; i++ ) {
+			sink += (uint32)codecHexDecode(g_bin, g_hex, BUF_SIZE) + g_bin[i % BUF_SIZE];
+		}
+		report("decode", actual, numIters, nowUsec() - startTime, sink);
+
+		sink = 0;
+		startTime = nowUsec();
+		for ( i = 0; i < numIters; i++ ) {
+			sink += codecChecksum(g_hex, 2*BUF_SIZE, (uint8)i);
+		}
+		report("checksum", actual, numIters, nowUsec() - startTime, sink);
+	}
+cleanup:
+	return retVal;
+}
@@ -0,0 +1,385 @@
+/*
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+#include <makestuff.h>
+#include <libfpgalink.h>
+#include <liberror.h>
+#include "../mem.h"
+#include "../session.h"
+#include "../args.h"
+#include "../sim/sim.h"
+
+#define TMP_FILE "bench.tmp"
+
+// Scratch buffer shared by all the benchmarks
+static uint8 g_buf[65536];
+
+// Each benchmark exercises one umdk*() entry point with representative arguments. The optional
+// tidy function puts the simulated MD back at the monitor afterwards, and is not timed.
+struct Benchmark {
+	const char *name;
+	int (*run)(struct UmdkSession *session, const char **error);
+	void (*tidy)(struct UmdkSession *session);
+};
+
+static int benchDirectWriteBytes(struct UmdkSession *session, const char **error) {
+	return umdkDirectWriteBytes(session, 0x010000, 256, g_buf, error);
+}
+static int benchDirectWriteWord(struct UmdkSession *session, const char **error) {
+	return umdkDirectWriteWord(session, 0x010000, 0xCAFE, error);
+}
+static int benchDirectWriteLong(struct UmdkSession *session, const char **error) {
+	return umdkDirectWriteLong(session, 0x010000, 0xCAFEBABE, error);
+}
+static int benchDirectWriteFile(struct UmdkSession *session, const char **error) {
+	return umdkDirectWriteFile(session, 0x010000, TMP_FILE, error);
+}
+static int benchPhysicalWriteBytes(struct UmdkSession *session, const char **error) {
+	return umdkPhysicalWriteBytes(session, 0x100000, 256, g_buf, error);
+}
+static int benchDirectReadBytes(struct UmdkSession *session, const char **error) {
+	return umdkDirectReadBytes(session, 0x010000, 256, g_buf, error);
+}
+static int benchDirectReadBytesOdd(struct UmdkSession *session, const char **error) {
+	return umdkDirectReadBytes(session, 0x010001, 255, g_buf, error);
+}
+static int benchDirectReadBytesAsync(struct UmdkSession *session, const char **error) {
+	int retVal = 0;
+	const uint8 *recvData;
+	uint32 requestLength, actualLength;
+	FLStatus status;
+	retVal = umdkDirectReadBytesAsync(session, 0x010000, 256, error);
+	CHECK_STATUS(retVal, retVal, cleanup);
+	status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+	CHECK_STATUS(status, 1, cleanup);
+cleanup:
+	return retVal;
+}
+static int benchDirectReadWord(struct UmdkSession *session, const char **error) {
+	uint16 value;
+	return umdkDirectReadWord(session, 0x010000, &value, error);
+}
+static int benchDirectReadLong(struct UmdkSession *session, const char **error) {
+	uint32 value;
+	return umdkDirectReadLong(session, 0x010000, &value, error);
+}
+static int benchWriteBytesDirect(struct UmdkSession *session, const char **error) {
+	return umdkWriteBytes(session, 0x010000, 256, g_buf, error);
+}
+static int benchWriteBytesIndirect(struct UmdkSession *session, const char **error) {
+	return umdkWriteBytes(session, 0xFF0000, 256, g_buf, error);
+}
+static int benchWriteBytesIndirect64K(struct UmdkSession *session, const char **error) {
+	return umdkWriteBytes(session, 0xFF0000, 65536, g_buf, error);
+}
+static int benchWriteBytesOdd(struct UmdkSession *session, const char **error) {
+	return umdkWriteBytes(session, 0x010001, 255, g_buf, error);
+}
+static int benchWriteBytesIndirectOdd(struct UmdkSession *session, const char **error) {
+	return umdkWriteBytes(session, 0xFF0001, 255, g_buf, error);
+}
+static int benchWriteWord(struct UmdkSession *session, const char **error) {
+	return umdkWriteWord(session, 0xFF0000, 0xCAFE, error);
+}
+static int benchWriteLong(struct UmdkSession *session, const char **error) {
+	return umdkWriteLong(session, 0xFF0000, 0xCAFEBABE, error);
+}
+static int benchReadBytesDirect(struct UmdkSession *session, const char **error) {
+	return umdkReadBytes(session, 0x010000, 256, g_buf, error);
+}
+static int benchReadBytesIndirect(struct UmdkSession *session, const char **error) {
+	return umdkReadBytes(session, 0xFF0000, 256, g_buf, error);
+}
+static int benchReadBytesIndirect64K(struct UmdkSession *session, const char **error) {
+	return umdkReadBytes(session, 0xFF0000, 65536, g_buf, error);
+}
+static int benchReadWord(struct UmdkSession *session, const char **error) {
+	uint16 value;
+	return umdkReadWord(session, 0xFF0000, &value, error);
+}
+static int benchReadLong(struct UmdkSession *session, const char **error) {
+	uint32 value;
+	return umdkReadLong(session, 0xFF0000, &value, error);
+}
+static int benchReadBytesX4(struct UmdkSession *session, const char **error) {
+	int retVal = umdkReadBytes(session, 0x000000, 16, g_buf, error);
+	CHECK_STATUS(retVal, retVal, cleanup);
+	retVal = umdkReadBytes(session, 0x010000, 16, g_buf+16, error);
+	CHECK_STATUS(retVal, retVal, cleanup);
+	retVal = umdkReadBytes(session, CB_REGS, 72, g_buf+32, error);
+	CHECK_STATUS(retVal, retVal, cleanup);
+	retVal = umdkReadBytes(session, 0x020001, 5, g_buf+104, error);
+	CHECK_STATUS(retVal, retVal, cleanup);
+cleanup:
+	return retVal;
+}
+static int benchReadV(struct UmdkSession *session, const char **error) {
+	const struct MemVec vec[] = {
+		{0x000000, 16, g_buf},
+		{0x010000, 16, g_buf+16},
+		{CB_REGS, 72, g_buf+32},
+		{0x020001, 5, g_buf+104}
+	};
+	return umdkReadV(session, vec, 4, error);
+}
+static int benchWriteV(struct UmdkSession *session, const char **error) {
+	const struct MemVec vec[] = {
+		{0x010000, 16, g_buf},
+		{0x020000, 16, g_buf},
+		{0x400800, 16, g_buf},
+		{0x000400, 4, g_buf}
+	};
+	return umdkWriteV(session, vec, 4, error);
+}
+static int benchDumpRAM(struct UmdkSession *session, const char **error) {
+	return umdkDumpRAM(session, TMP_FILE, error);
+}
+static int benchSetRegister(struct UmdkSession *session, const char **error) {
+	return umdkSetRegister(session, D7, 0xCAFEBABE, error);
+}
+static int benchGetRegister(struct UmdkSession *session, const char **error) {
+	uint32 value;
+	return umdkGetRegister(session, D7, &value, error);
+}
+static int benchRemoteAcquire(struct UmdkSession *session, const char **error) {
+	struct Registers regs;
+	return umdkRemoteAcquire(session, &regs, error);
+}
+static int benchAcquireTimeout(struct UmdkSession *session, const char **error) {
+	// Release the MD with nothing to bring it back, and see what a 20ms wait costs
+	const uint8 noVector[] = {0x00, 0x00, 0x00, 0x00};
+	const struct Deadline deadline = {20, NULL};
+	int retVal;
+	simPoke(session->handle, IL_VEC, 4, noVector);
+	retVal = umdkContinue(session, error);
+	if ( retVal == 0 ) {
+		retVal = umdkAcquire(session, NULL, &deadline, NULL);
+		retVal = (retVal == ACQ_TIMEOUT) ? 0 : 1;
+	}
+	return retVal;
+}
+static int benchExecuteCommand(struct UmdkSession *session, const char **error) {
+	return umdkExecuteCommand(session, CMD_READ, 0xFF0000, 16, NULL, g_buf, NULL, error);
+}
+static int benchStep(struct UmdkSession *session, const char **error) {
+	struct Registers regs;
+	return umdkStep(session, &regs, error);
+}
+static int benchStepRange(struct UmdkSession *session, const char **error) {
+	struct Registers regs;
+	return umdkStepRange(session, 0x000200, 0x000210, NULL, &regs, error);
+}
+static int benchContWait(struct UmdkSession *session, const char **error) {
+	struct Registers regs;
+	return umdkContWait(session, &regs, error);
+}
+static int benchContWaitTrace(struct UmdkSession *session, const char **error) {
+	struct Registers regs;
+	int retVal = umdkOpenTrace(session, TMP_FILE);
+	CHECK_STATUS(retVal, retVal, cleanup, "benchContWaitTrace(): Unable to open %s!", TMP_FILE);
+	retVal = umdkContWait(session, &regs, error);
+cleanup:
+	return retVal;
+}
+static int benchContinue(struct UmdkSession *session, const char **error) {
+	return umdkContinue(session, error);
+}
+static int benchReset(struct UmdkSession *session, const char **error) {
+	return umdkReset(session, error);
+}
+
+// Put the simulated MD back at the monitor, as if it had hit a breakpoint
+static void tidyReacquire(struct UmdkSession *session) {
+	const uint8 ready[] = {0x00, CF_READY};
+	simPoke(session->handle, CB_FLAG, 2, ready);
+}
+
+static const struct Benchmark benchmarks[] = {
+	{"umdkDirectWriteBytes(256)",     benchDirectWriteBytes,     NULL},
+	{"umdkDirectWriteWord",           benchDirectWriteWord,      NULL},
+	{"umdkDirectWriteLong",           benchDirectWriteLong,      NULL},
+	{"umdkDirectWriteFile(4KiB)",     benchDirectWriteFile,      NULL},
+	{"umdkPhysicalWriteBytes(256)",   benchPhysicalWriteBytes,   NULL},
+	{"umdkDirectReadBytes(256)",      benchDirectReadBytes,      NULL},
+	{"umdkDirectReadBytes(odd,255)",  benchDirectReadBytesOdd,   NULL},
+	{"umdkDirectReadBytesAsync(256)", benchDirectReadBytesAsync, NULL},
+	{"umdkDirectReadWord",            benchDirectReadWord,       NULL},
+	{"umdkDirectReadLong",            benchDirectReadLong,       NULL},
+	{"umdkWriteBytes(direct,256)",    benchWriteBytesDirect,     NULL},
+	{"umdkWriteBytes(indirect,256)",  benchWriteBytesIndirect,   NULL},
+	{"umdkWriteBytes(indirect,64KiB)",benchWriteBytesIndirect64K,NULL},
+	{"umdkWriteBytes(direct,odd,255)",benchWriteBytesOdd,        NULL},
+	{"umdkWriteBytes(indir,odd,255)", benchWriteBytesIndirectOdd,NULL},
+	{"umdkWriteWord(indirect)",       benchWriteWord,            NULL},
+	{"umdkWriteLong(indirect)",       benchWriteLong,            NULL},
+	{"umdkReadBytes(direct,256)",     benchReadBytesDirect,      NULL},
+	{"umdkReadBytes(indirect,256)",   benchReadBytesIndirect,    NULL},
+	{"umdkReadBytes(indirect,64KiB)", benchReadBytesIndirect64K, NULL},
+	{"umdkReadWord(indirect)",        benchReadWord,             NULL},
+	{"umdkReadLong(indirect)",        benchReadLong,             NULL},
+	{"umdkReadBytes(direct,x4)",      benchReadBytesX4,          NULL},
+	{"umdkReadV(direct,x4)",          benchReadV,                NULL},
+	{"umdkWriteV(direct,x4)",         benchWriteV,               NULL},
+	{"umdkDumpRAM",                   benchDumpRAM,              NULL},
+	{"umdkSetRegister",               benchSetRegister,          NULL},
+	{"umdkGetRegister",               benchGetRegister,          NULL},
+	{"umdkRemoteAcquire",             benchRemoteAcquire,        NULL},
+	{"umdkAcquire(running,20ms)",     benchAcquireTimeout,       tidyReacquire},
+	{"umdkExecuteCommand(read,16)",   benchExecuteCommand,       NULL},
+	{"umdkStep",                      benchStep,                 NULL},
+	{"umdkStepRange",                 benchStepRange,            NULL},
+	{"umdkContWait",                  benchContWait,             NULL},
+	{"umdkContWait(traced)",          benchContWaitTrace,        NULL},
+	{"umdkContinue",                  benchContinue,             tidyReacquire},
+	{"umdkReset",                     benchReset,                tidyReacquire},
+	{NULL, NULL, NULL}
+};
+
+static uint64 nowUsec(void) {
+	#ifdef WIN32
+		LARGE_INTEGER freq, count;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&count);
+		return (uint64)(count.QuadPart * 1000000 / freq.QuadPart);
+	#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64)ts.tv_sec * 1000000 + (uint64)ts.tv_nsec / 1000;
+	#endif
+}
+
+void usage(const char *prog) {
+	printf("Usage: %s [-h] [-l <latency>] [-n <iterations>] [-r <runLength>] [-f <filter>]\n\n", prog);
+	printf("Benchmark the UMDKv2 transport against a simulated FPGALink device.\n\n");
+	printf("  -l <latency>     USB round-trip latency in microseconds (default 125)\n");
+	printf("  -n <iterations>  number of times to call each entry point (default 100)\n");
+	printf("  -r <runLength>   command-flag polls before a continue hits a breakpoint (default 16)\n");
+	printf("  -f <filter>      only run benchmarks whose name contains this string\n");
+	printf("  -h               print this help and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+	int retVal = 0;
+	const char *error = NULL;
+	FLStatus fStatus;
+	int uStatus;
+	struct UmdkSession *session = NULL;
+	const char *latencyStr = NULL, *iterStr = NULL, *runStr = NULL, *filter = NULL;
+	uint32 latency = 125, numIters = 100, runLength = 16, i;
+	const struct Benchmark *bench;
+	struct SimStats stats;
+	uint64 startTime, elapsed;
+	FILE *file = NULL;
+	const char *const prog = argv[0];
+	printf("UMDKv2 Transport Benchmark Copyright (C) 2014 Chris McClelland\n\n");
+	argv++;
+	argc--;
+	while ( argc ) {
+		if ( argv[0][0] != '-' ) {
+			unexpected(prog, *argv);
+			FAIL(1, cleanup);
+		}
+		switch ( argv[0][1] ) {
+		case 'h':
+			usage(prog);
+			FAIL(0, cleanup);
+			break;
+		case 'l':
+			GET_ARG("l", latencyStr, 2, cleanup);
+			latency = (uint32)strtoul(latencyStr, NULL, 0);
+			break;
+		case 'n':
+			GET_ARG("n", iterStr, 3, cleanup);
+			numIters = (uint32)strtoul(iterStr, NULL, 0);
+			break;
+		case 'r':
+			GET_ARG("r", runStr, 4, cleanup);
+			runLength = (uint32)strtoul(runStr, NULL, 0);
+			break;
+		case 'f':
+			GET_ARG("f", filter, 5, cleanup);
+			break;
+		default:
+			invalid(prog, argv[0][1]);
+			FAIL(6, cleanup);
+		}
+		argv++;
+		argc--;
+	}
+
+	// A scratch file for the file-based entry points
+	for ( i = 0; i < sizeof(g_buf); i++ ) {
+		g_buf[i] = (uint8)i;
+	}
+	file = fopen(TMP_FILE, "wb");
+	if ( !file ) {
+		fprintf(stderr, "Unable to create %s!\n", TMP_FILE);
+		FAIL(7, cleanup);
+	}
+	fwrite(g_buf, 1, 4096, file);
+	fclose(file);
+
+	fStatus = flInitialise(0, &error);
+	CHECK_STATUS(fStatus, 8, cleanup);
+	uStatus = umdkOpenSession("1d50:602b", &session, &error);
+	CHECK_STATUS(uStatus, 9, cleanup);
+	simSetLatency(session->handle, latency);
+	simSetRunLength(session->handle, runLength);
+
+	printf("Latency %uus, %u iterations per entry point:\n\n", latency, numIters);
+	printf("%-32s %12s %12s %12s %12s\n", "Entry point", "Trips/call", "Out/call", "In/call", "us/call");
+	for ( bench = benchmarks; bench->name; bench++ ) {
+		if ( filter && !strstr(bench->name, filter) ) {
+			continue;
+		}
+		simResetStats(session->handle);
+		elapsed = 0;
+		for ( i = 0; i < numIters; i++ ) {
+			startTime = nowUsec();
+			uStatus = bench->run(session, &error);
+			elapsed += nowUsec() - startTime;
+			CHECK_STATUS(uStatus, 10, cleanup);
+			if ( bench->tidy ) {
+				bench->tidy(session);
+			}
+		}
+		simGetStats(session->handle, &stats);
+		printf(
+			"%-32s %12.2f %12.1f %12.1f %12.1f\n",
+			bench->name,
+			(double)stats.roundTrips / numIters,
+			(double)stats.bytesOut / numIters,
+			(double)stats.bytesIn / numIters,
+			(double)elapsed / numIters
+		);
+	}
+cleanup:
+	remove(TMP_FILE);
+	if ( error ) {
+		fprintf(stderr, "%s: %s\n", prog, error);
+		flFreeError(error);
+	}
+	umdkCloseSession(session);
+	return retVal;
+}
@@ -0,0 +1,484 @@
+// Breakpoints. GDB removes and reinserts every breakpoint around each stop, so rather than going to
+// the board for every Z0 and z0, the inserts and removes just update a table; a remove followed by
+// a reinsert then costs nothing. Only when the MD is about to run again does brkCommit() bring its
+// memory into line with the table, fetching the opcodes to be replaced with one scatter read and
+// writing the changes back with one scatter write.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <liberror.h>
+#include "range.h"
+#include "break.h"
+#include "agent.h"
+#include "trace.h"
+#include "mem.h"
+#include "session.h"
+
+static uint32 findSlot(const struct BreakTable *table, uint32 addr);
+static int growTable(struct BreakTable *table);
+static void deleteSlot(struct BreakTable *table, uint32 i);
+static int holdSlot(struct BreakTable *table, uint32 addr, uint8 reason);
+static bool releaseSlot(struct BreakTable *table, uint32 addr, uint8 reason);
+static struct BreakInfo *nextInRange(
+	const struct BreakTable *table, uint32 address, uint32 count, uint32 *cursor);
+
+#define INITIAL_SIZE 16
+
+
+// *************************************************************************************************
+// **                                   Recording breakpoints                                     **
+// *************************************************************************************************
+
+// Record that GDB wants a breakpoint at the given address. Returns nonzero if the table couldn't
+// grow to take it. Inserting a breakpoint that is already wanted does nothing.
+//
+int brkInsert(struct BreakTable *table, uint32 addr) {
+	return holdSlot(table, addr, BRK_WANTED);
+}
+
+// Record that GDB no longer wants the breakpoint at the given address. A breakpoint which never
+// made it into memory is forgotten straight away; otherwise its saved opcode is kept until it is
+// written back, in case GDB changes its mind. Returns false if there was no breakpoint there.
+//
+bool brkRemove(struct BreakTable *table, uint32 addr) {
+	return releaseSlot(table, addr, BRK_WANTED);
+}
+
+// Likewise for tracepoints, which need ILLEGAL in memory just as breakpoints do, but which GDB
+// knows nothing about while the trace runs.
+//
+int brkInsertTrace(struct BreakTable *table, uint32 addr) {
+	return holdSlot(table, addr, BRK_TRACE);
+}
+
+bool brkRemoveTrace(struct BreakTable *table, uint32 addr) {
+	return releaseSlot(table, addr, BRK_TRACE);
+}
+
+// Look up the breakpoint at the given address, whatever its state. Returns NULL if there is none.
+//
+const struct BreakInfo *brkFind(const struct BreakTable *table, uint32 addr) {
+	const struct BreakInfo *slot;
+	if ( !table->size ) {
+		return NULL;
+	}
+	slot = table->slots + findSlot(table, addr);
+	return (slot->flags & BRK_USED) ? slot : NULL;
+}
+
+// See whether GDB wants a breakpoint at the given address.
+//
+bool brkIsWanted(const struct BreakTable *table, uint32 addr) {
+	const struct BreakInfo *const slot = brkFind(table, addr);
+	return slot && (slot->flags & BRK_WANTED);
+}
+
+// See whether the MD's memory has a breakpoint (or tracepoint) at the given address.
+//
+bool brkIsInserted(const struct BreakTable *table, uint32 addr) {
+	const struct BreakInfo *const slot = brkFind(table, addr);
+	return slot && (slot->flags & BRK_INSERTED);
+}
+
+// Overlay the saved opcodes of the breakpoints in memory onto a copy of the count bytes of memory
+// at address, so GDB sees the code as it would be without them.
+//
+void brkPatch(const struct BreakTable *table, uint8 *buf, uint32 address, uint32 count) {
+	uint32 cursor = 0;
+	const struct BreakInfo *slot;
+	uint8 save[2];
+	while ( (slot = nextInRange(table, address, count, &cursor)) ) {
+		if ( slot->flags & BRK_INSERTED ) {
+			save[0] = (uint8)(slot->save >> 8);
+			save[1] = (uint8)slot->save;
+			patch(buf, address, count, save, slot->addr);
+		}
+	}
+}
+
+// Account for GDB having written the count bytes of memory at address: any breakpoint there is no
+// longer in memory, and what was written is what must be saved when it goes back in. So needed
+// breakpoints are reinserted, and others forgotten, at the next commit.
+//
+void brkOverwritten(struct BreakTable *table, uint32 address, uint32 count) {
+	uint32 cursor = 0;
+	struct BreakInfo *slot;
+	while ( (slot = nextInRange(table, address, count, &cursor)) ) {
+		if ( slot->flags & BRK_INSERTED ) {
+			slot->flags &= (uint8)~BRK_INSERTED;
+			table->dirty = true;
+		}
+	}
+}
+
+// Give the breakpoint at the given address a new condition: a list of agent expressions, each
+// preceded by its length as a big-endian word. The MD only stops there if one of them is true. An
+// empty list makes the breakpoint unconditional. Returns nonzero if there is no breakpoint there,
+// or the condition couldn't be stored.
+//
+int brkSetCondition(struct BreakTable *table, uint32 addr, const uint8 *cond, uint32 condLength) {
+	struct BreakInfo *const slot = (struct BreakInfo *)brkFind(table, addr);
+	uint8 *copy = NULL;
+	if ( !slot ) {
+		return 1;
+	}
+	if ( condLength ) {
+		copy = (uint8 *)malloc(condLength);
+		if ( !copy ) {
+			return 2;
+		}
+		memcpy(copy, cond, condLength);
+	}
+	free(slot->cond);
+	slot->cond = copy;
+	slot->condLength = condLength;
+	return 0;
+}
+
+// Have the MD resume silently from the next ignoreCount hits of the breakpoint at the given
+// address (counting only those where its condition is true). Returns false if there is none.
+//
+bool brkSetIgnoreCount(struct BreakTable *table, uint32 addr, uint32 ignoreCount) {
+	struct BreakInfo *const slot = (struct BreakInfo *)brkFind(table, addr);
+	if ( !slot ) {
+		return false;
+	}
+	slot->ignoreCount = ignoreCount;
+	return true;
+}
+
+// Forget all the breakpoints, without touching the MD's memory.
+//
+void brkDestroy(struct BreakTable *table) {
+	uint32 i;
+	for ( i = 0; i < table->size; i++ ) {
+		free(table->slots[i].cond);
+	}
+	free(table->slots);
+	memset(table, 0, sizeof(*table));
+}
+
+
+// *************************************************************************************************
+// **                                  Committing breakpoints                                     **
+// *************************************************************************************************
+
+// Bring the MD's memory into line with the breakpoint table: ILLEGAL goes in at each newly-wanted
+// breakpoint, and the saved opcode goes back at each one GDB has finished with. The opcodes about
+// to be replaced are fetched with one scatter read, and all the changes are made with one scatter
+// write. The MegaDrive must be suspended at the monitor.
+//
+int brkCommit(struct UmdkSession *session, const char **error) {
+	struct BreakTable *const table = &session->breakpoints;
+	int retVal = 0, status;
+	struct MemVec *vec = NULL;
+	uint8 *data = NULL;
+	struct BreakInfo *slot;
+	uint32 i, n;
+	if ( !table->dirty ) {
+		return 0;
+	}
+	vec = (struct MemVec *)malloc(table->count * sizeof(struct MemVec));
+	data = (uint8 *)malloc(2 * table->count);
+	CHECK_STATUS(!vec || !data, 1, cleanup, "brkCommit(): Allocation error!");
+
+	// Fetch the opcodes about to be replaced
+	n = 0;
+	for ( i = 0; i < table->size; i++ ) {
+		slot = table->slots + i;
+		if ( (slot->flags & (BRK_USED | BRK_INSERTED)) == BRK_USED && (slot->flags & BRK_NEEDED) ) {
+			vec[n].address = slot->addr;
+			vec[n].length = 2;
+			vec[n].data = data + 2*n;
+			n++;
+		}
+	}
+	if ( n ) {
+		status = umdkReadV(session, vec, n, error);
+		CHECK_STATUS(status, status, cleanup);
+		n = 0;
+		for ( i = 0; i < table->size; i++ ) {
+			slot = table->slots + i;
+			if ( (slot->flags & (BRK_USED | BRK_INSERTED)) == BRK_USED && (slot->flags & BRK_NEEDED) ) {
+				slot->save = (uint16)((data[2*n] << 8) | data[2*n + 1]);
+				n++;
+			}
+		}
+	}
+
+	// Write ILLEGAL over the new breakpoints, and the saved opcodes back over the old ones
+	n = 0;
+	for ( i = 0; i < table->size; i++ ) {
+		slot = table->slots + i;
+		if ( (slot->flags & (BRK_USED | BRK_INSERTED)) == BRK_USED && (slot->flags & BRK_NEEDED) ) {
+			data[2*n] = (uint8)(ILLEGAL >> 8);
+			data[2*n + 1] = (uint8)ILLEGAL;
+		} else if ( (slot->flags & (BRK_USED | BRK_INSERTED | BRK_NEEDED)) == (BRK_USED | BRK_INSERTED) ) {
+			data[2*n] = (uint8)(slot->save >> 8);
+			data[2*n + 1] = (uint8)slot->save;
+		} else {
+			continue;
+		}
+		vec[n].address = slot->addr;
+		vec[n].length = 2;
+		vec[n].data = data + 2*n;
+		n++;
+	}
+	if ( n ) {
+		status = umdkWriteV(session, vec, n, error);
+		CHECK_STATUS(status, status, cleanup);
+	}
+
+	// Now the table matches memory: forget the breakpoints nothing needs any more. Deleting a slot
+	// may move a later one into it, so look at the same slot again.
+	i = 0;
+	while ( i < table->size ) {
+		slot = table->slots + i;
+		if ( slot->flags & BRK_USED ) {
+			if ( !(slot->flags & BRK_NEEDED) ) {
+				deleteSlot(table, i);
+				continue;
+			}
+			slot->flags |= BRK_INSERTED;
+		}
+		i++;
+	}
+	table->dirty = false;
+cleanup:
+	free(data);
+	free(vec);
+	return retVal;
+}
+
+
+// *************************************************************************************************
+// **                                     Handling hits                                          **
+// *************************************************************************************************
+
+// Decide whether the MD, just stopped with the given registers, should be reported to GDB as
+// stopped. It should unless it's at a breakpoint whose condition is false, or whose ignore count
+// hasn't run out, or at a tracepoint (or the remains of a finished trace) GDB has no breakpoint
+// at. A condition which can't be evaluated counts as true, so the user gets to see why.
+//
+bool brkShouldStop(struct UmdkSession *session, const struct Registers *regs) {
+	struct BreakInfo *const slot = (struct BreakInfo *)brkFind(&session->breakpoints, regs->pc);
+	struct AgentEnv env = {session, regs, NULL, NULL};
+	const char *error = NULL;
+	const uint8 *ptr, *end;
+	uint32 length;
+	int64 result;
+	bool hit;
+	if ( !slot ) {
+		return true;
+	}
+	if ( !(slot->flags & BRK_WANTED) ) {
+		return false;
+	}
+	hit = (slot->condLength == 0);
+	ptr = slot->cond;
+	end = ptr + slot->condLength;
+	while ( !hit && ptr < end ) {
+		length = (uint32)((ptr[0] << 8) | ptr[1]);
+		if ( agentEval(ptr + 2, length, &env, &result, &error) ) {
+			printf("Condition at 0x%06X: %s\n", slot->addr, error);
+			flFreeError(error);
+			error = NULL;
+			return true;
+		}
+		hit = (result != 0);
+		ptr += 2 + length;
+	}
+	if ( hit && slot->ignoreCount ) {
+		slot->ignoreCount--;
+		return false;
+	}
+	return hit;
+}
+
+// Step the MD off the breakpoint it's stopped at, by putting the original opcode back just for the
+// one step. If the step fails, the breakpoint is left out of memory, to go back in at the next
+// commit. The MegaDrive must be suspended at the monitor.
+//
+int brkStepOver(struct UmdkSession *session, struct Registers *regs, const char **error) {
+	int retVal = 0, status;
+	struct BreakTable *const table = &session->breakpoints;
+	struct BreakInfo *const slot = (struct BreakInfo *)brkFind(table, regs->pc);
+	const uint32 addr = regs->pc;
+	if ( slot && (slot->flags & BRK_INSERTED) ) {
+		status = umdkWriteWord(session, addr, slot->save, error);
+		CHECK_STATUS(status, status, cleanup);
+		slot->flags &= (uint8)~BRK_INSERTED;
+		table->dirty = true;
+	}
+	status = umdkStep(session, regs, error);
+	CHECK_STATUS(status, status, cleanup);
+	status = brkCommit(session, error);
+	CHECK_STATUS(status, status, cleanup);
+cleanup:
+	return retVal;
+}
+
+// Step the MD one instruction. If it's stopped at one of its own inserted breakpoints (usually a
+// tracepoint GDB doesn't know about), stepping the ILLEGAL would just trap back to the same PC, so
+// that's a hit: any tracepoint there collects its frame, and the original opcode is stepped instead.
+// The MegaDrive must be suspended at the monitor.
+//
+int brkStep(struct UmdkSession *session, struct Registers *regs, const char **error) {
+	int retVal = 0, status;
+	status = umdkGetRegisters(session, regs, error);
+	CHECK_STATUS(status, status, cleanup);
+	if ( brkIsInserted(&session->breakpoints, regs->pc) ) {
+		status = traceHit(session, regs, error);
+		CHECK_STATUS(status, status, cleanup);
+		status = brkStepOver(session, regs, error);
+	} else {
+		status = umdkStep(session, regs, error);
+	}
+	CHECK_STATUS(status, status, cleanup);
+cleanup:
+	return retVal;
+}
+
+
+// *************************************************************************************************
+// **                               Operations private to this file                               **
+// *************************************************************************************************
+
+static uint32 hashAddr(uint32 addr) {
+	return (addr >> 1) * 0x9E3779B1U;  // opcodes are word-aligned
+}
+
+// Find the slot holding the given address, or the empty slot where it would go. The table must
+// have at least one empty slot.
+//
+static uint32 findSlot(const struct BreakTable *table, uint32 addr) {
+	const uint32 mask = table->size - 1;
+	uint32 i = hashAddr(addr) & mask;
+	while ( (table->slots[i].flags & BRK_USED) && table->slots[i].addr != addr ) {
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+// Make sure there's a breakpoint at the given address, held in memory for the given reason.
+//
+static int holdSlot(struct BreakTable *table, uint32 addr, uint8 reason) {
+	struct BreakInfo *slot;
+	if ( (table->count + 1) * 4 > table->size * 3 && growTable(table) ) {
+		return 1;
+	}
+	slot = table->slots + findSlot(table, addr);
+	if ( !(slot->flags & BRK_USED) ) {
+		slot->addr = addr;
+		slot->flags = BRK_USED;
+		table->count++;
+	}
+	if ( !(slot->flags & reason) ) {
+		slot->flags |= reason;
+		table->dirty = true;
+	}
+	return 0;
+}
+
+// Drop the given reason for holding the breakpoint at the given address in memory. If that was
+// the last reason, the breakpoint goes, straight away if it never made it into memory.
+//
+static bool releaseSlot(struct BreakTable *table, uint32 addr, uint8 reason) {
+	uint32 i;
+	struct BreakInfo *slot;
+	if ( !table->size ) {
+		return false;
+	}
+	i = findSlot(table, addr);
+	slot = table->slots + i;
+	if ( !(slot->flags & reason) ) {
+		return false;
+	}
+	slot->flags &= (uint8)~reason;
+	if ( slot->flags & BRK_NEEDED ) {
+		return true;
+	}
+	if ( slot->flags & BRK_INSERTED ) {
+		table->dirty = true;
+	} else {
+		deleteSlot(table, i);
+	}
+	return true;
+}
+
+// Iterate over the breakpoints whose opcode overlaps the count bytes at address, starting with a
+// zero cursor. A short range is looked up a word at a time; for a long one, it's cheaper to scan
+// the whole table. Returns NULL when there are no more.
+//
+static struct BreakInfo *nextInRange(
+	const struct BreakTable *table, uint32 address, uint32 count, uint32 *cursor)
+{
+	const uint32 first = (address - 1) & ~1U;  // a breakpoint here overlaps the first byte
+	const uint32 numWords = (count + 3) / 2;
+	struct BreakInfo *slot;
+	if ( !table->count || !count ) {
+		return NULL;
+	}
+	if ( numWords < table->size ) {
+		while ( *cursor < numWords ) {
+			slot = table->slots + findSlot(table, first + 2 * (*cursor)++);
+			if ( (slot->flags & BRK_USED) && isOverlapping(address, count, slot->addr, 2) ) {
+				return slot;
+			}
+		}
+	} else {
+		while ( *cursor < table->size ) {
+			slot = table->slots + (*cursor)++;
+			if ( (slot->flags & BRK_USED) && isOverlapping(address, count, slot->addr, 2) ) {
+				return slot;
+			}
+		}
+	}
+	return NULL;
+}
+
+// Double the size of the table, rehashing everything into the new slots.
+//
+static int growTable(struct BreakTable *table) {
+	const uint32 newSize = table->size ? 2 * table->size : INITIAL_SIZE;
+	struct BreakInfo *const oldSlots = table->slots;
+	const uint32 oldSize = table->size;
+	uint32 i;
+	struct BreakInfo *const newSlots = (struct BreakInfo *)calloc(newSize, sizeof(struct BreakInfo));
+	if ( !newSlots ) {
+		return 1;
+	}
+	table->slots = newSlots;
+	table->size = newSize;
+	for ( i = 0; i < oldSize; i++ ) {
+		if ( oldSlots[i].flags & BRK_USED ) {
+			table->slots[findSlot(table, oldSlots[i].addr)] = oldSlots[i];
+		}
+	}
+	free(oldSlots);
+	return 0;
+}
+
+// Empty a slot, moving later entries of its cluster back so that every entry can still be reached
+// from its home slot without a gap.
+//
+static void deleteSlot(struct BreakTable *table, uint32 i) {
+	const uint32 mask = table->size - 1;
+	uint32 j = i, home;
+	free(table->slots[i].cond);
+	for ( ;; ) {
+		j = (j + 1) & mask;
+		if ( !(table->slots[j].flags & BRK_USED) ) {
+			break;
+		}
+		home = hashAddr(table->slots[j].addr) & mask;
+		if ( (i <= j) ? (i < home && home <= j) : (i < home || home <= j) ) {
+			continue;  // already between its home and the gap, so it can stay where it is
+		}
+		table->slots[i] = table->slots[j];
+		i = j;
+	}
+	memset(table->slots + i, 0, sizeof(struct BreakInfo));
+	table->count--;
+}
@@ -0,0 +1,72 @@
+#ifndef BREAK_H
+#define BREAK_H
+
+#include <makestuff.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	struct UmdkSession;
+	struct Registers;
+
+	// State of one breakpoint. GDB's inserts and removes (and the starting and stopping of traces)
+	// only change what is needed; the MD's memory is brought into line with that by brkCommit(),
+	// just before it next runs.
+	#define BRK_USED     0x01  // the slot holds a breakpoint
+	#define BRK_WANTED   0x02  // GDB wants the breakpoint inserted
+	#define BRK_INSERTED 0x04  // the MD's memory has ILLEGAL at addr, and save holds what was there
+	#define BRK_TRACE    0x08  // a running trace has a tracepoint at addr
+	#define BRK_NEEDED   (BRK_WANTED | BRK_TRACE)
+	struct BreakInfo {
+		uint32 addr;
+		uint16 save;
+		uint8 flags;
+		uint8 *cond;           // agent expressions, each preceded by its length as a big-endian word
+		uint32 condLength;     // zero if the breakpoint is unconditional
+		uint32 ignoreCount;    // hits to resume from silently before stopping
+	};
+
+	// Breakpoints, hashed by address with linear probing. The table grows as needed, so there is no
+	// limit on the number of breakpoints.
+	struct BreakTable {
+		struct BreakInfo *slots;
+		uint32 size;     // number of slots: zero, or a power of two
+		uint32 count;    // number of slots in use
+		bool dirty;      // some breakpoint's needed and inserted states differ
+	};
+
+	int brkInsert(struct BreakTable *table, uint32 addr) WARN_UNUSED_RESULT;
+	bool brkRemove(struct BreakTable *table, uint32 addr);
+	int brkInsertTrace(struct BreakTable *table, uint32 addr) WARN_UNUSED_RESULT;
+	bool brkRemoveTrace(struct BreakTable *table, uint32 addr);
+	const struct BreakInfo *brkFind(const struct BreakTable *table, uint32 addr);
+	bool brkIsWanted(const struct BreakTable *table, uint32 addr);
+	bool brkIsInserted(const struct BreakTable *table, uint32 addr);
+	void brkPatch(const struct BreakTable *table, uint8 *buf, uint32 address, uint32 count);
+	void brkOverwritten(struct BreakTable *table, uint32 address, uint32 count);
+	int brkSetCondition(
+		struct BreakTable *table, uint32 addr, const uint8 *cond, uint32 condLength
+	) WARN_UNUSED_RESULT;
+	bool brkSetIgnoreCount(struct BreakTable *table, uint32 addr, uint32 ignoreCount);
+	void brkDestroy(struct BreakTable *table);
+
+	int brkCommit(
+		struct UmdkSession *session, const char **error
+	) WARN_UNUSED_RESULT;
+
+	bool brkShouldStop(struct UmdkSession *session, const struct Registers *regs);
+
+	int brkStepOver(
+		struct UmdkSession *session, struct Registers *regs, const char **error
+	) WARN_UNUSED_RESULT;
+
+	int brkStep(
+		struct UmdkSession *session, struct Registers *regs, const char **error
+	) WARN_UNUSED_RESULT;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+// A cache of pages of the MD's memory. It knows nothing of where its pages come from: mem.c fills
+// it as GDB reads, writes through it as anything is written, and empties it as the MD resumes,
+// apart from pages of memory which only the host changes, which are pinned.
+//
+#include <string.h>
+#include "cache.h"
+
+static struct CachePage *findSlot(struct PageCache *cache, uint32 page);
+
+// Get the cached copy of the given page, or NULL if there isn't one. Only pinned pages are any good
+// while the MD is running.
+//
+const uint8 *cacheLookup(struct PageCache *cache, uint32 page, bool stopped) {
+	if ( cacheHas(cache, page, stopped) ) {
+		cache->hits++;
+		return findSlot(cache, page)->data;
+	}
+	cache->misses++;
+	return NULL;
+}
+
+// Likewise, but just see whether the page is there, without counting it as a hit or a miss.
+//
+bool cacheHas(struct PageCache *cache, uint32 page, bool stopped) {
+	const struct CachePage *const slot = findSlot(cache, page);
+	return
+		(slot->flags & CACHE_PAGE_VALID) && slot->page == page &&
+		(stopped || (slot->flags & CACHE_PAGE_PINNED));
+}
+
+// Put a copy of the given page in the cache, in place of whatever was in its slot.
+//
+void cacheInsert(struct PageCache *cache, uint32 page, bool pinned, const uint8 *data) {
+	struct CachePage *const slot = findSlot(cache, page);
+	slot->page = page;
+	slot->flags = (uint8)(pinned ? CACHE_PAGE_VALID | CACHE_PAGE_PINNED : CACHE_PAGE_VALID);
+	memcpy(slot->data, data, CACHE_PAGE_SIZE);
+}
+
+// Update the cached copies of any pages the given write touches, so they stay valid.
+//
+void cacheWrite(struct PageCache *cache, uint32 address, uint32 count, const uint8 *data) {
+	struct CachePage *slot;
+	uint32 page, offset, chunkSize;
+	while ( count ) {
+		page = address / CACHE_PAGE_SIZE;
+		offset = address % CACHE_PAGE_SIZE;
+		chunkSize = CACHE_PAGE_SIZE - offset;
+		if ( chunkSize > count ) {
+			chunkSize = count;
+		}
+		slot = findSlot(cache, page);
+		if ( (slot->flags & CACHE_PAGE_VALID) && slot->page == page ) {
+			memcpy(slot->data + offset, data, chunkSize);
+		}
+		address += chunkSize;
+		data += chunkSize;
+		count -= chunkSize;
+	}
+}
+
+// Drop any pages the given range touches, pinned or not: for when memory is changed in a way the
+// cache can't follow.
+//
+void cacheInvalidate(struct PageCache *cache, uint32 address, uint32 count) {
+	struct CachePage *slot;
+	uint32 page;
+	if ( count ) {
+		for ( page = address / CACHE_PAGE_SIZE; page <= (address + count - 1) / CACHE_PAGE_SIZE; page++ ) {
+			slot = findSlot(cache, page);
+			if ( slot->page == page ) {
+				slot->flags = 0;
+			}
+		}
+	}
+}
+
+// The MD is about to run, so drop all but the pinned pages. Whatever GDB was reading through, it
+// will start afresh at the next stop.
+//
+void cacheResume(struct PageCache *cache) {
+	uint32 i;
+	memset(&cache->stream, 0, sizeof(cache->stream));
+	for ( i = 0; i < CACHE_NUM_SLOTS; i++ ) {
+		if ( !(cache->slots[i].flags & CACHE_PAGE_PINNED) ) {
+			cache->slots[i].flags = 0;
+		}
+	}
+}
+
+// Drop everything.
+//
+void cacheClear(struct PageCache *cache) {
+	uint32 i;
+	memset(&cache->stream, 0, sizeof(cache->stream));
+	for ( i = 0; i < CACHE_NUM_SLOTS; i++ ) {
+		cache->slots[i].flags = 0;
+	}
+}
+
+// Note a read, and see whether it continues a stream: if it and the CACHE_STREAM_RUN - 1 reads
+// before it each moved on from the read before, starting no more than a page beyond where that one
+// ended (or, for a descending stream, ending no more than a page before where it started), return
+// the direction the stream is going in. Otherwise return zero.
+//
+int32 cacheTrackStream(struct PageCache *cache, uint32 address, uint32 count) {
+	struct ReadStream *const stream = &cache->stream;
+	const uint32 end = address + count;
+	int32 direction = 0;
+	if ( end > stream->end && address >= stream->start && address <= stream->end + CACHE_PAGE_SIZE ) {
+		direction = 1;
+	} else if ( address < stream->start && end + CACHE_PAGE_SIZE >= stream->start ) {
+		direction = -1;
+	}
+	if ( direction && direction == stream->direction ) {
+		stream->run++;
+	} else {
+		stream->run = direction ? 1 : 0;
+	}
+	stream->direction = direction;
+	stream->start = address;
+	stream->end = end;
+	return (stream->run >= CACHE_STREAM_RUN) ? direction : 0;
+}
+
+
+// *************************************************************************************************
+// **                               Operations private to this file                               **
+// *************************************************************************************************
+
+// The slot a page goes in. Folding in the higher bits keeps the stack, at the top of WRAM, from
+// fighting with the code at the bottom of the cartridge.
+//
+static struct CachePage *findSlot(struct PageCache *cache, uint32 page) {
+	return &cache->slots[(page ^ (page / CACHE_NUM_SLOTS)) % CACHE_NUM_SLOTS];
+}
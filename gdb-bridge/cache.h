@@ -0,0 +1,56 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <makestuff.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// The cache holds this many pages of this size, so it covers 128KiB of the MD's memory
+	#define CACHE_PAGE_SIZE 256
+	#define CACHE_NUM_SLOTS 512
+
+	#define CACHE_PAGE_VALID  0x01  // the slot holds a copy of its page
+	#define CACHE_PAGE_PINNED 0x02  // only the host changes the page, so it stays good while the MD runs
+	struct CachePage {
+		uint32 page;     // the address of the page's first byte, divided by CACHE_PAGE_SIZE
+		uint8 flags;
+		uint8 data[CACHE_PAGE_SIZE];
+	};
+
+	// The last read, and how many reads in a row have moved on from the one before in the same
+	// direction, so a stream of small sequential reads (GDB disassembling, or walking the stack) can be
+	// spotted, and read ahead of.
+	#define CACHE_STREAM_RUN 2  // moves in a row in one direction which make a stream
+	struct ReadStream {
+		uint32 start;
+		uint32 end;
+		int32 direction;  // +1 for ascending, -1 for descending, or 0
+		uint32 run;
+	};
+
+	// Copies of pages of the MD's memory, so GDB's repeated reads of the same stack, code and
+	// globals while the MD is stopped don't each cost a round trip. Each page may only go in one
+	// slot, so a page just pushes out whichever other page was in its slot. All zeros is empty.
+	struct PageCache {
+		struct CachePage slots[CACHE_NUM_SLOTS];
+		struct ReadStream stream;
+		uint32 hits;
+		uint32 misses;
+	};
+
+	const uint8 *cacheLookup(struct PageCache *cache, uint32 page, bool stopped);
+	bool cacheHas(struct PageCache *cache, uint32 page, bool stopped);
+	void cacheInsert(struct PageCache *cache, uint32 page, bool pinned, const uint8 *data);
+	void cacheWrite(struct PageCache *cache, uint32 address, uint32 count, const uint8 *data);
+	void cacheInvalidate(struct PageCache *cache, uint32 address, uint32 count);
+	void cacheResume(struct PageCache *cache);
+	void cacheClear(struct PageCache *cache);
+	int32 cacheTrackStream(struct PageCache *cache, uint32 address, uint32 count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,353 @@
+// Hex encode/decode and checksum kernels for the GDB remote protocol. Each comes in SSE2 and AVX2
+// flavours as well as a scalar one; the best the CPU supports is used, unless codecSetLevel() says
+// otherwise. The encoder produces the checksum of its output as it goes, so a packet need not be
+// scanned again to finish it.
+//
+#include "codec.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define CODEC_HAVE_SSE2
+	#include <emmintrin.h>
+	#if defined(__GNUC__)
+		// GCC and Clang can compile AVX2 code in functions of its own, and check for it at runtime
+		#define CODEC_HAVE_AVX2
+		#include <immintrin.h>
+		#define AVX2_FUNC __attribute__((target("avx2")))
+	#endif
+#endif
+
+static const char hexDigits[] = {
+	'0', '1', '2', '3', '4', '5', '6', '7',
+	'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+};
+
+static int g_level = -1;  // not yet chosen: see codecInit()
+
+static CodecLevel bestLevel(void);
+static uint8 encodeScalar(char *out, const uint8 *in, uint32 count, uint8 checksum);
+static int decodeScalar(uint8 *out, const char *in, uint32 count);
+static uint8 checksumScalar(const char *data, uint32 count, uint8 checksum);
+#ifdef CODEC_HAVE_SSE2
+	static uint8 encodeSSE2(char *out, const uint8 *in, uint32 count, uint8 checksum);
+	static int decodeSSE2(uint8 *out, const char *in, uint32 count);
+	static uint8 checksumSSE2(const char *data, uint32 count, uint8 checksum);
+#endif
+#ifdef CODEC_HAVE_AVX2
+	static uint8 encodeAVX2(char *out, const uint8 *in, uint32 count, uint8 checksum) AVX2_FUNC;
+	static int decodeAVX2(uint8 *out, const char *in, uint32 count) AVX2_FUNC;
+	static uint8 checksumAVX2(const char *data, uint32 count, uint8 checksum) AVX2_FUNC;
+#endif
+
+
+// *************************************************************************************************
+// **                                        Public kernels                                       **
+// *************************************************************************************************
+
+// Write the (uppercase) hex representation of count bytes to out, which must have room for
+// 2*count chars. Returns the given checksum plus the modulo-256 sum of the chars written.
+//
+uint8 codecHexEncode(char *out, const uint8 *in, uint32 count, uint8 checksum) {
+	switch ( codecGetLevel() ) {
+	#ifdef CODEC_HAVE_AVX2
+	case CODEC_AVX2:
+		return encodeAVX2(out, in, count, checksum);
+	#endif
+	#ifdef CODEC_HAVE_SSE2
+	case CODEC_SSE2:
+		return encodeSSE2(out, in, count, checksum);
+	#endif
+	default:
+		return encodeScalar(out, in, count, checksum);
+	}
+}
+
+// Decode 2*count hex chars (either case) into count bytes. Returns zero on success, or nonzero if
+// any char is not a hex digit, in which case the contents of out are undefined.
+//
+int codecHexDecode(uint8 *out, const char *in, uint32 count) {
+	switch ( codecGetLevel() ) {
+	#ifdef CODEC_HAVE_AVX2
+	case CODEC_AVX2:
+		return decodeAVX2(out, in, count);
+	#endif
+	#ifdef CODEC_HAVE_SSE2
+	case CODEC_SSE2:
+		return decodeSSE2(out, in, count);
+	#endif
+	default:
+		return decodeScalar(out, in, count);
+	}
+}
+
+// Return the given checksum plus the modulo-256 sum of count chars.
+//
+uint8 codecChecksum(const char *data, uint32 count, uint8 checksum) {
+	switch ( codecGetLevel() ) {
+	#ifdef CODEC_HAVE_AVX2
+	case CODEC_AVX2:
+		return checksumAVX2(data, count, checksum);
+	#endif
+	#ifdef CODEC_HAVE_SSE2
+	case CODEC_SSE2:
+		return checksumSSE2(data, count, checksum);
+	#endif
+	default:
+		return checksumScalar(data, count, checksum);
+	}
+}
+
+// Pick the best kernels the CPU supports. A multi-threaded program must call this before starting
+// its threads, since the level is otherwise picked by whichever thread first needs it, with no
+// locking.
+//
+void codecInit(void) {
+	g_level = (int)bestLevel();
+}
+
+CodecLevel codecGetLevel(void) {
+	if ( g_level < 0 ) {
+		codecInit();
+	}
+	return (CodecLevel)g_level;
+}
+
+// Choose the kernels to use, e.g to compare them. Asking for more than the CPU supports gets the
+// best it does support; the level actually chosen is returned.
+//
+CodecLevel codecSetLevel(CodecLevel level) {
+	const CodecLevel best = bestLevel();
+	g_level = (int)((level > best) ? best : level);
+	return (CodecLevel)g_level;
+}
+
+
+// *************************************************************************************************
+// **                               Operations private to this file                               **
+// *************************************************************************************************
+
+static CodecLevel bestLevel(void) {
+	#ifdef CODEC_HAVE_AVX2
+		if ( __builtin_cpu_supports("avx2") ) {
+			return CODEC_AVX2;
+		}
+	#endif
+	#ifdef CODEC_HAVE_SSE2
+		return CODEC_SSE2;
+	#else
+		return CODEC_SCALAR;
+	#endif
+}
+
+static uint8 encodeScalar(char *out, const uint8 *in, uint32 count, uint8 checksum) {
+	uint8 byte;
+	char upper, lower;
+	while ( count-- ) {
+		byte = *in++;
+		upper = hexDigits[byte >> 4];
+		lower = hexDigits[byte & 0x0F];
+		*out++ = upper;
+		*out++ = lower;
+		checksum = (uint8)(checksum + upper + lower);
+	}
+	return checksum;
+}
+
+static int decodeNibble(char hexDigit) {
+	if ( hexDigit >= '0' && hexDigit <= '9' ) {
+		return hexDigit - '0';
+	} else if ( hexDigit >= 'a' && hexDigit <= 'f' ) {
+		return hexDigit - 'a' + 10;
+	} else if ( hexDigit >= 'A' && hexDigit <= 'F' ) {
+		return hexDigit - 'A' + 10;
+	} else {
+		return -1;
+	}
+}
+
+static int decodeScalar(uint8 *out, const char *in, uint32 count) {
+	int upper, lower;
+	while ( count-- ) {
+		upper = decodeNibble(*in++);
+		lower = decodeNibble(*in++);
+		if ( upper < 0 || lower < 0 ) {
+			return 1;
+		}
+		*out++ = (uint8)((upper << 4) | lower);
+	}
+	return 0;
+}
+
+static uint8 checksumScalar(const char *data, uint32 count, uint8 checksum) {
+	while ( count-- ) {
+		checksum = (uint8)(checksum + *data++);
+	}
+	return checksum;
+}
+
+#ifdef CODEC_HAVE_SSE2
+
+// Add up the two 64-bit lanes of a psadbw accumulator; only the bottom byte matters
+static uint8 foldSSE2(__m128i sum) {
+	return (uint8)(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+}
+
+// Turn 16 nibbles into their uppercase hex digits
+static __m128i digitsSSE2(__m128i nibbles) {
+	const __m128i isLetter = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+	return _mm_add_epi8(
+		_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+		_mm_and_si128(isLetter, _mm_set1_epi8('A' - '0' - 10)));
+}
+
+// Turn 16 hex digits into their nibble values, and clear bits in *valid for any that aren't
+static __m128i nibblesSSE2(__m128i chars, __m128i *valid) {
+	const __m128i digit = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+	const __m128i letter = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	const __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+	const __m128i isLetter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+	*valid = _mm_and_si128(*valid, _mm_or_si128(isDigit, isLetter));
+	return _mm_or_si128(
+		_mm_and_si128(isDigit, digit),
+		_mm_and_si128(isLetter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+// Combine each (upper, lower) pair of nibbles into a byte, in the bottom of each 16-bit lane
+static __m128i pairsSSE2(__m128i nibbles) {
+	return _mm_or_si128(
+		_mm_slli_epi16(_mm_and_si128(nibbles, _mm_set1_epi16(0x00FF)), 4),
+		_mm_srli_epi16(nibbles, 8));
+}
+
+static uint8 encodeSSE2(char *out, const uint8 *in, uint32 count, uint8 checksum) {
+	const __m128i mask = _mm_set1_epi8(0x0F);
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum = zero, bytes, upper, lower, first, second;
+	while ( count >= 16 ) {
+		bytes = _mm_loadu_si128((const __m128i *)in);
+		upper = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+		lower = _mm_and_si128(bytes, mask);
+		first = digitsSSE2(_mm_unpacklo_epi8(upper, lower));
+		second = digitsSSE2(_mm_unpackhi_epi8(upper, lower));
+		_mm_storeu_si128((__m128i *)out, first);
+		_mm_storeu_si128((__m128i *)(out + 16), second);
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(first, zero));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(second, zero));
+		in += 16;
+		out += 32;
+		count -= 16;
+	}
+	return encodeScalar(out, in, count, (uint8)(checksum + foldSSE2(sum)));
+}
+
+static int decodeSSE2(uint8 *out, const char *in, uint32 count) {
+	__m128i valid = _mm_set1_epi8(-1), first, second;
+	while ( count >= 16 ) {
+		first = pairsSSE2(nibblesSSE2(_mm_loadu_si128((const __m128i *)in), &valid));
+		second = pairsSSE2(nibblesSSE2(_mm_loadu_si128((const __m128i *)(in + 16)), &valid));
+		_mm_storeu_si128((__m128i *)out, _mm_packus_epi16(first, second));
+		in += 32;
+		out += 16;
+		count -= 16;
+	}
+	if ( _mm_movemask_epi8(valid) != 0xFFFF ) {
+		return 1;
+	}
+	return decodeScalar(out, in, count);
+}
+
+static uint8 checksumSSE2(const char *data, uint32 count, uint8 checksum) {
+	const __m128i zero = _mm_setzero_si128();
+	__m128i sum = zero;
+	while ( count >= 16 ) {
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)data), zero));
+		data += 16;
+		count -= 16;
+	}
+	return checksumScalar(data, count, (uint8)(checksum + foldSSE2(sum)));
+}
+
+#endif
+
+#ifdef CODEC_HAVE_AVX2
+
+AVX2_FUNC static uint8 foldAVX2(__m256i sum) {
+	return foldSSE2(_mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1)));
+}
+
+AVX2_FUNC static __m256i digitsAVX2(__m256i nibbles) {
+	const __m256i isLetter = _mm256_cmpgt_epi8(nibbles, _mm256_set1_epi8(9));
+	return _mm256_add_epi8(
+		_mm256_add_epi8(nibbles, _mm256_set1_epi8('0')),
+		_mm256_and_si256(isLetter, _mm256_set1_epi8('A' - '0' - 10)));
+}
+
+AVX2_FUNC static __m256i nibblesAVX2(__m256i chars, __m256i *valid) {
+	const __m256i digit = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+	const __m256i letter = _mm256_sub_epi8(_mm256_or_si256(chars, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+	const __m256i isDigit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+	const __m256i isLetter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+	*valid = _mm256_and_si256(*valid, _mm256_or_si256(isDigit, isLetter));
+	return _mm256_or_si256(
+		_mm256_and_si256(isDigit, digit),
+		_mm256_and_si256(isLetter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+AVX2_FUNC static __m256i pairsAVX2(__m256i nibbles) {
+	return _mm256_or_si256(
+		_mm256_slli_epi16(_mm256_and_si256(nibbles, _mm256_set1_epi16(0x00FF)), 4),
+		_mm256_srli_epi16(nibbles, 8));
+}
+
+// The unpacks work within 128-bit lanes, so the two halves of the output have to be put back
+// together across lanes before they are stored
+static uint8 encodeAVX2(char *out, const uint8 *in, uint32 count, uint8 checksum) {
+	const __m256i mask = _mm256_set1_epi8(0x0F);
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i sum = zero, bytes, upper, lower, low, high;
+	while ( count >= 32 ) {
+		bytes = _mm256_loadu_si256((const __m256i *)in);
+		upper = _mm256_and_si256(_mm256_srli_epi16(bytes, 4), mask);
+		lower = _mm256_and_si256(bytes, mask);
+		low = digitsAVX2(_mm256_unpacklo_epi8(upper, lower));
+		high = digitsAVX2(_mm256_unpackhi_epi8(upper, lower));
+		_mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(low, high, 0x20));
+		_mm256_storeu_si256((__m256i *)(out + 32), _mm256_permute2x128_si256(low, high, 0x31));
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(low, zero));
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(high, zero));
+		in += 32;
+		out += 64;
+		count -= 32;
+	}
+	return encodeSSE2(out, in, count, (uint8)(checksum + foldAVX2(sum)));
+}
+
+// Likewise the pack works within lanes, so the quadwords come out in the order 0, 2, 1, 3
+static int decodeAVX2(uint8 *out, const char *in, uint32 count) {
+	__m256i valid = _mm256_set1_epi8(-1), first, second;
+	while ( count >= 32 ) {
+		first = pairsAVX2(nibblesAVX2(_mm256_loadu_si256((const __m256i *)in), &valid));
+		second = pairsAVX2(nibblesAVX2(_mm256_loadu_si256((const __m256i *)(in + 32)), &valid));
+		_mm256_storeu_si256(
+			(__m256i *)out, _mm256_permute4x64_epi64(_mm256_packus_epi16(first, second), 0xD8));
+		in += 64;
+		out += 32;
+		count -= 32;
+	}
+	if ( _mm256_movemask_epi8(valid) != -1 ) {
+		return 1;
+	}
+	return decodeSSE2(out, in, count);
+}
+
+static uint8 checksumAVX2(const char *data, uint32 count, uint8 checksum) {
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i sum = zero;
+	while ( count >= 32 ) {
+		sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i *)data), zero));
+		data += 32;
+		count -= 32;
+	}
+	return checksumSSE2(data, count, (uint8)(checksum + foldAVX2(sum)));
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef CODEC_H
+#define CODEC_H
+
+#include <makestuff.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// Which kernels to use. By default the best the CPU supports is picked at runtime.
+	typedef enum {
+		CODEC_SCALAR,
+		CODEC_SSE2,
+		CODEC_AVX2
+	} CodecLevel;
+
+	uint8 codecHexEncode(char *out, const uint8 *in, uint32 count, uint8 checksum);
+	int codecHexDecode(uint8 *out, const char *in, uint32 count);
+	uint8 codecChecksum(const char *data, uint32 count, uint8 checksum);
+
+	void codecInit(void);
+	CodecLevel codecGetLevel(void);
+	CodecLevel codecSetLevel(CodecLevel level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,10 +2,8 @@
 #define ESCAPE_H
 
 #include <makestuff.h>
-#include "sock.h"
 
-void setConnection(SOCKET conn);
-bool isInterrupted(void);
-void setNonBlocking(SOCKET conn, bool nonBlocking);
+struct UmdkSession;
+bool isInterrupted(struct UmdkSession *session);
 
 #endif
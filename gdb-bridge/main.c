@@ -8,34 +8,29 @@
 	#include <unistd.h>
 	#include <sys/socket.h>
 	#include <netinet/in.h>
+	#include <pthread.h>
 #endif
 #include <makestuff.h>
 #include <libfpgalink.h>
 #include <liberror.h>
 #include "sock.h"
 #include "remote.h"
-#include "escape.h"
 #include "mem.h"
 #include "args.h"
+#include "stats.h"
+#include "session.h"
+#include "packet.h"
+#include "codec.h"
 
-static int readMessage(SOCKET conn, char *buf, int bufSize) {
-	char *ptr = buf;
-	const char *const bufEnd = buf + bufSize;
-	char dummy[2], ch;
-	do {
-		if ( recv(conn, &ch, 1, 0) <= 0 ) {
-			return -1;
-		}
-		*ptr++ = ch;
-	} while ( ptr < bufEnd && ch != '#' );
-	if ( ptr == bufEnd && ch != '#' ) {
-		return -3;
-	}
-	if ( recv(conn, dummy, 2, 0) != 2 ) {
-		return -4;
-	}
-	return (int)(ptr - buf - 1);
-}
+#define DEFAULT_VP "1d50:602b"
+#define MAX_BOARDS 16
+
+// One board to drive, and the port (if any) on which to serve GDB connections for it
+struct Board {
+	char vp[32];
+	uint16 listenPort;
+	struct UmdkSession *session;
+};
 
 /*static bool isInterrupted(const struct I68K *cpu) {
 	char ch;
@@ -54,34 +49,120 @@ void printMessage(const unsigned char *data, int length) {
 	printf("\n");
 }*/
 
-static int handleConnection(SOCKET conn, struct FLContext *handle) {
-	char buffer[SOCKET_BUFFER_SIZE];
-	int bytesRead;
-	setNonBlocking(conn, false);
-	bytesRead = readMessage(conn, buffer, SOCKET_BUFFER_SIZE);
-	while ( bytesRead > 0 ) {
-		buffer[bytesRead] = 0;
-		//printf("msg: ");printMessage((const unsigned char *)buffer, bytesRead);
-		setNonBlocking(conn, true);
-		processMessage(buffer, bytesRead, conn, handle);
-		setNonBlocking(conn, false);
-		bytesRead = readMessage(conn, buffer, SOCKET_BUFFER_SIZE);
-	}
-	return bytesRead;
+static void dumpStats(const struct Board *board) {
+	char statsBuf[8192];
+	if ( statsFormat(&board->session->stats, statsBuf, sizeof(statsBuf)) ) {
+		printf("\nTransport statistics for %s:\n%s\n", board->vp, statsBuf);
+	}
 }
 
-void usage(const char *prog) {
-	printf("Usage: %s [-crh] [-w <file:addr>] [-l <listenPort>] [-b <brkAddr>]\n\n", prog);
-	printf("Interact with the UMDKv2 cartridge.\n\n");
-	printf("  -w <file:addr>   write the file to the given address\n");
-	printf("  -l <listenPort>  listen for GDB connections on the given port\n");
-	printf("  -b <brkAddr>     address to use to interrupt execution\n");
-	printf("  -c               continue execution\n");
-	printf("  -r               simulate a reset\n");
-	printf("  -h               print this help and exit\n");
+// Frame packets out of whatever the socket delivers, and process them in turn. Each good packet is
+// acked along with its response; a bad one is nacked so GDB sends it again. Once GDB has asked for
+// QStartNoAckMode, there are no acks either way. Each GDB starts in all-stop mode, whatever the
+// last one asked for.
+static int handleConnection(struct UmdkSession *session) {
+	char *const buffer = session->message;
+	uint32 length;
+	memset(&session->reader, 0, sizeof(session->reader));
+	session->writer.length = 0;
+	session->noAck = false;
+	session->nonStop = false;
+	session->stopRequested = false;
+	session->whileRunning = NULL;
+	for ( ; ; ) {
+		switch ( pktNext(&session->reader, buffer, sizeof(session->message), &length) ) {
+		case PKT_NONE:
+			if ( pktFill(&session->reader, session->conn, true) < 0 ) {
+				return -1;
+			}
+			break;
+		case PKT_MESSAGE:
+			//printf("msg: ");printMessage((const unsigned char *)buffer, length);
+			if ( !session->noAck ) {
+				pktAck(&session->writer, true);
+			}
+			processMessage(buffer, (int)length, session);
+			break;
+		case PKT_INTERRUPT:
+			processMessage("\x03", 1, session);
+			break;
+		default:
+			if ( !session->noAck ) {
+				pktAck(&session->writer, false);
+			}
+			break;
+		}
+
+		// Anything a message didn't send itself (e.g. the ack for one that failed) goes now
+		if ( session->writer.length && pktFlush(&session->writer, session->conn) < 0 ) {
+			return -1;
+		}
+	}
 }
 
-int main(int argc, char *argv[]) {
+// Open the board, then maybe load some data into it, reset it or let it continue.
+static int prepareBoard(
+	struct Board *board, const uint8 *loadData, uint32 loadAddr, uint32 loadSize, bool doReset,
+	bool doCont, const char **error)
+{
+	int retVal = 0;
+	int uStatus;
+	struct UmdkSession *session;
+	uStatus = umdkOpenSession(board->vp, &board->session, error);
+	CHECK_STATUS(uStatus, uStatus, cleanup);
+	session = board->session;
+
+	// Maybe load some data
+	if ( loadData ) {
+		uint16 cmdFlag, oldOp;
+		uint32 vbAddr;
+		uStatus = umdkDirectReadWord(session, CB_FLAG, &cmdFlag, error);
+		CHECK_STATUS(uStatus, uStatus, cleanup);
+		if ( cmdFlag != CF_READY ) {
+			// Read address of VDP vertical interrupt vector & read 1st opcode
+			uStatus = umdkDirectReadLong(session, VB_VEC, &vbAddr, error);
+			CHECK_STATUS(uStatus, uStatus, cleanup);
+			uStatus = umdkDirectReadWord(session, vbAddr, &oldOp, error);
+			CHECK_STATUS(uStatus, uStatus, cleanup);
+			//printf("vbAddr = 0x%06X, opCode = 0x%04X\n", vbAddr, oldOp);
+			
+			// Replace illegal instruction vector
+			uStatus = umdkDirectWriteLong(session, IL_VEC, MONITOR, error);
+			CHECK_STATUS(uStatus, uStatus, cleanup);
+			
+			// Write illegal instruction opcode
+			uStatus = umdkDirectWriteWord(session, vbAddr, ILLEGAL, error);
+			CHECK_STATUS(uStatus, uStatus, cleanup);
+			
+			// Acquire the monitor
+			uStatus = umdkRemoteAcquire(session, NULL, error);
+			CHECK_STATUS(uStatus, uStatus, cleanup);
+			
+			// Restore old opcode to vbAddr
+			uStatus = umdkDirectWriteWord(session, vbAddr, oldOp, error);
+			CHECK_STATUS(uStatus, uStatus, cleanup);
+		}
+		uStatus = umdkPhysicalWriteBytes(session, loadAddr, loadSize, loadData, error);
+		CHECK_STATUS(uStatus, uStatus, cleanup);
+
+		// Keep a copy, so GDB's reads of the code can be answered without asking the board
+		uStatus = umdkAddMirror(session, loadAddr, loadSize, loadData, error);
+		CHECK_STATUS(uStatus, uStatus, cleanup);
+	}
+	if ( doReset ) {
+		uStatus = umdkReset(session, error);
+		CHECK_STATUS(uStatus, uStatus, cleanup);
+	} else if ( doCont ) {
+		uStatus = umdkContinue(session, error);
+		CHECK_STATUS(uStatus, uStatus, cleanup);
+	}
+cleanup:
+	return retVal;
+}
+
+// Accept GDB connections for one board, one at a time, until something goes wrong. Each board has
+// its own thread running this, so all output is prefixed with the port it relates to.
+static int serveBoard(struct Board *board) {
 	int retVal = 0;
 	SOCKET server = 0;
 	SOCKET conn = 0;
@@ -92,24 +173,137 @@ int main(int argc, char *argv[]) {
 	#endif
 	struct sockaddr_in serverAddress = {0,};
 	struct sockaddr_in clientAddress = {0,};
-	#ifdef WIN32
-		WSADATA wsaData;
-	#endif
 	union {
 		uint32 ip4;
-		char ip[4];
+		unsigned char ip[4];
 	} u;
 	const char *error = NULL;
+	struct UmdkSession *const session = board->session;
+	const uint16 listenPort = board->listenPort;
+	server = socket(AF_INET, SOCK_STREAM, 0);
+	if ( server < 0 ) {
+		errRenderStd(&error);
+		FAIL(1, cleanup);
+	}
+	serverAddress.sin_family = AF_INET;
+	serverAddress.sin_addr.s_addr = INADDR_ANY;
+	serverAddress.sin_port = htons(listenPort);
+	retVal = bind(server, (struct sockaddr *)&serverAddress, sizeof(serverAddress));
+	if ( retVal < 0 ) {
+		errRenderStd(&error);
+		FAIL(2, cleanup);
+	}
+	for ( ; ; ) {
+		printf("[:%d] Waiting for GDB connection for %s...\n", listenPort, board->vp);
+		listen(server, 5);
+		clientAddrLen = sizeof(clientAddress);
+		conn = accept(server, (struct sockaddr *)&clientAddress, &clientAddrLen);
+		if ( conn < 0 ) {
+			errRenderStd(&error);
+			FAIL(3, cleanup);
+		}
+		u.ip4 = clientAddress.sin_addr.s_addr;
+		printf("[:%d] Got GDB connection from %d.%d.%d.%d:%d\n", listenPort, u.ip[0], u.ip[1], u.ip[2], u.ip[3], clientAddress.sin_port);
+		session->conn = conn;
+		handleConnection(session);
+		close(conn);
+		conn = 0;
+		printf("[:%d] GDB disconnected\n", listenPort);
+		dumpStats(board);
+	}
+cleanup:
+	if ( error ) {
+		fprintf(stderr, "[:%d] %s\n", listenPort, error);
+		flFreeError(error);
+	}
+	if ( conn > 0 ) {
+		close(conn);
+	}
+	if ( server > 0 ) {
+		close(server);
+	}
+	return retVal;
+}
+
+#ifdef WIN32
+	typedef HANDLE Thread;
+	static DWORD WINAPI serveThread(LPVOID arg) {
+		return (DWORD)serveBoard((struct Board *)arg);
+	}
+	static bool startThread(Thread *thread, struct Board *board) {
+		*thread = CreateThread(NULL, 0, serveThread, board, 0, NULL);
+		return *thread != NULL;
+	}
+	static void joinThread(Thread thread) {
+		WaitForSingleObject(thread, INFINITE);
+		CloseHandle(thread);
+	}
+#else
+	typedef pthread_t Thread;
+	static void *serveThread(void *arg) {
+		serveBoard((struct Board *)arg);
+		return NULL;
+	}
+	static bool startThread(Thread *thread, struct Board *board) {
+		return pthread_create(thread, NULL, serveThread, board) == 0;
+	}
+	static void joinThread(Thread thread) {
+		pthread_join(thread, NULL);
+	}
+#endif
+
+// Parse a "<vp:port>" argument to -s; the port follows the last colon, since the VID:PID may
+// itself have a device ID suffix.
+static bool parseBoard(const char *arg, struct Board *board) {
+	const char *const colon = strrchr(arg, ':');
+	const char *ptr;
+	size_t vpLength;
+	if ( !colon || colon == arg ) {
+		return false;
+	}
+	vpLength = (size_t)(colon - arg);
+	if ( vpLength >= sizeof(board->vp) ) {
+		return false;
+	}
+	memcpy(board->vp, arg, vpLength);
+	board->vp[vpLength] = '\0';
+	ptr = colon + 1;
+	board->listenPort = (uint16)strtoul(ptr, (char**)&ptr, 0);
+	return *ptr == '\0' && ptr != colon + 1;
+}
+
+void usage(const char *prog) {
+	printf("Usage: %s [-crh] [-w <file:addr>] [-v <vp>] [-l <listenPort>] [-s <vp:port>]... [-b <brkAddr>]\n\n", prog);
+	printf("Interact with the UMDKv2 cartridge.\n\n");
+	printf("  -w <file:addr>   write the file to the given SDRAM address, keeping a copy to serve reads\n");
+	printf("  -v <vp>          VID:PID of the board to use (default %s)\n", DEFAULT_VP);
+	printf("  -l <listenPort>  listen for GDB connections on the given port\n");
+	printf("  -s <vp:port>     also serve the board at VID:PID on the given port (repeatable)\n");
+	printf("  -b <brkAddr>     address to use to interrupt execution\n");
+	printf("  -c               continue execution (on every board)\n");
+	printf("  -r               simulate a reset (on every board)\n");
+	printf("  -h               print this help and exit\n");
+}
+
+int main(int argc, char *argv[]) {
+	int retVal = 0;
+	#ifdef WIN32
+		WSADATA wsaData;
+	#endif
+	const char *error = NULL;
 	FLStatus fStatus;
 	int uStatus;
-	struct FLContext *handle = NULL;
+	struct Board boards[MAX_BOARDS];
+	Thread threads[MAX_BOARDS];
+	int numBoards = 1, numThreads = 0, i;
 	bool doCont = false, doReset = false;
-	const char *wrFile = NULL, *listenPortStr = NULL, *brkAddrStr = NULL;
+	const char *wrFile = NULL, *listenPortStr = NULL, *brkAddrStr = NULL, *vpStr = DEFAULT_VP;
+	const char *boardStr = NULL;
 	char *loadFile = NULL;
 	uint8 *loadData = NULL;
-	uint16 listenPort = 0;
 	uint32 brkAddr = 0, loadAddr = 0, loadSize = 0;
 	const char *const prog = argv[0];
+	memset(boards, 0, sizeof(boards));
 	printf("UMDKv2 Bridge Tool Copyright (C) 2014 Chris McClelland\n\n");
 	argv++;
 	argc--;
@@ -126,9 +320,24 @@ int main(int argc, char *argv[]) {
 		case 'w':
 			GET_ARG("w", wrFile, 7, cleanup);
 			break;
+		case 'v':
+			GET_ARG("v", vpStr, 7, cleanup);
+			break;
 		case 'l':
 			GET_ARG("l", listenPortStr, 6, cleanup);
 			break;
+		case 's':
+			GET_ARG("s", boardStr, 7, cleanup);
+			if ( numBoards == MAX_BOARDS ) {
+				fprintf(stderr, "Too many boards: at most %d can be served\n", MAX_BOARDS);
+				FAIL(15, cleanup);
+			}
+			if ( !parseBoard(boardStr, boards + numBoards) ) {
+				fprintf(stderr, "Invalid argument to option -s <vp:port>\n");
+				FAIL(15, cleanup);
+			}
+			numBoards++;
+			break;
 		case 'b':
 			GET_ARG("r", brkAddrStr, 7, cleanup);
 			break;
@@ -145,6 +354,11 @@ int main(int argc, char *argv[]) {
 		argv++;
 		argc--;
 	}
+	if ( strlen(vpStr) >= sizeof(boards[0].vp) ) {
+		fprintf(stderr, "Invalid argument to option -v <vp>\n");
+		FAIL(15, cleanup);
+	}
+	strcpy(boards[0].vp, vpStr);
 	if ( wrFile ) {
 		size_t fileNameLength, numBytes;
 		const char *ptr = wrFile;
@@ -198,7 +412,7 @@ int main(int argc, char *argv[]) {
 	}
 	if ( listenPortStr ) {
 		const char *ptr = listenPortStr;
-		listenPort = (uint16)strtoul(ptr, (char**)&ptr, 0);
+		boards[0].listenPort = (uint16)strtoul(ptr, (char**)&ptr, 0);
 		if ( *ptr != '\0' ) {
 			fprintf(stderr, "Invalid argument to option -l <listenPort>\n");
 			FAIL(15, cleanup);
@@ -217,90 +431,34 @@ int main(int argc, char *argv[]) {
 	fStatus = flInitialise(0, &error);
 	CHECK_STATUS(fStatus, 1, cleanup);
 
-	fStatus = flOpen("1d50:602b", &handle, NULL);
-	CHECK_STATUS(fStatus, 1, cleanup);
-
-	fStatus = flSelectConduit(handle, 0x01, NULL);
-	CHECK_STATUS(fStatus, 1, cleanup);
-
-	// Maybe load some data
-	if ( loadData ) {
-		uint16 cmdFlag, oldOp;
-		uint32 vbAddr;
-		uStatus = umdkDirectReadWord(handle, CB_FLAG, &cmdFlag, NULL);
-		CHECK_STATUS(uStatus, uStatus, cleanup);
-		if ( cmdFlag != CF_READY ) {
-			// Read address of VDP vertical interrupt vector & read 1st opcode
-			uStatus = umdkDirectReadLong(handle, VB_VEC, &vbAddr, NULL);
-			CHECK_STATUS(uStatus, uStatus, cleanup);
-			uStatus = umdkDirectReadWord(handle, vbAddr, &oldOp, NULL);
-			CHECK_STATUS(uStatus, uStatus, cleanup);
-			//printf("vbAddr = 0x%06X, opCode = 0x%04X\n", vbAddr, oldOp);
-			
-			// Replace illegal instruction vector
-			uStatus = umdkDirectWriteLong(handle, IL_VEC, MONITOR, NULL);
-			CHECK_STATUS(uStatus, uStatus, cleanup);
-			
-			// Write illegal instruction opcode
-			uStatus = umdkDirectWriteWord(handle, vbAddr, ILLEGAL, NULL);
-			CHECK_STATUS(uStatus, uStatus, cleanup);
-			
-			// Acquire the monitor
-			uStatus = umdkRemoteAcquire(handle, NULL, NULL);
-			CHECK_STATUS(uStatus, uStatus, cleanup);
-			
-			// Restore old opcode to vbAddr
-			uStatus = umdkDirectWriteWord(handle, vbAddr, oldOp, NULL);
-			CHECK_STATUS(uStatus, uStatus, cleanup);
-		}
-		uStatus = umdkPhysicalWriteBytes(handle, loadAddr, loadSize, loadData, NULL);
+	for ( i = 0; i < numBoards; i++ ) {
+		uStatus = prepareBoard(boards + i, loadData, loadAddr, loadSize, doReset, doCont, &error);
 		CHECK_STATUS(uStatus, uStatus, cleanup);
 	}
-	if ( doReset ) {
-		uStatus = umdkReset(handle, NULL);
-		CHECK_STATUS(uStatus, uStatus, cleanup);
-	} else if ( doCont ) {
-		uStatus = umdkContinue(handle, NULL);
-		CHECK_STATUS(uStatus, uStatus, cleanup);
-	}
-	if ( listenPortStr ) {
-		#ifdef WIN32
-			retVal = WSAStartup(MAKEWORD(2, 2), &wsaData);
-			if ( retVal != 0 ) {
-				printf("WSAStartup failed with error: %d\n", retVal);
-				FAIL(1, cleanup);
-			}
-		#endif
-		server = socket(AF_INET, SOCK_STREAM, 0);
-		if ( server < 0 ) {
-			errRenderStd(&error);
+
+	// Serve each board that has a port on its own thread, having picked the codec kernels they'll
+	// all share first
+	codecInit();
+	#ifdef WIN32
+		retVal = WSAStartup(MAKEWORD(2, 2), &wsaData);
+		if ( retVal != 0 ) {
+			printf("WSAStartup failed with error: %d\n", retVal);
 			FAIL(1, cleanup);
 		}
-		serverAddress.sin_family = AF_INET;
-		serverAddress.sin_addr.s_addr = INADDR_ANY;
-		serverAddress.sin_port = htons(listenPort);
-		retVal = bind(server, (struct sockaddr *)&serverAddress, sizeof(serverAddress));
-		if ( retVal < 0 ) {
-			errRenderStd(&error);
-			FAIL(2, cleanup);
-		}
-		for ( ; ; ) {
-			printf("Waiting for GDB connection on :%d...\n", listenPort);
-			listen(server, 5);
-			clientAddrLen = sizeof(clientAddress);
-			conn = accept(server, (struct sockaddr *)&clientAddress, &clientAddrLen);
-			if ( conn < 0 ) {
-				errRenderStd(&error);
-				FAIL(3, cleanup);
+	#endif
+	for ( i = 0; i < numBoards; i++ ) {
+		if ( boards[i].listenPort ) {
+			if ( !startThread(threads + numThreads, boards + i) ) {
+				fprintf(stderr, "Unable to start a thread for %s\n", boards[i].vp);
+				FAIL(4, cleanup);
 			}
-			u.ip4 = clientAddress.sin_addr.s_addr;
-			printf("Got GDB connection from %d.%d.%d.%d:%d\n", u.ip[0], u.ip[1], u.ip[2], u.ip[3], clientAddress.sin_port);
-			setConnection(conn);
-			handleConnection(conn, handle);
-			printf("GDB disconnected\n");
+			numThreads++;
 		}
 	}
 cleanup:
+	for ( i = 0; i < numThreads; i++ ) {
+		joinThread(threads[i]);
+	}
 	if ( loadFile ) {
 		free(loadFile);
 	}
@@ -308,17 +466,14 @@ cleanup:
 		flFreeFile(loadData);
 	}
 	if ( error ) {
-		fprintf(stderr, "%s: %s\n", argv[0], error);
+		fprintf(stderr, "%s: %s\n", prog, error);
 		flFreeError(error);
 	}
-	if ( conn > 0 ) {
-		close(conn);
-	}
-	if ( server > 0 ) {
-		close(server);
-	}
-	if ( handle ) {
-		flClose(handle);
+	for ( i = 0; i < numBoards; i++ ) {
+		if ( boards[i].session ) {
+			dumpStats(boards + i);
+			umdkCloseSession(boards[i].session);
+		}
 	}
 	return retVal;
 }
@@ -1,37 +1,140 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
 #include <libfpgalink.h>
 #include <liberror.h>
 #include "range.h"
 #include "mem.h"
 #include "escape.h"
+#include "stats.h"
+#include "session.h"
+#include "cache.h"
 
 // Forward-declare local functions
 static void prepMemCtrlCmd(uint8 cmd, uint32 addr, uint8 *buf);
+static uint8 *prepMemCtrlWrite(uint8 *buf, uint32 address, uint32 count, const uint8 *data);
+static int umdkSubmitCommand(
+	struct UmdkSession *session, Command command, uint32 address, uint32 length,
+	const uint8 *sendData, const char **error);
+static bool getDirectPhysical(
+	const struct UmdkSession *session, uint32 address, uint32 count, uint32 *physAddr);
+static uint32 splitRequest(
+	const struct UmdkSession *session, uint32 address, uint32 count, uint8 *data,
+	struct MemVec *parts);
+static bool readMirror(
+	struct UmdkSession *session, uint32 address, uint32 count, uint8 *data);
+static void invalidateMirror(struct UmdkSession *session, uint32 address, uint32 count);
+static const struct MemRegion *findRegion(uint32 address, uint32 *end);
+static int getCachePolicy(const struct UmdkSession *session, uint32 page);
+static bool canCache(const struct UmdkSession *session, uint32 address, uint32 count);
+static bool isCacheableNow(const struct UmdkSession *session, uint32 page);
+static uint32 unaliasWram(uint32 address, uint32 count);
+static void writeThroughCache(
+	struct UmdkSession *session, uint32 address, uint32 count, const uint8 *data);
+static int umdkCachedRead(
+	struct UmdkSession *session, uint32 address, uint32 count, uint8 *data, const char **error);
+static void trackBankWrites(
+	struct UmdkSession *session, uint32 address, uint32 count, const uint8 *data);
+static void captureRegisters(struct UmdkSession *session, const uint8 *block);
+static uint32 nowMsec(void);
+static FLStatus usbWriteAsync(
+	struct UmdkSession *session, uint8 chan, size_t count, const uint8 *data, const char **error);
+static FLStatus usbWrite(
+	struct UmdkSession *session, uint8 chan, size_t count, const uint8 *data, const char **error);
+static FLStatus usbReadSubmit(
+	struct UmdkSession *session, uint8 chan, uint32 count, uint8 *buf, const char **error);
+static FLStatus usbRead(
+	struct UmdkSession *session, uint8 chan, size_t count, uint8 *buf, const char **error);
+static int umdkIndirectReadWords(
+	struct UmdkSession *session, uint32 address, uint32 count, uint8 *data, const char **error);
 static int umdkIndirectReadBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, uint8 *const data,
 	const char **error);
 static int umdkIndirectWriteBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, const uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, const uint8 *const data,
 	const char **error);
+static int umdkReadSpanEnds(
+	struct UmdkSession *session, bool direct, uint32 address, uint32 count, bool head, bool tail,
+	uint8 *buf, const char **error);
 
 #define CHUNK_SIZE 0x10000
 
+// Unaligned indirect writes of spans up to this long have the whole span copied by the monitor to
+// get its end words; longer ones have just the two words copied, one after the other
+#define SPAN_COPY_MAX 64
+
+// How memory in each area of the 68000's address space is to be reached
+typedef enum {
+	MEM_BANKED,   // cartridge space: direct, in banks whose SDRAM page is known, else by the monitor
+	MEM_MONITOR   // only the MD can get at it, so it must be copied by the monitor
+} MemPolicy;
+
+// How long a copy of memory in each area stays good
+typedef enum {
+	CACHE_NEVER,    // it may change even while the MD is stopped, or reading it has side-effects
+	CACHE_STOPPED,  // the MD may change it, so a copy lasts until the MD next runs
+	CACHE_PINNED    // only the host changes it, so a copy lasts until the host writes it
+} CachePolicy;
+
+// The areas of the memory map, in address order. Addresses in the gaps between them are left to the
+// monitor, just like those in the MEM_MONITOR areas, and are never cached.
+static const struct MemRegion {
+	uint32 start;
+	uint32 length;
+	MemPolicy policy;
+	CachePolicy cache;
+} memRegions[] = {
+	{0x000000, 0x400000, MEM_BANKED,  CACHE_STOPPED},  // cartridge, in SSF2 banks: pinnable
+	{0x400000, 0x080000, MEM_BANKED,  CACHE_NEVER},    // the monitor and its buffers
+	{0x480000, 0x380000, MEM_BANKED,  CACHE_STOPPED},  // more cartridge
+	{0xA00000, 0x010000, MEM_MONITOR, CACHE_NEVER},    // Z80 address space: the Z80 may be running
+	{0xA10000, 0x010000, MEM_MONITOR, CACHE_NEVER},    // I/O and control registers
+	{0xC00000, 0x200000, MEM_MONITOR, CACHE_NEVER},    // VDP
+	{0xE00000, 0x1F0000, MEM_MONITOR, CACHE_NEVER},    // WRAM's aliases: cached as WRAM_BASE
+	{0xFF0000, 0x010000, MEM_MONITOR, CACHE_STOPPED}   // WRAM
+};
+#define NUM_REGIONS (sizeof(memRegions) / sizeof(*memRegions))
+
+// WRAM repeats every 64KiB from WRAM_ALIASES up. Its pages are cached under their addresses at
+// WRAM_BASE, whichever alias they're read or written through, so no alias goes stale.
+#define WRAM_ALIASES 0xE00000
+#define WRAM_BASE    0xFF0000
+
+// Reads touching at most this many pages go through the cache; bigger ones go straight to the MD.
+// Streams of reads are read ahead of by CACHE_READ_AHEAD pages at a time.
+#define CACHE_MAX_PAGES  16
+#define CACHE_READ_AHEAD 8
+
+// While umdkAcquire() spins, it checks for cancellation at least once every this many polls
+#define ACQ_CANCEL_POLLS 4
+
+// The most parts splitRequest() can make: at worst, every bank is direct and there is a monitor
+// part before each, and one after the last
+#define MAX_PARTS (2*SSF2_NUM_BANKS + 1)
+
+// The UMDKv2-reserved 512KiB of address-space at 0x400000 is fixed to the top 512KiB of SDRAM
+#define MONITOR_PHYS(x) ((x) + 0xb80000)
+
 
 // *************************************************************************************************
 // **                                Direct read/write operations                                 **
 // *************************************************************************************************
 
 // Direct-write a binary file to the specified address. The area of memory to be written must reside
-// entirely within one of the two direct-writable memory areas (0x000000-0x07FFFF and
-// 0x400000-0x47FFFF, mapped to SDRAM pages 0 and 31 respectively) and must have an even start
-// address and length. The MegaDrive need not be suspended at the monitor.
+// entirely within a single 512KiB cartridge bank whose SDRAM page is known (see umdkSetBankPage())
+// and must have an even start address and length. The MegaDrive need not be suspended at the
+// monitor.
 //
 int umdkDirectWriteFile(
-	struct FLContext *handle, uint32 address, const char *fileName,
+	struct UmdkSession *session, uint32 address, const char *fileName,
 	const char **error)
 {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_DIRECT_WRITE_FILE);
 	int retVal = 0;
 	FLStatus status;
 	uint8 command[8];
@@ -39,25 +142,15 @@ int umdkDirectWriteFile(
 	size_t byteCount;
 	size_t wordCount;
 	uint8 *const fileData = flLoadFile(fileName, &byteCount);
+	const uint32 mdAddress = address;
 	CHECK_STATUS(!fileData, 1, cleanup, "umdkDirectWriteFile(): Cannot read from %s!", fileName);
 
-	// Verify the write is in a legal range
-	if ( isInside(MONITOR, 0x80000, address, byteCount) ) {
-		// Write is to the UMDKv2-reserved 512KiB of address-space at 0x400000. The mapping for this
-		// is fixed to the top 512KiB of SDRAM, so we need to transpose the MD virtual address to
-		// get the correct SDRAM physical address.
-		address += 0xb80000;
-	} else if ( !isInside(0, 0x80000, address, byteCount) ) {
-		// The only other region of the address-space which is directly host-addressable is the
-		// bottom 512KiB of address-space, which has a logical-physical mapping that is guaranteed
-		// by SEGA to be 1:1 (i.e no transpose necessary). So any attempt to directly access memory
-		// anywhere else is an error.
-		CHECK_STATUS(
-			true, 1, cleanup,
-			"umdkDirectWriteFile(): Illegal direct-write to 0x%06X-0x%06X range!",
-			address, address+byteCount-1
-		);
-	}
+	// Verify the write is in a legal range, and find where it is in SDRAM
+	CHECK_STATUS(
+		!getDirectPhysical(session, address, byteCount, &address), 1, cleanup,
+		"umdkDirectWriteFile(): Illegal direct-write to 0x%06X-0x%06X range!",
+		address, address+byteCount-1
+	);
 
 	// Next verify that the write is to an even address, and has even length
 	CHECK_STATUS(address&1, 2, cleanup, "umdkDirectWriteFile(): Address must be even!");
@@ -72,12 +165,15 @@ int umdkDirectWriteFile(
 	prepMemCtrlCmd(0x80, wordCount, command+4);
 
 	// Do the write
-	status = flWriteChannelAsync(handle, 0x00, 8, command, error);
+	status = usbWriteAsync(session, 0x00, 8, command, error);
 	CHECK_STATUS(status, 4, cleanup);
-	status = flWriteChannelAsync(handle, 0x00, byteCount, fileData, error);
+	status = usbWriteAsync(session, 0x00, byteCount, fileData, error);
 	CHECK_STATUS(status, 5, cleanup);
+	cacheInvalidate(&session->cache, mdAddress, (uint32)byteCount);
+	mirrorInvalidate(&session->mirror, address, (uint32)byteCount);
 cleanup:
 	flFreeFile(fileData);
+	statsExit(&frame);
 	return retVal;
 }
 
@@ -89,9 +185,10 @@ cleanup:
 // a recipe for disaster.
 //
 int umdkPhysicalWriteBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, const uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, const uint8 *const data,
 	const char **error)
 {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_PHYSICAL_WRITE_BYTES);
 	int retVal = 0;
 	FLStatus status;
 	uint8 command[8];
@@ -111,46 +208,42 @@ int umdkPhysicalWriteBytes(
 	prepMemCtrlCmd(0x80, wordCount, command+4);
 
 	// Do the write
-	status = flWriteChannelAsync(handle, 0x00, 8, command, error);
+	status = usbWriteAsync(session, 0x00, 8, command, error);
 	CHECK_STATUS(status, 4, cleanup);
-	status = flWriteChannelAsync(handle, 0x00, count, data, error);
+	status = usbWriteAsync(session, 0x00, count, data, error);
 	CHECK_STATUS(status, 5, cleanup);
+
+	// There's no telling which addresses the MD sees this at, so the whole cache must go
+	cacheClear(&session->cache);
+	mirrorInvalidate(&session->mirror, address, count);
 cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
 // Direct-write a sequence of bytes to the specified address. The area of memory to be written must
-// reside entirely within one of the two direct-writable memory areas (0x000000-0x07FFFF and
-// 0x400000-0x47FFFF, mapped to SDRAM pages 0 and 31 respectively) and must have an even start
-// address and length. The MegaDrive need not be suspended at the monitor.
+// reside entirely within a single 512KiB cartridge bank whose SDRAM page is known (see
+// umdkSetBankPage()) and must have an even start address and length. The MegaDrive need not be
+// suspended at the monitor.
 //
 int umdkDirectWriteBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, const uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, const uint8 *const data,
 	const char **error)
 {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_DIRECT_WRITE_BYTES);
 	int retVal = 0;
 	FLStatus status;
 	uint8 command[8];
 	uint32 wordAddr;
 	uint32 wordCount;
+	const uint32 mdAddress = address;
 
-	// First verify the write is in a legal range
-	if ( isInside(MONITOR, 0x80000, address, count) ) {
-		// Write is to the UMDKv2-reserved 512KiB of address-space at 0x400000. The mapping for this
-		// is fixed to the top 512KiB of SDRAM, so we need to transpose the MD virtual address to
-		// get the correct SDRAM physical address.
-		address += 0xb80000;
-	} else if ( !isInside(0, 0x80000, address, count) ) {
-		// The only other region of the address-space which is directly host-addressable is the
-		// bottom 512KiB of address-space, which has a logical-physical mapping that is guaranteed
-		// by SEGA to be 1:1 (i.e no transpose necessary). So any attempt to directly access memory
-		// anywhere else is an error.
-		CHECK_STATUS(
-			true, 1, cleanup,
-			"umdkDirectWriteBytes(): Illegal direct-write to 0x%06X-0x%06X range!",
-			address, address+count-1
-		);
-	}
+	// First verify the write is in a legal range, and find where it is in SDRAM
+	CHECK_STATUS(
+		!getDirectPhysical(session, address, count, &address), 1, cleanup,
+		"umdkDirectWriteBytes(): Illegal direct-write to 0x%06X-0x%06X range!",
+		address, address+count-1
+	);
 
 	// Next verify that the write is to an even address, and has even length
 	CHECK_STATUS(address&1, 2, cleanup, "umdkDirectWriteBytes(): Address must be even!");
@@ -165,21 +258,27 @@ int umdkDirectWriteBytes(
 	prepMemCtrlCmd(0x80, wordCount, command+4);
 
 	// Do the write
-	status = flWriteChannelAsync(handle, 0x00, 8, command, error);
+	status = usbWriteAsync(session, 0x00, 8, command, error);
 	CHECK_STATUS(status, 4, cleanup);
-	status = flWriteChannelAsync(handle, 0x00, count, data, error);
+	status = usbWriteAsync(session, 0x00, count, data, error);
 	CHECK_STATUS(status, 5, cleanup);
+	cacheWrite(&session->cache, mdAddress, count, data);
+
+	// The monitor's housekeeping (the vectors, and the patch it makes to the vertical interrupt
+	// handler and takes out again) comes this way, so the mirror is written through rather than
+	// invalidated, and those pages can still be served from it
+	mirrorWrite(&session->mirror, address, count, data);
 cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
 // Direct-write one 16-bit word to the specified address. The target word must reside entirely
-// within one of the two direct-writable memory areas (0x000000-0x07FFFF and 0x400000-0x47FFFF,
-// mapped to SDRAM pages 0 and 31 respectively) and must have an even start address. The MegaDrive
-// need not be suspended at the monitor.
+// within a single 512KiB cartridge bank whose SDRAM page is known (see umdkSetBankPage()) and must
+// have an even start address. The MegaDrive need not be suspended at the monitor.
 //
 int umdkDirectWriteWord(
-	struct FLContext *handle, const uint32 address, uint16 value, const char **error)
+	struct UmdkSession *session, const uint32 address, uint16 value, const char **error)
 {
 	int retVal = 0;
 	uint8 buf[2];
@@ -187,19 +286,18 @@ int umdkDirectWriteWord(
 	buf[1] = (uint8)value;
 	value >>= 8;
 	buf[0] = (uint8)value;
-	status = umdkDirectWriteBytes(handle, address, 2, buf, error);
+	status = umdkDirectWriteBytes(session, address, 2, buf, error);
 	CHECK_STATUS(status, status, cleanup);
 cleanup:
 	return retVal;
 }
 
 // Direct-write one 32-bit longword to the specified address. The target longword must reside
-// entirely within one of the two direct-writable memory areas (0x000000-0x07FFFF and
-// 0x400000-0x47FFFF, mapped to SDRAM pages 0 and 31 respectively) and must have an even start
-// address. The MegaDrive need not be suspended at the monitor.
+// entirely within a single 512KiB cartridge bank whose SDRAM page is known (see umdkSetBankPage())
+// and must have an even start address. The MegaDrive need not be suspended at the monitor.
 //
 int umdkDirectWriteLong(
-	struct FLContext *handle, const uint32 address, uint32 value, const char **error)
+	struct UmdkSession *session, const uint32 address, uint32 value, const char **error)
 {
 	int retVal = 0;
 	uint8 buf[4];
@@ -211,21 +309,22 @@ int umdkDirectWriteLong(
 	buf[1] = (uint8)value;
 	value >>= 8;
 	buf[0] = (uint8)value;
-	status = umdkDirectWriteBytes(handle, address, 4, buf, error);
+	status = umdkDirectWriteBytes(session, address, 4, buf, error);
 	CHECK_STATUS(status, status, cleanup);
 cleanup:
 	return retVal;
 }
 
 // Synchronously direct-read a sequence of bytes from the specified address. The area of memory to
-// be read must reside entirely within one of the two direct-readable memory areas
-// (0x000000-0x07FFFF and 0x400000-0x47FFFF, mapped to SDRAM pages 0 and 31 respectively). It need
-// not have an even start address or length. The MegaDrive need not be suspended at the monitor.
+// be read must reside entirely within a single 512KiB cartridge bank whose SDRAM page is known (see
+// umdkSetBankPage()). It need not have an even start address or length. The MegaDrive need not be
+// suspended at the monitor.
 //
 int umdkDirectReadBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, uint8 *const data,
 	const char **error)
 {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_DIRECT_READ_BYTES);
 	int retVal = 0;
 	FLStatus status;
 	uint8 command[8];
@@ -233,23 +332,12 @@ int umdkDirectReadBytes(
 	uint32 wordCount;
 	uint8 *tmpBuf = NULL;
 
-	// First verify the read is in a legal range
-	if ( isInside(MONITOR, 0x80000, address, count) ) {
-		// Read is from the UMDKv2-reserved 512KiB of address-space at 0x400000. The mapping for this
-		// is fixed to the top 512KiB of SDRAM, so we need to transpose the MD virtual address to
-		// get the correct SDRAM physical address.
-		address += 0xb80000;
-	} else if ( !isInside(0, 0x80000, address, count) ) {
-		// The only other region of the address-space which is directly host-addressable is the
-		// bottom 512KiB of address-space, which has a logical-physical mapping that is guaranteed
-		// by SEGA to be 1:1 (i.e no transpose necessary). So any attempt to directly access memory
-		// anywhere else is an error.
-		CHECK_STATUS(
-			true, 1, cleanup,
-			"umdkDirectReadBytes(): Illegal direct-read from 0x%06X-0x%06X range!",
-			address, address+count-1
-		);
-	}
+	// First verify the read is in a legal range, and find where it is in SDRAM
+	CHECK_STATUS(
+		!getDirectPhysical(session, address, count, &address), 1, cleanup,
+		"umdkDirectReadBytes(): Illegal direct-read from 0x%06X-0x%06X range!",
+		address, address+count-1
+	);
 
 	// Reads from odd addresses or for odd lengths need to be done via a temporary buffer
 	if ( address & 1 ) {
@@ -264,11 +352,11 @@ int umdkDirectReadBytes(
 		prepMemCtrlCmd(0x40, wordCount, command+4);
 		
 		// Send the read request
-		status = flWriteChannelAsync(handle, 0x00, 8, command, error);
+		status = usbWriteAsync(session, 0x00, 8, command, error);
 		CHECK_STATUS(status, 3, cleanup);
 		
 		// Receive the data
-		status = flReadChannel(handle, 0x00, 2*wordCount, tmpBuf, error);
+		status = usbRead(session, 0x00, 2*wordCount, tmpBuf, error);
 		CHECK_STATUS(status, 4, cleanup);
 		memcpy(data, tmpBuf+1, count);
 	} else {
@@ -285,11 +373,11 @@ int umdkDirectReadBytes(
 			prepMemCtrlCmd(0x40, wordCount, command+4);
 			
 			// Send the read request
-			status = flWriteChannelAsync(handle, 0x00, 8, command, error);
+			status = usbWriteAsync(session, 0x00, 8, command, error);
 			CHECK_STATUS(status, 6, cleanup);
 			
 			// Receive the data
-			status = flReadChannel(handle, 0x00, 2*wordCount, tmpBuf, error);
+			status = usbRead(session, 0x00, 2*wordCount, tmpBuf, error);
 			CHECK_STATUS(status, 7, cleanup);
 			memcpy(data, tmpBuf, count);
 		} else {
@@ -302,51 +390,41 @@ int umdkDirectReadBytes(
 			prepMemCtrlCmd(0x40, wordCount, command+4);
 			
 			// Send the read request
-			status = flWriteChannelAsync(handle, 0x00, 8, command, error);
+			status = usbWriteAsync(session, 0x00, 8, command, error);
 			CHECK_STATUS(status, 8, cleanup);
 			
 			// Receive the data
-			status = flReadChannel(handle, 0x00, count, data, error);
+			status = usbRead(session, 0x00, count, data, error);
 			CHECK_STATUS(status, 9, cleanup);
 		}
 	}
 cleanup:
 	free(tmpBuf);
+	statsExit(&frame);
 	return retVal;
 }
 
 // Asynchronously direct-read a sequence of bytes from the specified address. The area of memory to
-// be read must reside entirely within one of the two direct-readable memory areas
-// (0x000000-0x07FFFF and 0x400000-0x47FFFF, mapped to SDRAM pages 0 and 31 respectively). Unlike
-// umdkDirectReadBytes(), this function must be given an even start address and count. The
-// MegaDrive need not be suspended at the monitor. This does an asynchronous read, so each call to
-// this function must match a later call to FPGALink's flReadChannelAsyncAwait(), to retrieve the
-// actual data.
+// be read must reside entirely within a single 512KiB cartridge bank whose SDRAM page is known (see
+// umdkSetBankPage()). Unlike umdkDirectReadBytes(), this function must be given an even start
+// address and count. The MegaDrive need not be suspended at the monitor. This does an asynchronous
+// read, so each call to this function must match a later call to FPGALink's
+// flReadChannelAsyncAwait(), to retrieve the actual data.
 //
 int umdkDirectReadBytesAsync(
-	struct FLContext *handle, uint32 address, const uint32 count, const char **error)
+	struct UmdkSession *session, uint32 address, const uint32 count, const char **error)
 {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_DIRECT_READ_BYTES_ASYNC);
 	int retVal = 0;
 	FLStatus status;
 	uint8 command[8];
 
-	// First verify the read is in a legal range
-	if ( isInside(MONITOR, 0x80000, address, count) ) {
-		// Read is from the UMDKv2-reserved 512KiB of address-space at 0x400000. The mapping for this
-		// is fixed to the top 512KiB of SDRAM, so we need to transpose the MD virtual address to
-		// get the correct SDRAM physical address.
-		address += 0xb80000;
-	} else if ( !isInside(0, 0x80000, address, count) ) {
-		// The only other region of the address-space which is directly host-addressable is the
-		// bottom 512KiB of address-space, which has a logical-physical mapping that is guaranteed
-		// by SEGA to be 1:1 (i.e no transpose necessary). So any attempt to directly access memory
-		// anywhere else is an error.
-		CHECK_STATUS(
-			true, 1, cleanup,
-			"umdkDirectReadBytesAsync(): Illegal direct-read from 0x%06X-0x%06X range!",
-			address, address+count-1
-		);
-	}
+	// First verify the read is in a legal range, and find where it is in SDRAM
+	CHECK_STATUS(
+		!getDirectPhysical(session, address, count, &address), 1, cleanup,
+		"umdkDirectReadBytesAsync(): Illegal direct-read from 0x%06X-0x%06X range!",
+		address, address+count-1
+	);
 
 	// Next verify that the read is to an even address, and has even length
 	CHECK_STATUS(address&1, 2, cleanup, "umdkDirectReadBytesAsync(): Address must be even!");
@@ -357,28 +435,28 @@ int umdkDirectReadBytesAsync(
 	prepMemCtrlCmd(0x40, count/2, command+4);
 	
 	// Send the read request
-	status = flWriteChannelAsync(handle, 0x00, 8, command, error);
+	status = usbWriteAsync(session, 0x00, 8, command, error);
 	CHECK_STATUS(status, 8, cleanup);
 	
 	// Submit the read
-	status = flReadChannelAsyncSubmit(handle, 0x00, count, NULL, error);
+	status = usbReadSubmit(session, 0x00, count, NULL, error);
 	CHECK_STATUS(status, 9, cleanup);
 cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
 // Direct-read one 16-bit word from the specified address. The source word must reside entirely
-// within one of the two direct-readable memory areas (0x000000-0x07FFFF and 0x400000-0x47FFFF,
-// mapped to SDRAM pages 0 and 31 respectively). It need not have an even start address. The
-// MegaDrive need not be suspended at the monitor.
+// within a single 512KiB cartridge bank whose SDRAM page is known (see umdkSetBankPage()). It need
+// not have an even start address. The MegaDrive need not be suspended at the monitor.
 //
 int umdkDirectReadWord(
-	struct FLContext *handle, const uint32 address, uint16 *const pValue, const char **error)
+	struct UmdkSession *session, const uint32 address, uint16 *const pValue, const char **error)
 {
 	int retVal = 0;
 	uint8 buf[2];
 	uint16 value;
-	int status = umdkDirectReadBytes(handle, address, 2, buf, error);
+	int status = umdkDirectReadBytes(session, address, 2, buf, error);
 	CHECK_STATUS(status, status, cleanup);
 	value = buf[0];
 	value <<= 8;
@@ -389,17 +467,16 @@ cleanup:
 }
 
 // Direct-read one 32-bit longword from the specified address. The source longword must reside
-// entirely within one of the two direct-readable memory areas (0x000000-0x07FFFF and
-// 0x400000-0x47FFFF, mapped to SDRAM pages 0 and 31 respectively). It need not have an even start
-// address. The MegaDrive need not be suspended at the monitor.
+// entirely within a single 512KiB cartridge bank whose SDRAM page is known (see umdkSetBankPage()).
+// It need not have an even start address. The MegaDrive need not be suspended at the monitor.
 //
 int umdkDirectReadLong(
-	struct FLContext *handle, const uint32 address, uint32 *const pValue, const char **error)
+	struct UmdkSession *session, const uint32 address, uint32 *const pValue, const char **error)
 {
 	int retVal = 0;
 	uint8 buf[4];
 	uint32 value;
-	int status = umdkDirectReadBytes(handle, address, 4, buf, error);
+	int status = umdkDirectReadBytes(session, address, 4, buf, error);
 	CHECK_STATUS(status, status, cleanup);
 	value = buf[0];
 	value <<= 8;
@@ -418,31 +495,90 @@ cleanup:
 // **                                Generic read/write operations                                **
 // *************************************************************************************************
 
-// Write a sequence of bytes to the specified address. If the region to be written resides entirely
-// within one of the two direct-writable memory areas (0x000000-0x07FFFF and 0x400000-0x47FFFF,
-// mapped to SDRAM pages 0 and 31 respectively), then the write is done directly without the need
-// for the MegaDrive to be suspended at the monitor. Otherwise, it is done through the monitor. In
-// both cases, the region to be written must have an even start address and length.
+// Write a sequence of bytes to the specified address. The region is split at the boundaries in the
+// memory map (see splitRequest()): the parts in cartridge banks whose SDRAM page is known (see
+// umdkSetBankPage()) are written directly, and the rest through the monitor, which needs the
+// MegaDrive to be suspended there. A region lying wholly in one part is written with no splitting.
+//
+// The region need not have an even start address or length: the SDRAM and the monitor both work
+// in 16-bit words, so an unaligned write fetches the word(s) straddling its ends in one pipelined
+// batch per part, merges the new bytes in and writes back the whole word-aligned span.
 //
 int umdkWriteBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, const uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, const uint8 *const data,
 	const char **error)
 {
-	// GDB sometimes requests zero-length writes, which succeed trivially
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_WRITE_BYTES);
+	int retVal = 0;
+	int status;
+	uint8 stackBuf[256];
+	uint8 *buf = stackBuf;
+	struct MemVec parts[MAX_PARTS];
+	const struct MemVec *last;
+	uint32 spanAddr, spanLen, physAddr, numParts;
+
 	if ( count == 0 ) {
-		return 0;
+		// GDB sometimes requests zero-length writes, which succeed trivially
+		goto cleanup;
+	}
+	spanAddr = address & ~1U;
+	spanLen = ((address + count + 1) & ~1U) - spanAddr;
+	if ( !((address | count) & 1) ) {
+		// Aligned: the data can be written as it is
+		buf = (uint8*)data;
+	} else {
+		// Unaligned: read the existing words at the ends of the span and merge the new data in
+		if ( spanLen > sizeof(stackBuf) ) {
+			buf = (uint8*)malloc(spanLen);
+			CHECK_STATUS(!buf, 5, cleanup, "umdkWriteBytes(): Allocation error!");
+		}
+	}
+	numParts = splitRequest(session, spanAddr, spanLen, buf, parts);
+	last = parts + numParts - 1;
+	if ( buf != data ) {
+		if ( numParts == 1 ) {
+			status = umdkReadSpanEnds(
+				session, getDirectPhysical(session, spanAddr, spanLen, &physAddr),
+				spanAddr, spanLen, address & 1, (address + count) & 1, buf, error);
+			CHECK_STATUS(status, status, cleanup);
+		} else {
+			if ( address & 1 ) {
+				status = umdkReadSpanEnds(
+					session, getDirectPhysical(session, parts->address, parts->length, &physAddr),
+					parts->address, parts->length, true, false, parts->data, error);
+				CHECK_STATUS(status, status, cleanup);
+			}
+			if ( (address + count) & 1 ) {
+				status = umdkReadSpanEnds(
+					session, getDirectPhysical(session, last->address, last->length, &physAddr),
+					last->address, last->length, false, true, last->data, error);
+				CHECK_STATUS(status, status, cleanup);
+			}
+		}
+		memcpy(buf + (address & 1), data, count);
 	}
 
-	// Determine from the range whether to use a direct or indirect write
-	if ( isInside(MONITOR, 0x80000, address, count) || isInside(0, 0x80000, address, count) ) {
-		return umdkDirectWriteBytes(handle, address, count, data, error);
+	// Write the whole span, in one go if it's all in one part. Whichever way it goes, the mirror
+	// can no longer vouch for it
+	invalidateMirror(session, spanAddr, spanLen);
+	if ( numParts == 1 ) {
+		status = getDirectPhysical(session, spanAddr, spanLen, &physAddr) ?
+			umdkDirectWriteBytes(session, spanAddr, spanLen, buf, error) :
+			umdkIndirectWriteBytes(session, spanAddr, spanLen, buf, error);
 	} else {
-		return umdkIndirectWriteBytes(handle, address, count, data, error);
+		status = umdkWriteV(session, parts, numParts, error);
 	}
+	CHECK_STATUS(status, status, cleanup);
+cleanup:
+	if ( buf != stackBuf && buf != data ) {
+		free(buf);
+	}
+	statsExit(&frame);
+	return retVal;
 }
 
 int umdkWriteWord(
-	struct FLContext *handle, const uint32 address, uint16 value, const char **error)
+	struct UmdkSession *session, const uint32 address, uint16 value, const char **error)
 {
 	int retVal = 0;
 	uint8 buf[2];
@@ -450,14 +586,14 @@ int umdkWriteWord(
 	buf[1] = (uint8)value;
 	value >>= 8;
 	buf[0] = (uint8)value;
-	status = umdkWriteBytes(handle, address, 2, buf, error);
+	status = umdkWriteBytes(session, address, 2, buf, error);
 	CHECK_STATUS(status, status, cleanup);
 cleanup:
 	return retVal;
 }
 
 int umdkWriteLong(
-	struct FLContext *handle, const uint32 address, uint32 value, const char **error)
+	struct UmdkSession *session, const uint32 address, uint32 value, const char **error)
 {
 	int retVal = 0;
 	uint8 buf[4];
@@ -469,37 +605,61 @@ int umdkWriteLong(
 	buf[1] = (uint8)value;
 	value >>= 8;
 	buf[0] = (uint8)value;
-	status = umdkWriteBytes(handle, address, 4, buf, error);
+	status = umdkWriteBytes(session, address, 4, buf, error);
 	CHECK_STATUS(status, status, cleanup);
 cleanup:
 	return retVal;
 }
 
-// Read a sequence of bytes from the specified address. If the region to be read resides entirely
-// within one of the two direct-readable memory areas (0x000000-0x07FFFF and 0x400000-0x47FFFF,
-// mapped to SDRAM pages 0 and 31 respectively), then the read is done directly without the need
-// for the MegaDrive to be suspended at the monitor. Otherwise, it is done through the monitor. In
-// both cases, the region to be read need not have an even start address and length.
+// Read a sequence of bytes from the specified address. The region is split at the boundaries in the
+// memory map (see splitRequest()): the parts in cartridge banks whose SDRAM page is known (see
+// umdkSetBankPage()) are read directly, all in one pipelined batch, and the rest through the
+// monitor, which needs the MegaDrive to be suspended there. So a large read which strays a little
+// out of direct memory only pays the monitor's cost for the bytes that need it. The region to be
+// read need not have an even start address or length.
+//
+// Small reads of cacheable memory (see memRegions) are served from the page cache instead, which
+// fetches only the pages it doesn't already have. The cache is written through by every write made
+// here, and emptied of everything but the pinned pages whenever the MD is resumed or reset.
+//
+// Reads of cartridge memory which lie wholly in unchanged pages of an image the host uploaded (see
+// umdkAddMirror()) don't go to the board at all, whether the MD is running or not. Breakpoints
+// don't mark pages changed, so reads behind them get the original opcodes.
 //
 int umdkReadBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, uint8 *const data,
 	const char **error)
 {
-	// Determine from the range whether to use a direct or indirect read
-	if ( isInside(MONITOR, 0x80000, address, count) || isInside(0, 0x80000, address, count) ) {
-		return umdkDirectReadBytes(handle, address, count, data, error);
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_READ_BYTES);
+	int retVal;
+	uint32 physAddr, numParts;
+	struct MemVec parts[MAX_PARTS];
+
+	// Small reads of memory which can be cached go through the cache; otherwise determine from the
+	// range whether to use a direct or indirect read, or both
+	numParts = count ? splitRequest(session, address, count, data, parts) : 1;
+	if ( count && readMirror(session, address, count, data) ) {
+		retVal = 0;
+	} else if ( canCache(session, unaliasWram(address, count), count) ) {
+		retVal = umdkCachedRead(session, unaliasWram(address, count), count, data, error);
+	} else if ( numParts > 1 ) {
+		retVal = umdkReadV(session, parts, numParts, error);
+	} else if ( getDirectPhysical(session, address, count, &physAddr) ) {
+		retVal = umdkDirectReadBytes(session, address, count, data, error);
 	} else {
-		return umdkIndirectReadBytes(handle, address, count, data, error);
+		retVal = umdkIndirectReadBytes(session, address, count, data, error);
 	}
+	statsExit(&frame);
+	return retVal;
 }
 
 int umdkReadWord(
-	struct FLContext *handle, const uint32 address, uint16 *const pValue, const char **error)
+	struct UmdkSession *session, const uint32 address, uint16 *const pValue, const char **error)
 {
 	int retVal = 0;
 	uint8 buf[2];
 	uint16 value;
-	int status = umdkReadBytes(handle, address, 2, buf, error);
+	int status = umdkReadBytes(session, address, 2, buf, error);
 	CHECK_STATUS(status, status, cleanup);
 	value = buf[0];
 	value <<= 8;
@@ -510,12 +670,12 @@ cleanup:
 }
 
 int umdkReadLong(
-	struct FLContext *handle, const uint32 address, uint32 *const pValue, const char **error)
+	struct UmdkSession *session, const uint32 address, uint32 *const pValue, const char **error)
 {
 	int retVal = 0;
 	uint8 buf[4];
 	uint32 value;
-	int status = umdkReadBytes(handle, address, 4, buf, error);
+	int status = umdkReadBytes(session, address, 4, buf, error);
 	CHECK_STATUS(status, status, cleanup);
 	value = buf[0];
 	value <<= 8;
@@ -529,28 +689,218 @@ cleanup:
 	return retVal;
 }
 
+// *************************************************************************************************
+// **                              Scatter/gather read/write operations                           **
+// *************************************************************************************************
+
+// Read a list of (possibly disjoint) regions. The SDRAM-controller commands for all the regions
+// which lie entirely within a single cartridge bank whose SDRAM page is known are sent in one
+// write, and all their reads are submitted before any is awaited, so however many there are, they
+// cost about one USB round trip. Other regions are read through the monitor afterwards, one at a
+// time, which needs the MegaDrive to be suspended at the monitor. Regions need not have an even
+// start address or length.
+//
+int umdkReadV(
+	struct UmdkSession *session, const struct MemVec *vec, uint32 count, const char **error)
+{
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_READ_V);
+	int retVal = 0;
+	FLStatus status;
+	int uStatus;
+	uint8 *cmdBuf = NULL, *ptr;
+	uint32 i, physAddr, rawBytes, chunkSize, offset, skip, from, to;
+	uint32 requestLength, actualLength;
+	const uint8 *recvData;
+
+	// Queue the commands for all the direct regions
+	cmdBuf = (uint8*)malloc(8*count + 1);
+	CHECK_STATUS(!cmdBuf, 1, cleanup, "umdkReadV(): Allocation error!");
+	ptr = cmdBuf;
+	for ( i = 0; i < count; i++ ) {
+		if ( vec[i].length && getDirectPhysical(session, vec[i].address, vec[i].length, &physAddr) ) {
+			prepMemCtrlCmd(0x00, physAddr/2, ptr);
+			prepMemCtrlCmd(0x40, (physAddr + vec[i].length + 1)/2 - physAddr/2, ptr+4);
+			ptr += 8;
+		}
+	}
+	if ( ptr != cmdBuf ) {
+		status = usbWriteAsync(session, 0x00, (size_t)(ptr - cmdBuf), cmdBuf, error);
+		CHECK_STATUS(status, 2, cleanup);
+	}
+
+	// Submit all the reads; the response data for each region is in whole words, and may need to be
+	// split into several reads if it's large
+	for ( i = 0; i < count; i++ ) {
+		if ( vec[i].length && getDirectPhysical(session, vec[i].address, vec[i].length, &physAddr) ) {
+			rawBytes = 2 * ((physAddr + vec[i].length + 1)/2 - physAddr/2);
+			while ( rawBytes ) {
+				chunkSize = (rawBytes > CHUNK_SIZE) ? CHUNK_SIZE : rawBytes;
+				status = usbReadSubmit(session, 0x00, chunkSize, NULL, error);
+				CHECK_STATUS(status, 3, cleanup);
+				rawBytes -= chunkSize;
+			}
+		}
+	}
+
+	// Now await them all, copying the wanted bytes out of each chunk of words
+	for ( i = 0; i < count; i++ ) {
+		if ( vec[i].length && getDirectPhysical(session, vec[i].address, vec[i].length, &physAddr) ) {
+			skip = physAddr & 1;
+			rawBytes = 2 * ((physAddr + vec[i].length + 1)/2 - physAddr/2);
+			offset = 0;
+			while ( offset < rawBytes ) {
+				status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+				CHECK_STATUS(status, 4, cleanup);
+				CHECK_STATUS(actualLength != requestLength, 5, cleanup, "umdkReadV(): Short read!");
+				from = (offset > skip) ? offset : skip;
+				to = offset + actualLength;
+				if ( to > skip + vec[i].length ) {
+					to = skip + vec[i].length;
+				}
+				if ( to > from ) {
+					memcpy(vec[i].data + from - skip, recvData + from - offset, to - from);
+				}
+				offset += actualLength;
+			}
+		}
+	}
+
+	// Finally, read the regions which have to go through the monitor
+	for ( i = 0; i < count; i++ ) {
+		if ( vec[i].length && !getDirectPhysical(session, vec[i].address, vec[i].length, &physAddr) ) {
+			uStatus = umdkIndirectReadBytes(session, vec[i].address, vec[i].length, vec[i].data, error);
+			CHECK_STATUS(uStatus, uStatus, cleanup);
+		}
+	}
+cleanup:
+	free(cmdBuf);
+	statsExit(&frame);
+	return retVal;
+}
+
+// Write a list of (possibly disjoint) regions. The writes to all the regions which lie entirely
+// within a single cartridge bank whose SDRAM page is known are built into one SDRAM-controller
+// command stream and sent with a single async write. Other regions are written through the monitor
+// afterwards, one at a time, which needs the MegaDrive to be suspended at the monitor. All regions
+// must have an even start address and length.
+//
+// This is how breakpoints go in and come out, so it leaves the mirror alone: the mirror keeps the
+// opcodes they cover. Anything else that writes with it must call invalidateMirror() itself, as
+// umdkWriteBytes() does.
+//
+int umdkWriteV(
+	struct UmdkSession *session, const struct MemVec *vec, uint32 count, const char **error)
+{
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_WRITE_V);
+	int retVal = 0;
+	FLStatus status;
+	int uStatus;
+	uint8 *cmdBuf = NULL, *ptr;
+	uint32 i, physAddr, bufSize = 1;
+
+	// Validate everything before writing anything
+	for ( i = 0; i < count; i++ ) {
+		CHECK_STATUS(
+			vec[i].address&1, 2, cleanup,
+			"umdkWriteV(): Address 0x%06X must be even!", vec[i].address);
+		CHECK_STATUS(
+			vec[i].length&1, 3, cleanup,
+			"umdkWriteV(): Count for address 0x%06X must be even!", vec[i].address);
+		if ( vec[i].length && getDirectPhysical(session, vec[i].address, vec[i].length, &physAddr) ) {
+			bufSize += 8 + vec[i].length;
+		}
+	}
+
+	// Build the direct writes into one command stream
+	cmdBuf = (uint8*)malloc(bufSize);
+	CHECK_STATUS(!cmdBuf, 1, cleanup, "umdkWriteV(): Allocation error!");
+	ptr = cmdBuf;
+	for ( i = 0; i < count; i++ ) {
+		if ( vec[i].length && getDirectPhysical(session, vec[i].address, vec[i].length, &physAddr) ) {
+			ptr = prepMemCtrlWrite(ptr, physAddr, vec[i].length, vec[i].data);
+		}
+	}
+	if ( ptr != cmdBuf ) {
+		status = usbWriteAsync(session, 0x00, (size_t)(ptr - cmdBuf), cmdBuf, error);
+		CHECK_STATUS(status, 4, cleanup);
+		for ( i = 0; i < count; i++ ) {
+			if ( vec[i].length && getDirectPhysical(session, vec[i].address, vec[i].length, &physAddr) ) {
+				cacheWrite(&session->cache, vec[i].address, vec[i].length, vec[i].data);
+			}
+		}
+	}
+
+	// Write the regions which have to go through the monitor
+	for ( i = 0; i < count; i++ ) {
+		if ( vec[i].length && !getDirectPhysical(session, vec[i].address, vec[i].length, &physAddr) ) {
+			uStatus = umdkIndirectWriteBytes(session, vec[i].address, vec[i].length, vec[i].data, error);
+			CHECK_STATUS(uStatus, uStatus, cleanup);
+		}
+	}
+cleanup:
+	free(cmdBuf);
+	statsExit(&frame);
+	return retVal;
+}
+
 // *************************************************************************************************
 // **                                Low-level CPU-state operations                               **
 // *************************************************************************************************
 
 // Set the specified register to the specified value. The MegaDrive must be suspended at the
-// monitor.
+// monitor. If the registers were captured when it stopped, this just edits the cached copy and
+// marks the register dirty: the dirty registers are written back all together as part of the next
+// step or continue command, so GDB can edit a whole frame's worth of registers for free.
 //
-int umdkSetRegister(struct FLContext *handle, Register reg, uint32 value, const char **error) {
+int umdkSetRegister(struct UmdkSession *session, Register reg, uint32 value, const char **error) {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_SET_REGISTER);
 	int retVal = 0;
-	int status = umdkDirectWriteLong(handle, CB_REGS+4*reg, value, error);
-	CHECK_STATUS(status, status, cleanup);
+	int status;
+	if ( session->regsValid ) {
+		(&session->regCache.d0)[reg] = value;
+		session->regsDirty |= 1U << reg;
+	} else {
+		status = umdkDirectWriteLong(session, CB_REGS+4*reg, value, error);
+		CHECK_STATUS(status, status, cleanup);
+	}
 cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
-// Read the specified register. The MegaDrive must be suspended at the monitor.
+// Read the specified register. The MegaDrive must be suspended at the monitor. The register is
+// served from the cache if there is one, so this usually costs no USB traffic at all.
 //
-int umdkGetRegister(struct FLContext *handle, Register reg, uint32 *value, const char **error) {
+int umdkGetRegister(struct UmdkSession *session, Register reg, uint32 *value, const char **error) {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_GET_REGISTER);
 	int retVal = 0;
-	int status = umdkDirectReadLong(handle, CB_REGS+4*reg, value, error);
-	CHECK_STATUS(status, status, cleanup);
+	int status;
+	if ( session->regsValid ) {
+		*value = (&session->regCache.d0)[reg];
+	} else {
+		status = umdkDirectReadLong(session, CB_REGS+4*reg, value, error);
+		CHECK_STATUS(status, status, cleanup);
+	}
 cleanup:
+	statsExit(&frame);
+	return retVal;
+}
+
+// Read all the registers. This is served from the cache if the registers were captured when the MD
+// stopped; otherwise it waits for the MD to enter the monitor, which fills the cache.
+//
+int umdkGetRegisters(struct UmdkSession *session, struct Registers *regs, const char **error) {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_GET_REGISTERS);
+	int retVal = 0;
+	int status;
+	if ( session->regsValid ) {
+		*regs = session->regCache;
+	} else {
+		status = umdkAcquire(session, regs, NULL, error);
+		CHECK_STATUS(status, status, cleanup);
+	}
+cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
@@ -559,44 +909,189 @@ cleanup:
 // somewhere in the code, or you'll be waiting forever.
 //
 int umdkRemoteAcquire(
-	struct FLContext *handle, struct Registers *regs, const char **error)
+	struct UmdkSession *session, struct Registers *regs, const char **error)
 {
+	return umdkAcquire(session, regs, NULL, error);
+}
+
+// Poll the command flag waiting for the MD to enter the monitor, giving up if the deadline (if any)
+// expires or is cancelled. Each poll reads CB_FLAG and CB_REGS together, so the registers arrive
+// with the flag that says they are valid. The first poll is issued alone, since the MD is often
+// already stopped; after that, up to the configured depth of polls are kept in flight so the stop is
+// seen as soon as possible. If the MD keeps running, the engine backs off to one poll at a time,
+// with an increasing sleep in between, so a running game doesn't hog the host CPU or the USB bus.
+// A timeout returns ACQ_TIMEOUT with an error message; a cancellation returns ACQ_CANCELLED
+// without one, since the caller asked for it. Cancellation is only checked when no polls are in
+// flight, since checking may itself talk to the board: that's after every poll once the engine
+// backs off, and while it spins, the polls in flight are let drain every ACQ_CANCEL_POLLS polls so
+// that a cancellation is seen promptly. The registers are always captured into the session's
+// register cache, and also copied to regs if it is not NULL.
+//
+int umdkAcquire(
+	struct UmdkSession *session, struct Registers *regs, const struct Deadline *deadline,
+	const char **error)
+{
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_ACQUIRE);
 	int retVal = 0;
-	int status, i;
+	int status;
+	const uint32 startTime = nowMsec();
+	const uint8 *recvData;
+	uint32 requestLength, actualLength;
+	uint32 numPolls = 0, sleepTime = 0, depth, nextCheck = 0;
+	uint32 numReads = 0;
 	uint16 cmdFlag;
-	union RegUnion {
-		struct Registers reg;
-		uint32 longs[18];
-		uint8 bytes[18*4];
-	} *const u = (union RegUnion *)regs;
-	do {
-		status = umdkDirectReadWord(handle, CB_FLAG, &cmdFlag, error);
-		CHECK_STATUS(status, status, cleanup);
-	} while ( cmdFlag != CF_READY );
+	bool draining = false;
+	for ( ;; ) {
+		// Top up the polls in flight, unless they're being let drain for a cancellation check
+		depth =
+			draining ? 0 :
+			(numPolls == 0 || sleepTime) ? 1 :
+			session->acqConfig.depth;
+		while ( numReads < depth ) {
+			status = umdkDirectReadBytesAsync(session, CB_FLAG, CB_MEM - CB_FLAG, error);
+			CHECK_STATUS(status, status, cleanup);
+			numReads++;
+		}
 
-	// Read saved registers, if necessary
-	if ( regs ) {
-		status = umdkDirectReadBytes(handle, CB_REGS, 18*4, u->bytes, error);
-		CHECK_STATUS(status, status, cleanup);
-		for ( i = 0; i < 18; i++ ) {
-			u->longs[i] = bigEndian32(u->longs[i]);
+		// See what the oldest one says
+		status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+		CHECK_STATUS(status, 4, cleanup);
+		numReads--;
+		numPolls++;
+		cmdFlag = (uint16)((recvData[0] << 8) | recvData[1]);
+		if ( cmdFlag == CF_READY ) {
+			break;
+		}
+
+		// Still running; see whether it's time to give up
+		if ( deadline && deadline->isCancelled ) {
+			draining = draining || numPolls >= nextCheck;
+			if ( numReads == 0 ) {
+				CHECK_STATUS(deadline->isCancelled(session), ACQ_CANCELLED, cleanup);
+				draining = false;
+				nextCheck = numPolls + ACQ_CANCEL_POLLS;
+			}
+		}
+		if ( deadline ) {
+			CHECK_STATUS(
+				deadline->timeout && nowMsec() - startTime >= deadline->timeout, ACQ_TIMEOUT, cleanup,
+				"umdkAcquire(): Timed out after %ums waiting for the monitor!", deadline->timeout);
+		}
+
+		// Back off, once the polls already in flight have drained
+		if ( numPolls >= session->acqConfig.spinPolls ) {
+			sleepTime = sleepTime ? 2*sleepTime : 1;
+			if ( sleepTime > session->acqConfig.maxSleep ) {
+				sleepTime = session->acqConfig.maxSleep;
+			}
+			if ( numReads == 0 && sleepTime ) {
+				flSleep(sleepTime);
+			}
 		}
 	}
+
+	// Unpack the saved registers
+	captureRegisters(session, recvData + CB_REGS - CB_FLAG);
+	if ( regs ) {
+		*regs = session->regCache;
+	}
 cleanup:
+	while ( numReads-- ) {
+		flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, NULL);
+	}
+	statsExit(&frame);
 	return retVal;
 }
 
+// See whether the given region lies entirely within a single cartridge bank whose SDRAM page is
+// known, so it can be read and written while the MD is running.
+//
+bool umdkIsDirect(const struct UmdkSession *session, uint32 address, uint32 count) {
+	uint32 physAddr;
+	return getDirectPhysical(session, address, count, &physAddr);
+}
+
+// Record that the given cartridge bank is mapped to the given SDRAM page, so the bank can be
+// accessed directly. The host's own writes to the SSF2 registers are recorded automatically, but
+// the MD's are invisible to it, so a game which pages its own banks must be described with this (or
+// its banks forgotten, with umdkForgetBank()). A bank declared this way is taken to be changed only
+// by the host, so its pages stay cached while the MD runs.
+//
+void umdkSetBankPage(struct UmdkSession *session, uint32 bank, uint32 page) {
+	if ( bank < SSF2_NUM_BANKS ) {
+		session->bankPages[bank] = (uint8)(page & (SSF2_NUM_PAGES - 1));
+		session->banksKnown |= (uint16)(1U << bank);
+		session->banksPinned |= (uint16)(1U << bank);
+		cacheInvalidate(&session->cache, bank * SSF2_BANK_SIZE, SSF2_BANK_SIZE);
+	}
+}
+
+// Forget the given bank's mapping, so it is only accessed through the monitor, which always sees
+// the MD's own view of it.
+//
+void umdkForgetBank(struct UmdkSession *session, uint32 bank) {
+	if ( bank < SSF2_NUM_BANKS ) {
+		session->banksKnown &= (uint16)~(1U << bank);
+		session->banksPinned &= (uint16)~(1U << bank);
+		cacheInvalidate(&session->cache, bank * SSF2_BANK_SIZE, SSF2_BANK_SIZE);
+	}
+}
+
+// Get the SDRAM page the given bank is mapped to, returning false if it is not known.
+//
+bool umdkGetBankPage(const struct UmdkSession *session, uint32 bank, uint32 *page) {
+	if ( bank < SSF2_NUM_BANKS && (session->banksKnown & (1U << bank)) ) {
+		*page = session->bankPages[bank];
+		return true;
+	}
+	return false;
+}
+
+// Keep a host-side copy of an image which has just been written to SDRAM at the given physical
+// address (see umdkPhysicalWriteBytes()), so reads of it can be served without asking the board,
+// until the host writes over it. This assumes the MD doesn't write to its own ROM: a game which does
+// must have its mirror dropped, with umdkDropMirror().
+//
+int umdkAddMirror(
+	struct UmdkSession *session, uint32 physAddr, uint32 length, const uint8 *data,
+	const char **error)
+{
+	int retVal = 0;
+	CHECK_STATUS(
+		mirrorAdd(&session->mirror, physAddr, length, data), 1, cleanup,
+		"umdkAddMirror(): Allocation error!");
+cleanup:
+	return retVal;
+}
+
+// Drop all the mirrored images, so every read goes to the board.
+//
+void umdkDropMirror(struct UmdkSession *session) {
+	mirrorDestroy(&session->mirror);
+}
+
+void umdkGetAcquireConfig(struct UmdkSession *session, struct AcquireConfig *config) {
+	*config = session->acqConfig;
+}
+
+void umdkSetAcquireConfig(struct UmdkSession *session, const struct AcquireConfig *config) {
+	session->acqConfig = *config;
+	if ( session->acqConfig.depth == 0 ) {
+		session->acqConfig.depth = 1;
+	}
+}
+
 /*
 // This is useful for debugging command sends
 //
 static
-int dumpCommandBlock(struct FLContext *handle, const char **error) {
+int dumpCommandBlock(struct UmdkSession *session, const char **error) {
 	int retVal = 0;
 	int status;
 	const int TMPSZ = 84 + 64;
 	uint8 tmpBuf[TMPSZ];
 	memset(tmpBuf, 0xCC, TMPSZ);
-	status = umdkDirectReadBytes(handle, 0x400400, TMPSZ, tmpBuf, error);
+	status = umdkDirectReadBytes(session, 0x400400, TMPSZ, tmpBuf, error);
 	CHECK_STATUS(status, status, cleanup);
 	printf("   cmdFlag: "); dumpSimple(tmpBuf, 2);
 	printf("  cmdIndex: "); dumpSimple(tmpBuf+2, 2);
@@ -624,98 +1119,131 @@ static const char *cmdNames[] = {
 // a jump-table indexed by the issued command.
 //
 int umdkExecuteCommand(
-	struct FLContext *handle, Command command, uint32 address, uint32 length,
+	struct UmdkSession *session, Command command, uint32 address, uint32 length,
 	const uint8 *sendData, uint8 *recvData, struct Registers *regs,
 	const char **error)
 {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_EXECUTE_COMMAND);
 	int retVal = 0;
 	int status;
 	//printf("umdkExecuteCommand(%s):\n", cmdNames[command]);
 
-	// Send the request data, if necessary
-	if ( sendData ) {
-		status = umdkDirectWriteBytes(handle, CB_MEM, length, sendData, error);
-		CHECK_STATUS(status, status, cleanup);
-	}
-
-	// Setup the parameter block
-	status = umdkDirectWriteWord(handle, CB_INDEX, command, error);
-	CHECK_STATUS(status, status, cleanup);
-	status = umdkDirectWriteLong(handle, CB_ADDR, address, error);
-	CHECK_STATUS(status, status, cleanup);
-	status = umdkDirectWriteLong(handle, CB_LEN, length, error);
+	// Send the request data (if any) and the parameter block, and start the command executing
+	status = umdkSubmitCommand(session, command, address, length, sendData, error);
 	CHECK_STATUS(status, status, cleanup);
 
-	// Start the command executing
-	status = umdkDirectWriteWord(handle, CB_FLAG, CF_CMD, error);
-	CHECK_STATUS(status, status, cleanup);
-	
 	// Wait for execution to complete
-	status = umdkRemoteAcquire(handle, regs, error);
+	status = umdkRemoteAcquire(session, regs, error);
 	CHECK_STATUS(status, status, cleanup);
+	if ( (command & ~CMD_BUF2) == CMD_WRITE ) {
+		writeThroughCache(session, address, length, sendData);
+	}
 
 	// Get the response data, if necessary
 	if ( recvData ) {
-		status = umdkDirectReadBytes(handle, CB_MEM, length, recvData, error);
+		status = umdkDirectReadBytes(
+			session, (command & CMD_BUF2) ? CB_MEM2 : CB_MEM, length, recvData, error);
 		CHECK_STATUS(status, status, cleanup);
 	}
 
 cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
-int umdkReset(struct FLContext *handle, const char **error) {
+int umdkReset(struct UmdkSession *session, const char **error) {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_RESET);
 	int retVal = 0;
 	int status;
-	status = umdkDirectWriteWord(handle, CB_INDEX, CMD_RESET, error);
-	CHECK_STATUS(status, status, cleanup);
-	status = umdkDirectWriteWord(handle, CB_FLAG, CF_CMD, error);
+	status = umdkSubmitCommand(session, CMD_RESET, 0, 0, NULL, error);
 	CHECK_STATUS(status, status, cleanup);
 cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
-int umdkContinue(struct FLContext *handle, const char **error) {
-	int retVal = 0, status = umdkDirectWriteWord(handle, CB_INDEX, CMD_CONT, error);
-	CHECK_STATUS(status, status, cleanup);
-	status = umdkDirectWriteWord(handle, CB_FLAG, CF_CMD, error);
+int umdkContinue(struct UmdkSession *session, const char **error) {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_CONTINUE);
+	int retVal = 0, status = umdkSubmitCommand(session, CMD_CONT, 0, 0, NULL, error);
 	CHECK_STATUS(status, status, cleanup);
 cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
 // Have the monitor continue execution with the SR trace bit set. This will cause precisely one
 // instruction of user code to execute and then return control to the monitor. Tracing only works if
 // the code being executed is running in user mode. If you try to step through supervisor-mode code,
-// the MegaDrive will just carry on executing, and never return control to the monitor. Meanwhile
-// this function will be patiently waiting. And that's a long wait for a train don't come.
+// the MegaDrive will just carry on executing, and never return control to the monitor. So rather
+// than wait forever, this gives up after the configured stepTimeout milliseconds and returns
+// ACQ_TIMEOUT, leaving the MD running; it's up to the caller to get it back.
 //
 int umdkStep(
-	struct FLContext *handle, struct Registers *regs, const char **error)
+	struct UmdkSession *session, struct Registers *regs, const char **error)
 {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_STEP);
 	int retVal = 0;
 	int status;
+	const struct Deadline deadline = {session->acqConfig.stepTimeout, NULL};
 
 	// Write monitor address to trace vector
-	status = umdkDirectWriteLong(handle, TR_VEC, MONITOR, error);
+	status = umdkDirectWriteLong(session, TR_VEC, MONITOR, error);
 	CHECK_STATUS(status, status, cleanup);
 
 	// Execute step
-	status = umdkExecuteCommand(handle, CMD_STEP, 0, 0, NULL, NULL, regs, error);
+	status = umdkSubmitCommand(session, CMD_STEP, 0, 0, NULL, error);
+	CHECK_STATUS(status, status, cleanup);
+	status = umdkAcquire(session, regs, &deadline, error);
 	CHECK_STATUS(status, status, cleanup);
 cleanup:
+	statsExit(&frame);
+	return retVal;
+}
+
+// Step repeatedly while the PC stays within [start, end), so GDB can step over a whole source line
+// with one request. The trace vector is written once for the whole range, rather than once per
+// step. Stepping also stops early if isStop (which may be NULL) says so after any step, which lets
+// the caller stop on breakpoints or interrupts. Like umdkStep(), a step that doesn't return to the
+// monitor gives up with ACQ_TIMEOUT.
+//
+int umdkStepRange(
+	struct UmdkSession *session, uint32 start, uint32 end,
+	bool (*isStop)(struct UmdkSession *session, const struct Registers *regs),
+	struct Registers *regs, const char **error)
+{
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_STEP_RANGE);
+	int retVal = 0;
+	int status;
+	const struct Deadline deadline = {session->acqConfig.stepTimeout, NULL};
+
+	// Write monitor address to trace vector
+	status = umdkDirectWriteLong(session, TR_VEC, MONITOR, error);
+	CHECK_STATUS(status, status, cleanup);
+
+	do {
+		// Execute step
+		status = umdkSubmitCommand(session, CMD_STEP, 0, 0, NULL, error);
+		CHECK_STATUS(status, status, cleanup);
+		status = umdkAcquire(session, regs, &deadline, error);
+		CHECK_STATUS(status, status, cleanup);
+	} while (
+		regs->pc >= start && regs->pc < end && !(isStop && isStop(session, regs))
+	);
+cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
 // Dump the contents of WRAM to the specified file.
 //
-int umdkDumpRAM(struct FLContext *handle, const char *fileName, const char **error) {
+int umdkDumpRAM(struct UmdkSession *session, const char *fileName, const char **error) {
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_DUMP_RAM);
 	int retVal = 0, status;
 	uint8 tmpData[65536];
 	FILE *file = NULL;
 
 	// Read RAM
-	status = umdkReadBytes(handle, 0xFF0000, 65536, tmpData, error);
+	status = umdkReadBytes(session, 0xFF0000, 65536, tmpData, error);
 	CHECK_STATUS(status, status, cleanup);
 
 	// Save it
@@ -726,18 +1254,18 @@ cleanup:
 	if ( file ) {
 		fclose(file);
 	}
+	statsExit(&frame);
 	return retVal;
 }
 
-// File to write trace information to
-static FILE *g_traceFile = NULL;
-
-int umdkOpenTrace(const char *fileName) {
-	if ( g_traceFile ) {
-		fclose(g_traceFile);
+// Arrange for a trace of the next execution operation to be written to the specified file.
+//
+int umdkOpenTrace(struct UmdkSession *session, const char *fileName) {
+	if ( session->traceFile ) {
+		fclose(session->traceFile);
 	}
-	g_traceFile = fopen(fileName, "wb");
-	if ( g_traceFile == NULL ) {
+	session->traceFile = fopen(fileName, "wb");
+	if ( session->traceFile == NULL ) {
 		return 1;
 	} else {
 		return 0;
@@ -749,144 +1277,164 @@ int umdkOpenTrace(const char *fileName) {
 // forever.
 //
 int umdkContWait(
-	struct FLContext *handle, struct Registers *regs, const char **error)
+	struct UmdkSession *session, struct Registers *regs, const char **error)
 {
-	int retVal = 0, status, i;
+	struct StatsFrame frame = statsEnter(&session->stats, STATS_CONT_WAIT);
+	int retVal = 0, status;
 	uint8 tmpData[65536];
 	size_t scrapSize;
-	uint32 vbAddr, actualLength, requestLength;
+	uint32 vbAddr, actualLength, requestLength, numPolls = 0;
 	uint16 oldOp;
-	union RegUnion {
-		struct Registers reg;
-		uint32 longs[18];
-		uint8 bytes[18*4];
-	} *const u = (union RegUnion *)regs;
+	bool isCheck, isReady;
 	const uint8 *recvData;
+	const struct Deadline interruptible = {
+		0, session->whileRunning ? session->whileRunning : isInterrupted
+	};
 
 	// Get address of VDP vertical interrupt routine and its first opcode
-	status = umdkDirectReadLong(handle, VB_VEC, &vbAddr, error);
+	status = umdkDirectReadLong(session, VB_VEC, &vbAddr, error);
 	CHECK_STATUS(status, status, cleanup);
-	status = umdkDirectReadWord(handle, vbAddr, &oldOp, error);
+	status = umdkDirectReadWord(session, vbAddr, &oldOp, error);
 	CHECK_STATUS(status, status, cleanup);
 
 	// Write monitor address to illegal instruction vector
-	status = umdkDirectWriteLong(handle, IL_VEC, MONITOR, error);
+	status = umdkDirectWriteLong(session, IL_VEC, MONITOR, error);
 	CHECK_STATUS(status, status, cleanup);
 
-	if ( g_traceFile ) {
+	if ( session->traceFile ) {
 		// Disable tracing (if any) & clear junk from trace FIFO
 		tmpData[0] = 0x00;
-		status = flWriteChannel(handle, 0x01, 1, tmpData, error);
+		status = usbWrite(session, 0x01, 1, tmpData, error);
 		CHECK_STATUS(status, 25, cleanup);
-		status = flReadChannel(handle, 0x03, 1, tmpData, error);
+		status = usbRead(session, 0x03, 1, tmpData, error);
 		CHECK_STATUS(status, 20, cleanup);
 		tmpData[0] &= 0x1F;
 		scrapSize = tmpData[0] << 8;
-		status = flReadChannel(handle, 0x04, 1, tmpData, error);
+		status = usbRead(session, 0x04, 1, tmpData, error);
 		CHECK_STATUS(status, 20, cleanup);
 		scrapSize |= tmpData[0];
 		scrapSize *= 7;
 
 		// Clear junk from FIFO
 		if ( scrapSize ) {
-			status = flReadChannel(handle, 0x02, scrapSize, tmpData, error);
+			status = usbRead(session, 0x02, scrapSize, tmpData, error);
 			CHECK_STATUS(status, 20, cleanup);
 		}
 
 		// There might be up to six straggler bytes
-		status = flReadChannel(handle, 0x03, 1, tmpData, error);
+		status = usbRead(session, 0x03, 1, tmpData, error);
 		CHECK_STATUS(status, 20, cleanup);
 		while ( tmpData[0] & 0x80 ) {
-			status = flReadChannel(handle, 0x02, 1, tmpData, error);
+			status = usbRead(session, 0x02, 1, tmpData, error);
 			CHECK_STATUS(status, 20, cleanup);
-			status = flReadChannel(handle, 0x03, 1, tmpData, error);
+			status = usbRead(session, 0x03, 1, tmpData, error);
 			CHECK_STATUS(status, 20, cleanup);
 		}
 
 		// Enable tracing
 		tmpData[0] = 0x02;
-		status = flWriteChannelAsync(handle, 0x01, 1, tmpData, error);
+		status = usbWriteAsync(session, 0x01, 1, tmpData, error);
 		CHECK_STATUS(status, 25, cleanup);
 	}
 
 	// Set up the continue command and execute it
-	status = umdkDirectWriteWord(handle, CB_INDEX, CMD_CONT, error);
-	CHECK_STATUS(status, status, cleanup);
-	status = umdkDirectWriteWord(handle, CB_FLAG, CF_CMD, error);
+	status = umdkSubmitCommand(session, CMD_CONT, 0, 0, NULL, error);
 	CHECK_STATUS(status, status, cleanup);
 
-	if ( g_traceFile ) {
+	if ( session->traceFile ) {
+		// The trace FIFO has to be drained continuously while the MD runs, so poll flat-out, with
+		// the next pair of reads submitted before the last is awaited. Every ACQ_CANCEL_POLLS polls
+		// the pipeline is let empty, so that GDB can be served (or checked for an interrupt) with
+		// no reads in flight, as umdkAcquire() does
+
 		// Submit 1st read for some trace data
-		status = flReadChannelAsyncSubmit(handle, 2, CHUNK_SIZE, NULL, error);
+		status = usbReadSubmit(session, 2, CHUNK_SIZE, NULL, error);
 		CHECK_STATUS(status, 28, cleanup);
-	}
-
-	// Submit 1st read for the command status flag
-	status = umdkDirectReadBytesAsync(handle, CB_FLAG, 2, error);
-	CHECK_STATUS(status, status, cleanup);
-	do {
-		// If interrupted (escape or ctrl-c in gdb), induce a suspend at the next vblank
-		if ( isInterrupted() ) {
-			status = umdkDirectWriteWord(handle, vbAddr, ILLEGAL, error);
-			CHECK_STATUS(status, status, cleanup);
-		}
-
-		if ( g_traceFile ) {
-			// Submit a read for some trace data
-			status = flReadChannelAsyncSubmit(handle, 2, CHUNK_SIZE, NULL, error);
-			CHECK_STATUS(status, 28, cleanup);
-		}
 
-		// Submit a read for the command status flag
-		status = umdkDirectReadBytesAsync(handle, CB_FLAG, 2, error);
+		// Submit 1st read for the command status flag
+		status = umdkDirectReadBytesAsync(session, CB_FLAG, 2, error);
 		CHECK_STATUS(status, status, cleanup);
+		do {
+			isCheck = (++numPolls % ACQ_CANCEL_POLLS == 0);
+			if ( !isCheck ) {
+				// Submit a read for some trace data
+				status = usbReadSubmit(session, 2, CHUNK_SIZE, NULL, error);
+				CHECK_STATUS(status, 28, cleanup);
+
+				// Submit a read for the command status flag
+				status = umdkDirectReadBytesAsync(session, CB_FLAG, 2, error);
+				CHECK_STATUS(status, status, cleanup);
+			}
 
-		if ( g_traceFile ) {
 			// Await the requested trace data
-			status = flReadChannelAsyncAwait(handle, &recvData, &requestLength, &actualLength, error);
+			status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
 			CHECK_STATUS(status, status, cleanup);
 			CHECK_STATUS(actualLength != requestLength, 31, cleanup);
 
 			// Write it to the trace-log
-			fwrite(recvData, 1, actualLength, g_traceFile);
-		}
+			fwrite(recvData, 1, actualLength, session->traceFile);
 
-		// Await the requested command status flag
-		status = flReadChannelAsyncAwait(handle, &recvData, &requestLength, &actualLength, error);
-		CHECK_STATUS(status, status, cleanup);
-		CHECK_STATUS(actualLength != requestLength, 31, cleanup);
-	} while ( recvData[0] != 0x00 || recvData[1] != CF_READY );
+			// Await the requested command status flag
+			status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+			CHECK_STATUS(status, status, cleanup);
+			CHECK_STATUS(actualLength != requestLength, 31, cleanup);
+			isReady = (recvData[0] == 0x00 && recvData[1] == CF_READY);
+			if ( isCheck ) {
+				// If interrupted (escape or ctrl-c in gdb, or a stop request in non-stop mode),
+				// induce a suspend at the next vblank
+				if ( !isReady && interruptible.isCancelled(session) ) {
+					status = umdkDirectWriteWord(session, vbAddr, ILLEGAL, error);
+					CHECK_STATUS(status, status, cleanup);
+				}
+
+				// Refill the pipeline, so the reads after the loop are in flight either way
+				status = usbReadSubmit(session, 2, CHUNK_SIZE, NULL, error);
+				CHECK_STATUS(status, 28, cleanup);
+				status = umdkDirectReadBytesAsync(session, CB_FLAG, 2, error);
+				CHECK_STATUS(status, status, cleanup);
+			}
+		} while ( !isReady );
 
-	if ( g_traceFile ) {
 		// Await the final block of trace-data
-		status = flReadChannelAsyncAwait(handle, &recvData, &requestLength, &actualLength, error);
+		status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
 		CHECK_STATUS(status, status, cleanup);
 		CHECK_STATUS(actualLength != requestLength, 31, cleanup);
-		
+	
 		// Write it to the trace-log
-		fwrite(recvData, 1, actualLength, g_traceFile);
-		fclose(g_traceFile);
-		g_traceFile = NULL;
-	}
+		fwrite(recvData, 1, actualLength, session->traceFile);
+		fclose(session->traceFile);
+		session->traceFile = NULL;
 	
-	// Await the final command-flag
-	status = flReadChannelAsyncAwait(handle, &recvData, &requestLength, &actualLength, error);
-	CHECK_STATUS(status, status, cleanup);
-	CHECK_STATUS(actualLength != requestLength, 31, cleanup);
-
-	// Restore old opcode to vbAddr
-	status = umdkDirectWriteWord(handle, vbAddr, oldOp, error);
-	CHECK_STATUS(status, status, cleanup);
+		// Await the final command-flag
+		status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+		CHECK_STATUS(status, status, cleanup);
+		CHECK_STATUS(actualLength != requestLength, 31, cleanup);
 
-	// Read saved registers, if necessary
-	if ( regs ) {
-		status = umdkDirectReadBytes(handle, CB_REGS, 18*4, u->bytes, error);
+		// Read saved registers
+		status = umdkDirectReadBytes(session, CB_REGS, 18*4, tmpData, error);
 		CHECK_STATUS(status, status, cleanup);
-		for ( i = 0; i < 18; i++ ) {
-			u->longs[i] = bigEndian32(u->longs[i]);
+		captureRegisters(session, tmpData);
+		if ( regs ) {
+			*regs = session->regCache;
+		}
+	} else {
+		// Otherwise the acquisition engine can back off while the MD runs, serving GDB in between
+		// polls if the session wants that. If interrupted (escape or ctrl-c in gdb, or a stop
+		// request in non-stop mode), induce a suspend at the next vblank and carry on waiting
+		status = umdkAcquire(session, regs, &interruptible, error);
+		if ( status == ACQ_CANCELLED ) {
+			status = umdkDirectWriteWord(session, vbAddr, ILLEGAL, error);
+			CHECK_STATUS(status, status, cleanup);
+			status = umdkAcquire(session, regs, NULL, error);
 		}
+		CHECK_STATUS(status, status, cleanup);
 	}
+
+	// Restore old opcode to vbAddr
+	status = umdkDirectWriteWord(session, vbAddr, oldOp, error);
+	CHECK_STATUS(status, status, cleanup);
 cleanup:
+	statsExit(&frame);
 	return retVal;
 }
 
@@ -894,6 +1442,21 @@ cleanup:
 // **                               Operations private to this file                               **
 // *************************************************************************************************
 
+// Fill the register cache from a copy of the CB_REGS block, read when the MD stopped. Registers
+// edited since the last stop keep their edited values, since they have not been written back yet.
+//
+static
+void captureRegisters(struct UmdkSession *session, const uint8 *block) {
+	uint32 *const cache = &session->regCache.d0;
+	int i;
+	for ( i = 0; i < 18; i++, block += 4 ) {
+		if ( !(session->regsDirty & (1U << i)) ) {
+			cache[i] = (uint32)((block[0] << 24) | (block[1] << 16) | (block[2] << 8) | block[3]);
+		}
+	}
+	session->regsValid = true;
+}
+
 // Prepare a low-level SDRAM-controller command. Three commands are accepted:
 //   0x00 <u24> - set the SDRAM-controller read/write address register to u24
 //   0x40 <u24> - read u24 16-bit words from the r/w addr reg, incrementing
@@ -909,36 +1472,696 @@ void prepMemCtrlCmd(uint8 cmd, uint32 addr, uint8 *buf) {
 	buf[1] = (uint8)addr;
 }
 
+// If the specified region lies entirely within a single 512KiB cartridge bank whose SDRAM page is
+// known (see umdkSetBankPage()), get its SDRAM physical address and return true. Otherwise return
+// false.
+//
+static
+bool getDirectPhysical(
+	const struct UmdkSession *session, uint32 address, uint32 count, uint32 *physAddr)
+{
+	const uint32 bank = address / SSF2_BANK_SIZE;
+	if (
+		bank < SSF2_NUM_BANKS && (session->banksKnown & (1U << bank)) &&
+		isInside(bank * SSF2_BANK_SIZE, SSF2_BANK_SIZE, address, count) )
+	{
+		*physAddr = session->bankPages[bank] * SSF2_BANK_SIZE + (address & (SSF2_BANK_SIZE - 1));
+		return true;
+	}
+	return false;
+}
+
+// Split a request into the fewest parts such that each part either lies entirely within a cartridge
+// bank which can be accessed directly, or can be copied by the monitor in one go: the parts which
+// need the monitor are merged wherever they meet, whichever areas of the memory map they are in.
+// The parts' data pointers are set to the corresponding places in data. Every boundary between
+// parts is a bank or region boundary, so if the request is word-aligned, so is each part. Return
+// the number of parts, which is at least one (for a nonzero count) and at most MAX_PARTS.
+//
+static
+uint32 splitRequest(
+	const struct UmdkSession *session, uint32 address, uint32 count, uint8 *data,
+	struct MemVec *parts)
+{
+	const struct MemRegion *region;
+	uint32 numParts = 0, end, length, physAddr;
+	bool direct, lastDirect = true;
+	while ( count ) {
+		// Find the area containing address, or the gap it's in, and where that ends
+		region = findRegion(address, &end);
+		if ( region && region->policy == MEM_BANKED ) {
+			end = (address / SSF2_BANK_SIZE + 1) * SSF2_BANK_SIZE;
+		}
+		length = (end - address < count) ? end - address : count;
+		direct =
+			region && region->policy == MEM_BANKED &&
+			getDirectPhysical(session, address, length, &physAddr);
+
+		// Start a new part, unless this and the last both need the monitor
+		if ( direct || lastDirect ) {
+			parts[numParts].address = address;
+			parts[numParts].length = 0;
+			parts[numParts].data = data;
+			numParts++;
+		}
+		parts[numParts - 1].length += length;
+		lastDirect = direct;
+		address += length;
+		data += length;
+		count -= length;
+	}
+	return numParts;
+}
+
+// Try to serve a read from the mirror. Every part of it must be in a cartridge bank whose SDRAM page
+// is known, and in unchanged pages of a mirrored image. Returns false if any part isn't,
+// in which case the whole read must go to the board.
+//
+static
+bool readMirror(struct UmdkSession *session, uint32 address, uint32 count, uint8 *data) {
+	const struct MemRegion *region;
+	uint32 end, length, physAddr;
+	if ( !session->mirror.numImages ) {
+		return false;
+	}
+	while ( count ) {
+		region = findRegion(address, &end);
+		if ( !region || region->policy != MEM_BANKED || region->cache == CACHE_NEVER ) {
+			return false;
+		}
+		end = (address / SSF2_BANK_SIZE + 1) * SSF2_BANK_SIZE;
+		length = (end - address < count) ? end - address : count;
+		if (
+			!getDirectPhysical(session, address, length, &physAddr) ||
+			!mirrorRead(&session->mirror, physAddr, length, data) )
+		{
+			return false;
+		}
+		address += length;
+		data += length;
+		count -= length;
+	}
+	return true;
+}
+
+// Mark stale whatever mirrored pages a write to the given MD address range may land on. Where a
+// bank's SDRAM page isn't known, the write could be to any page, so each page's copy of the range is
+// marked stale.
+//
+static
+void invalidateMirror(struct UmdkSession *session, uint32 address, uint32 count) {
+	const struct MemRegion *region;
+	uint32 end, length, page;
+	while ( count && session->mirror.numImages ) {
+		region = findRegion(address, &end);
+		if ( region && region->policy == MEM_BANKED ) {
+			end = (address / SSF2_BANK_SIZE + 1) * SSF2_BANK_SIZE;
+		}
+		length = (end - address < count) ? end - address : count;
+		if ( region && region->policy == MEM_BANKED ) {
+			if ( umdkGetBankPage(session, address / SSF2_BANK_SIZE, &page) ) {
+				mirrorInvalidate(
+					&session->mirror,
+					page * SSF2_BANK_SIZE + (address & (SSF2_BANK_SIZE - 1)), length);
+			} else {
+				for ( page = 0; page < SSF2_NUM_PAGES; page++ ) {
+					mirrorInvalidate(
+						&session->mirror,
+						page * SSF2_BANK_SIZE + (address & (SSF2_BANK_SIZE - 1)), length);
+				}
+			}
+		}
+		address += length;
+		count -= length;
+	}
+}
+
+// Find the area of the memory map containing the given address, and where it ends. If the address
+// is in a gap, return NULL, with the end of the gap.
+//
+static
+const struct MemRegion *findRegion(uint32 address, uint32 *end) {
+	uint32 i;
+	for ( i = 0; i < NUM_REGIONS && memRegions[i].start + memRegions[i].length <= address; i++ );
+	if ( i == NUM_REGIONS ) {
+		*end = 0xFFFFFFFF;
+		return NULL;
+	} else if ( memRegions[i].start > address ) {
+		*end = memRegions[i].start;
+		return NULL;
+	}
+	*end = memRegions[i].start + memRegions[i].length;
+	return memRegions + i;
+}
+
+// How long a copy of the given cache page stays good. The MD can write cartridge SDRAM (to save
+// games, say) and remap banks without the host seeing, so a cartridge bank is only pinned once the
+// host has declared its page (see umdkSetBankPage()).
+//
+static
+int getCachePolicy(const struct UmdkSession *session, uint32 page) {
+	uint32 end;
+	const uint32 address = page * CACHE_PAGE_SIZE;
+	const struct MemRegion *const region = findRegion(address, &end);
+	if ( !region ) {
+		return CACHE_NEVER;
+	} else if (
+		region->policy == MEM_BANKED && region->cache == CACHE_STOPPED &&
+		(session->banksPinned & (1U << (address / SSF2_BANK_SIZE))) )
+	{
+		return CACHE_PINNED;
+	}
+	return region->cache;
+}
+
+// See whether a read can go through the cache: it must be small, and every page it touches must be
+// cacheable, now.
+//
+static
+bool canCache(const struct UmdkSession *session, uint32 address, uint32 count) {
+	const uint32 first = address / CACHE_PAGE_SIZE;
+	const uint32 last = (address + count - 1) / CACHE_PAGE_SIZE;
+	uint32 page;
+	if ( count == 0 || address + count > 0x1000000 || last - first >= CACHE_MAX_PAGES ) {
+		return false;
+	}
+	for ( page = first; page <= last; page++ ) {
+		if ( !isCacheableNow(session, page) ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// See whether the given page can be cached now. Only pinned pages can be cached while the MD runs.
+//
+static
+bool isCacheableNow(const struct UmdkSession *session, uint32 page) {
+	const int policy = getCachePolicy(session, page);
+	return
+		page < 0x1000000 / CACHE_PAGE_SIZE &&
+		(policy == CACHE_PINNED || (policy == CACHE_STOPPED && session->regsValid));
+}
+
+// WRAM is only cached at WRAM_BASE, so move a range in one of its aliases to the same range there.
+// Anything else, including a range straddling two aliases, is left where it is.
+//
+static
+uint32 unaliasWram(uint32 address, uint32 count) {
+	if ( address >= WRAM_ALIASES && count && (address >> 16) == ((address + count - 1) >> 16) ) {
+		return WRAM_BASE | (address & 0xFFFF);
+	}
+	return address;
+}
+
+// Write the given range of memory through to the page cache, or with no data just invalidate it.
+// The range is split where it enters WRAM and at each 64KiB alias in there, so every part of it
+// reaches the pages cached at WRAM_BASE.
+//
+static
+void writeThroughCache(
+	struct UmdkSession *session, uint32 address, uint32 count, const uint8 *data)
+{
+	uint32 length;
+	while ( count ) {
+		length = count;
+		if ( address < WRAM_ALIASES && length > WRAM_ALIASES - address ) {
+			length = WRAM_ALIASES - address;
+		} else if ( address >= WRAM_ALIASES && length > 0x10000 - (address & 0xFFFF) ) {
+			length = 0x10000 - (address & 0xFFFF);
+		}
+		if ( data ) {
+			cacheWrite(&session->cache, unaliasWram(address, length), length, data);
+			data += length;
+		} else {
+			cacheInvalidate(&session->cache, unaliasWram(address, length), length);
+		}
+		address += length;
+		count -= length;
+	}
+}
+
+// Read through the cache. The whole pages the read touches are taken from the cache where they're
+// there, and the rest are fetched from the MD, all in one scatter read, and kept. If the read is
+// part of a stream, and the MD has to be asked for something anyway, the next CACHE_READ_AHEAD
+// pages in the stream's direction are fetched in the same batch: the reads are all submitted before
+// any is awaited, so this costs no more round trips, and the stream's next reads find their pages
+// waiting in the cache.
+//
+static
+int umdkCachedRead(
+	struct UmdkSession *session, uint32 address, uint32 count, uint8 *data, const char **error)
+{
+	int retVal = 0, status;
+	uint8 window[(CACHE_MAX_PAGES + CACHE_READ_AHEAD) * CACHE_PAGE_SIZE];
+	struct MemVec fills[CACHE_MAX_PAGES + CACHE_READ_AHEAD];
+	const int32 direction = cacheTrackStream(&session->cache, address, count);
+	const uint32 first = address / CACHE_PAGE_SIZE;
+	const uint32 last = (address + count - 1) / CACHE_PAGE_SIZE;
+	uint32 winFirst = first, winLast = last, page, i, j, numFills = 0, pageAddr;
+	const uint8 *cached;
+
+	// See whether the MD has to be asked at all, and if so, how far the stream (if any) can be read
+	// ahead: no further than the pages which could be cached now
+	for ( page = first; page <= last && cacheHas(&session->cache, page, session->regsValid); page++ );
+	if ( page <= last && direction > 0 ) {
+		while ( winLast - last < CACHE_READ_AHEAD && isCacheableNow(session, winLast + 1) ) {
+			winLast++;
+		}
+	} else if ( page <= last && direction < 0 ) {
+		while (
+			first - winFirst < CACHE_READ_AHEAD && winFirst && isCacheableNow(session, winFirst - 1) )
+		{
+			winFirst--;
+		}
+	}
+
+	// Take what's already cached, and gather the rest into runs of missing pages. A run never
+	// crosses into another bank, so the direct parts of the fill stay direct.
+	for ( page = winFirst; page <= winLast; page++ ) {
+		pageAddr = page * CACHE_PAGE_SIZE;
+		cached = NULL;
+		if ( page >= first && page <= last ) {
+			cached = cacheLookup(&session->cache, page, session->regsValid);
+		} else if ( cacheHas(&session->cache, page, session->regsValid) ) {
+			continue;  // read-ahead which is already there
+		}
+		if ( cached ) {
+			memcpy(window + (page - winFirst) * CACHE_PAGE_SIZE, cached, CACHE_PAGE_SIZE);
+		} else if (
+			numFills && fills[numFills - 1].address + fills[numFills - 1].length == pageAddr &&
+			pageAddr % SSF2_BANK_SIZE )
+		{
+			fills[numFills - 1].length += CACHE_PAGE_SIZE;
+		} else {
+			fills[numFills].address = pageAddr;
+			fills[numFills].length = CACHE_PAGE_SIZE;
+			fills[numFills].data = window + (page - winFirst) * CACHE_PAGE_SIZE;
+			numFills++;
+		}
+	}
+
+	// Fetch the missing pages, and keep them
+	if ( numFills ) {
+		status = umdkReadV(session, fills, numFills, error);
+		CHECK_STATUS(status, status, cleanup);
+		for ( i = 0; i < numFills; i++ ) {
+			for ( j = 0; j < fills[i].length; j += CACHE_PAGE_SIZE ) {
+				page = (fills[i].address + j) / CACHE_PAGE_SIZE;
+				cacheInsert(
+					&session->cache, page, getCachePolicy(session, page) == CACHE_PINNED,
+					window + (page - winFirst) * CACHE_PAGE_SIZE);
+			}
+		}
+	}
+	memcpy(data, window + (first - winFirst) * CACHE_PAGE_SIZE + address % CACHE_PAGE_SIZE, count);
+cleanup:
+	return retVal;
+}
+
+// The SSF2 registers cannot be read back, so note the page numbers the host writes to them through
+// the monitor: the banks it maps stay directly accessible at their new pages.
+//
+static
+void trackBankWrites(
+	struct UmdkSession *session, uint32 address, uint32 count, const uint8 *data)
+{
+	uint32 reg, bank;
+	for ( reg = SSF2_REG_FIRST; reg <= SSF2_REG_LAST; reg += 2 ) {
+		if ( isInside(address, count, reg, 1) ) {
+			bank = ((data[reg - address] >> 3) & 0x08) | ((reg >> 1) & 0x07);
+			umdkSetBankPage(session, bank, data[reg - address] & 0x1F);
+		}
+	}
+}
+// Get a monotonic timestamp in milliseconds, for timing out waits
+//
+static
+uint32 nowMsec(void) {
+	#ifdef WIN32
+		return (uint32)GetTickCount();
+	#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint32)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+	#endif
+}
+
+// Wrappers for the FPGALink channel operations, which account for each transfer in the statistics
+//
+static
+FLStatus usbWriteAsync(
+	struct UmdkSession *session, uint8 chan, size_t count, const uint8 *data, const char **error)
+{
+	statsTransfer(&session->stats, (uint32)count, 0);
+	return flWriteChannelAsync(session->handle, chan, count, data, error);
+}
+
+static
+FLStatus usbWrite(
+	struct UmdkSession *session, uint8 chan, size_t count, const uint8 *data, const char **error)
+{
+	statsTransfer(&session->stats, (uint32)count, 0);
+	return flWriteChannel(session->handle, chan, count, data, error);
+}
+
+static
+FLStatus usbReadSubmit(
+	struct UmdkSession *session, uint8 chan, uint32 count, uint8 *buf, const char **error)
+{
+	statsTransfer(&session->stats, 0, count);
+	return flReadChannelAsyncSubmit(session->handle, chan, count, buf, error);
+}
+
+static
+FLStatus usbRead(
+	struct UmdkSession *session, uint8 chan, size_t count, uint8 *buf, const char **error)
+{
+	statsTransfer(&session->stats, 0, (uint32)count);
+	return flReadChannel(session->handle, chan, count, buf, error);
+}
+
+// Append a complete SDRAM-controller write (set-address, write-words and the data itself) to a
+// command stream, and return a pointer to the next free byte. The address is an SDRAM physical
+// address, and the address and count must both be even.
+//
+static
+uint8 *prepMemCtrlWrite(uint8 *buf, uint32 address, uint32 count, const uint8 *data) {
+	prepMemCtrlCmd(0x00, address/2, buf);
+	prepMemCtrlCmd(0x80, count/2, buf+4);
+	memcpy(buf+8, data, count);
+	return buf + 8 + count;
+}
+
+// Send a command to the monitor, without waiting for it to complete. The request data (if any), the
+// parameter block at CB_INDEX-CB_LEN and finally the CF_CMD write to CB_FLAG are all built into one
+// SDRAM-controller command stream and sent with a single async write, so the whole submission
+// costs one USB transfer. The monitor only looks at the parameter block once it sees CB_FLAG
+// change, and the SDRAM controller executes the stream in order, so the flag must go last.
+//
+// Step and continue commands release the MD, so the register cache is no longer valid after them.
+// If any cached registers were edited, the whole CB_REGS block follows on from the parameter block
+// in the same write, so the MD resumes with the edited registers at no extra cost.
+//
+static
+int umdkSubmitCommand(
+	struct UmdkSession *session, Command command, uint32 address, uint32 length,
+	const uint8 *sendData, const char **error)
+{
+	int retVal = 0;
+	FLStatus status;
+	uint8 stackBuf[256];
+	uint8 params[10 + 18*4];
+	uint32 paramSize = 10;
+	const uint32 dataSize = sendData ? 8 + length : 0;
+	const uint32 bufSize = dataSize + (8 + sizeof(params)) + (8 + 2);
+	uint8 *const buf = (bufSize > sizeof(stackBuf)) ? (uint8*)malloc(bufSize) : stackBuf;
+	uint8 *ptr = buf;
+	const bool resume = (command == CMD_STEP || command == CMD_CONT || command == CMD_RESET);
+	const uint32 *const cache = &session->regCache.d0;
+	int i;
+	CHECK_STATUS(!buf, 1, cleanup, "umdkSubmitCommand(): Allocation error!");
+
+	// The request data goes straight into whichever of the monitor's two buffers the command uses
+	if ( sendData ) {
+		CHECK_STATUS(length&1, 3, cleanup, "umdkSubmitCommand(): Count must be even!");
+		ptr = prepMemCtrlWrite(
+			ptr, MONITOR_PHYS((command & CMD_BUF2) ? CB_MEM2 : CB_MEM), length, sendData);
+	}
+
+	// The parameter block CB_INDEX, CB_ADDR and CB_LEN is contiguous, so write it in one go
+	params[0] = (uint8)(command >> 8);
+	params[1] = (uint8)command;
+	params[2] = (uint8)(address >> 24);
+	params[3] = (uint8)(address >> 16);
+	params[4] = (uint8)(address >> 8);
+	params[5] = (uint8)address;
+	params[6] = (uint8)(length >> 24);
+	params[7] = (uint8)(length >> 16);
+	params[8] = (uint8)(length >> 8);
+	params[9] = (uint8)length;
+	if ( session->regsDirty && command != CMD_RESET ) {
+		// CB_REGS follows on directly from CB_LEN
+		for ( i = 0; i < 18; i++ ) {
+			params[paramSize++] = (uint8)(cache[i] >> 24);
+			params[paramSize++] = (uint8)(cache[i] >> 16);
+			params[paramSize++] = (uint8)(cache[i] >> 8);
+			params[paramSize++] = (uint8)cache[i];
+		}
+	}
+	ptr = prepMemCtrlWrite(ptr, MONITOR_PHYS(CB_INDEX), paramSize, params);
+
+	// Finally, set the command flag to start the monitor executing the command
+	params[0] = 0x00;
+	params[1] = CF_CMD;
+	ptr = prepMemCtrlWrite(ptr, MONITOR_PHYS(CB_FLAG), 2, params);
+
+	status = usbWriteAsync(session, 0x00, (size_t)(ptr - buf), buf, error);
+	CHECK_STATUS(status, 4, cleanup);
+	if ( resume ) {
+		session->regsValid = false;
+		session->regsDirty = 0;
+		cacheResume(&session->cache);
+	}
+cleanup:
+	if ( buf != stackBuf ) {
+		free(buf);
+	}
+	return retVal;
+}
+
 // Indirect-write a sequence of bytes to the specified address. The area of memory to be written may
 // be anywhere in the MegaDrive's 16MiB address-space. It must have an even start-address and
 // length. The MegaDrive must be suspended at the monitor.
 //
+// The data is sent in CB_MEM_SIZE chunks, alternating between the monitor's two buffers: chunk N+1
+// is sent to one buffer while the monitor is still copying chunk N out of the other one, so only
+// the command submission itself has to wait for the monitor.
+//
 static
 int umdkIndirectWriteBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, const uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, const uint8 *const data,
 	const char **error)
 {
 	int retVal = 0;
 	int status;
+	uint32 offset = 0, chunkSize, nextOffset, nextSize;
+	uint32 command = CMD_WRITE;
 
 	// Verify that the write is to an even address, and has even length
 	CHECK_STATUS(address&1, 2, cleanup, "umdkIndirectWriteBytes(): Address must be even!");
 	CHECK_STATUS(count&1, 3, cleanup, "umdkIndirectWriteBytes(): Count must be even!");
 
-	// Execute the write
-	status = umdkExecuteCommand(handle, CMD_WRITE, address, count, data, NULL, NULL, error);
+	// Send the first chunk and start the monitor copying it
+	chunkSize = (count > CB_MEM_SIZE) ? CB_MEM_SIZE : count;
+	status = umdkSubmitCommand(session, (Command)command, address, chunkSize, data, error);
 	CHECK_STATUS(status, status, cleanup);
+	for ( ;; ) {
+		// Send the next chunk (if any) to the other buffer, while the monitor is busy
+		nextOffset = offset + chunkSize;
+		nextSize = count - nextOffset;
+		if ( nextSize > CB_MEM_SIZE ) {
+			nextSize = CB_MEM_SIZE;
+		}
+		command ^= CMD_BUF2;
+		if ( nextSize ) {
+			status = umdkDirectWriteBytes(
+				session, (command & CMD_BUF2) ? CB_MEM2 : CB_MEM, nextSize, data + nextOffset, error);
+			CHECK_STATUS(status, status, cleanup);
+		}
+
+		// Wait for the monitor to finish with the current chunk
+		status = umdkRemoteAcquire(session, NULL, error);
+		CHECK_STATUS(status, status, cleanup);
+		if ( !nextSize ) {
+			break;
+		}
+
+		// Start the monitor copying the next chunk
+		status = umdkSubmitCommand(
+			session, (Command)command, address + nextOffset, nextSize, NULL, error);
+		CHECK_STATUS(status, status, cleanup);
+		offset = nextOffset;
+		chunkSize = nextSize;
+	}
+	writeThroughCache(session, address, count, data);
+	trackBankWrites(session, address, count, data);
 cleanup:
 	return retVal;
 }
 
+// Indirect-read an even number of bytes from the specified even address, via the monitor. This is
+// done in CB_MEM_SIZE chunks, alternating between the monitor's two buffers: as soon as chunk N is
+// ready in one buffer, the monitor is told to start copying chunk N+1 into the other buffer, and
+// chunk N is read back (along with a speculative poll of CB_FLAG) while it does so. As long as the
+// monitor finishes chunk N+1 before chunk N has arrived, each chunk costs one round-trip.
+//
+static
+int umdkIndirectReadWords(
+	struct UmdkSession *session, uint32 address, uint32 count, uint8 *data, const char **error)
+{
+	int retVal = 0;
+	int status;
+	uint32 offset = 0, chunkSize, nextOffset, nextSize;
+	uint32 command = CMD_READ;
+	uint16 cmdFlag = CF_RUNNING;
+	const uint8 *recvData;
+	uint32 requestLength, actualLength;
+	int numReads = 0;
+
+	// Start the monitor copying the first chunk, and wait for it
+	chunkSize = (count > CB_MEM_SIZE) ? CB_MEM_SIZE : count;
+	status = umdkSubmitCommand(session, (Command)command, address, chunkSize, NULL, error);
+	CHECK_STATUS(status, status, cleanup);
+	status = umdkRemoteAcquire(session, NULL, error);
+	CHECK_STATUS(status, status, cleanup);
+	for ( ;; ) {
+		// Start the monitor copying the next chunk (if any) into the other buffer
+		nextOffset = offset + chunkSize;
+		nextSize = count - nextOffset;
+		if ( nextSize > CB_MEM_SIZE ) {
+			nextSize = CB_MEM_SIZE;
+		}
+		if ( nextSize ) {
+			status = umdkSubmitCommand(
+				session, (Command)(command ^ CMD_BUF2), address + nextOffset, nextSize, NULL, error);
+			CHECK_STATUS(status, status, cleanup);
+		}
+
+		// Read back the current chunk, and poll the command flag behind it
+		status = umdkDirectReadBytesAsync(
+			session, (command & CMD_BUF2) ? CB_MEM2 : CB_MEM, chunkSize, error);
+		CHECK_STATUS(status, status, cleanup);
+		numReads++;
+		if ( nextSize ) {
+			status = umdkDirectReadBytesAsync(session, CB_FLAG, 2, error);
+			CHECK_STATUS(status, status, cleanup);
+			numReads++;
+		}
+		status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+		CHECK_STATUS(status, 4, cleanup);
+		numReads--;
+		memcpy(data + offset, recvData, chunkSize);
+		if ( !nextSize ) {
+			break;
+		}
+		status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+		CHECK_STATUS(status, 4, cleanup);
+		numReads--;
+		cmdFlag = (uint16)((recvData[0] << 8) | recvData[1]);
+
+		// If the monitor wasn't quick enough, wait for it to finish the next chunk
+		if ( cmdFlag != CF_READY ) {
+			status = umdkRemoteAcquire(session, NULL, error);
+			CHECK_STATUS(status, status, cleanup);
+		}
+		command ^= CMD_BUF2;
+		offset = nextOffset;
+		chunkSize = nextSize;
+	}
+cleanup:
+	while ( numReads-- ) {
+		flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, NULL);
+	}
+	return retVal;
+}
+
+// Read the first and/or last words of an even-aligned span of memory into the corresponding places
+// in buf, in one pipelined batch. For an indirect span, the monitor is told to copy what's needed
+// into its buffer and CB_FLAG is polled in the same batch that reads it back, so as long as the
+// monitor is quick, each copy costs one round-trip. A short span is copied whole; otherwise the
+// monitor copies just the end word(s), the head into the first buffer and the tail into the second,
+// one after the other.
+//
+static
+int umdkReadSpanEnds(
+	struct UmdkSession *session, bool direct, uint32 address, uint32 count, bool head, bool tail,
+	uint8 *buf, const char **error)
+{
+	int retVal = 0;
+	int status;
+	const uint32 last = count - 2;
+	uint32 srcAddr = address;
+	uint16 cmdFlag = CF_READY;
+	const uint8 *recvData;
+	uint32 requestLength, actualLength;
+	int numReads = 0;
+	if ( count == 2 ) {
+		// One word is both the head and the tail
+		head = head || tail;
+		tail = false;
+	}
+	if ( !direct ) {
+		if ( head && tail && count > SPAN_COPY_MAX ) {
+			status = umdkReadSpanEnds(session, false, address, count, true, false, buf, error);
+			CHECK_STATUS(status, status, cleanup);
+			status = umdkReadSpanEnds(session, false, address, count, false, true, buf, error);
+			CHECK_STATUS(status, status, cleanup);
+			goto cleanup;
+		} else if ( head ) {
+			status = umdkSubmitCommand(session, CMD_READ, address, tail ? count : 2, NULL, error);
+			CHECK_STATUS(status, status, cleanup);
+			srcAddr = CB_MEM;
+		} else {
+			// srcAddr is where the span would start, so the tail word lands at the start of the buffer
+			status = umdkSubmitCommand(
+				session, (Command)(CMD_READ | CMD_BUF2), address + last, 2, NULL, error);
+			CHECK_STATUS(status, status, cleanup);
+			srcAddr = CB_MEM2 - last;
+		}
+	}
+	do {
+		// Submit the reads, with a poll of CB_FLAG in front if the monitor is doing the copy
+		if ( !direct ) {
+			status = umdkDirectReadBytesAsync(session, CB_FLAG, 2, error);
+			CHECK_STATUS(status, status, cleanup);
+			numReads++;
+		}
+		if ( head ) {
+			status = umdkDirectReadBytesAsync(session, srcAddr, 2, error);
+			CHECK_STATUS(status, status, cleanup);
+			numReads++;
+		}
+		if ( tail ) {
+			status = umdkDirectReadBytesAsync(session, srcAddr + last, 2, error);
+			CHECK_STATUS(status, status, cleanup);
+			numReads++;
+		}
+
+		// Collect the results; if the monitor hadn't finished, just go round again
+		if ( !direct ) {
+			status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+			CHECK_STATUS(status, 4, cleanup);
+			numReads--;
+			cmdFlag = (uint16)((recvData[0] << 8) | recvData[1]);
+		}
+		if ( head ) {
+			status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+			CHECK_STATUS(status, 4, cleanup);
+			numReads--;
+			memcpy(buf, recvData, 2);
+		}
+		if ( tail ) {
+			status = flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, error);
+			CHECK_STATUS(status, 4, cleanup);
+			numReads--;
+			memcpy(buf + last, recvData, 2);
+		}
+	} while ( cmdFlag != CF_READY );
+cleanup:
+	while ( numReads-- ) {
+		flReadChannelAsyncAwait(session->handle, &recvData, &requestLength, &actualLength, NULL);
+	}
+	return retVal;
+}
+
 // Indirect-read a sequence of bytes from the specified address. The area of memory to be read may
 // be anywhere in the MegaDrive's 16MiB address-space. It must have an even start-address and
 // length. The MegaDrive must be suspended at the monitor.
 //
 static
 int umdkIndirectReadBytes(
-	struct FLContext *handle, uint32 address, const uint32 count, uint8 *const data,
+	struct UmdkSession *session, uint32 address, const uint32 count, uint8 *const data,
 	const char **error)
 {
 	int retVal = 0;
@@ -954,7 +2177,7 @@ int umdkIndirectReadBytes(
 		CHECK_STATUS(!tmpBuf, 2, cleanup, "umdkIndirectReadBytes(): Allocation error!");
 
 		// Execute the read
-		status = umdkExecuteCommand(handle, CMD_READ, address-1, 2*wordCount, NULL, tmpBuf, NULL, error);
+		status = umdkIndirectReadWords(session, address-1, 2*wordCount, tmpBuf, error);
 		CHECK_STATUS(status, status, cleanup);
 		memcpy(data, tmpBuf+1, count);
 	} else {
@@ -966,12 +2189,12 @@ int umdkIndirectReadBytes(
 			CHECK_STATUS(!tmpBuf, 5, cleanup, "umdkIndirectReadBytes(): Allocation error!");
 
 			// Execute the read
-			status = umdkExecuteCommand(handle, CMD_READ, address, 2*wordCount, NULL, tmpBuf, NULL, error);
+			status = umdkIndirectReadWords(session, address, 2*wordCount, tmpBuf, error);
 			CHECK_STATUS(status, status, cleanup);
 			memcpy(data, tmpBuf, count);
 		} else {
 			// Even address, even count
-			status = umdkExecuteCommand(handle, CMD_READ, address, count, NULL, data, NULL, error);
+			status = umdkIndirectReadWords(session, address, count, data, error);
 			CHECK_STATUS(status, status, cleanup);
 		}
 	}
@@ -985,43 +2208,43 @@ cleanup:
   CODE TO INTERRUPT EXECUTION (USER PRESSES ESCAPE IN GDB)
 
 	// See if the monitor is already running
-	status = umdkDirectReadWord(handle, CB_FLAG, &cmdFlag, error);
+	status = umdkDirectReadWord(session, CB_FLAG, &cmdFlag, error);
 	CHECK_STATUS(status, status, cleanup);
 
 	// If monitor is already running, we've got nothing to do. Otherwise...
 	if ( cmdFlag != CF_READY ) {
 		// Read address of VDP vertical interrupt vector
-		status = umdkDirectReadLong(handle, VB_VEC, &vbAddr, error);
+		status = umdkDirectReadLong(session, VB_VEC, &vbAddr, error);
 		CHECK_STATUS(status, status, cleanup);
 
 		// Read illegal instruction vector
-		status = umdkDirectReadLong(handle, IL_VEC, &oldIL, error);
+		status = umdkDirectReadLong(session, IL_VEC, &oldIL, error);
 		CHECK_STATUS(status, status, cleanup);
 		
 		// Read opcode at vbAddr
-		status = umdkDirectReadWord(handle, vbAddr, &oldOp, error);
+		status = umdkDirectReadWord(session, vbAddr, &oldOp, error);
 		CHECK_STATUS(status, status, cleanup);
 		
 		// Write monitor address to illegal instruction vector
-		status = umdkDirectWriteLong(handle, IL_VEC, MONITOR, error);
+		status = umdkDirectWriteLong(session, IL_VEC, MONITOR, error);
 		CHECK_STATUS(status, status, cleanup);
 
 		// Replace opcode at vbAddr with illegal instruction, causing MD to enter monitor
-		status = umdkDirectWriteWord(handle, vbAddr, ILLEGAL, error);
+		status = umdkDirectWriteWord(session, vbAddr, ILLEGAL, error);
 		CHECK_STATUS(status, status, cleanup);
 		
 		// Wait for monitor to start
 		do {
-			status = umdkDirectReadWord(handle, CB_FLAG, &cmdFlag, error);
+			status = umdkDirectReadWord(session, CB_FLAG, &cmdFlag, error);
 			CHECK_STATUS(status, status, cleanup);
 		} while ( cmdFlag != CF_READY );
 		
 		// Restore old opcode back at vbAddr
-		status = umdkDirectWriteWord(handle, vbAddr, oldOp, error);
+		status = umdkDirectWriteWord(session, vbAddr, oldOp, error);
 		CHECK_STATUS(status, status, cleanup);
 
 		// Restore illegal instruction vector
-		status = umdkDirectWriteLong(handle, IL_VEC, oldIL, error);
+		status = umdkDirectWriteLong(session, IL_VEC, oldIL, error);
 		CHECK_STATUS(status, status, cleanup);
 	}
 */
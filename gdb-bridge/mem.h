@@ -7,6 +7,8 @@
 extern "C" {
 #endif
 
+	struct UmdkSession;
+
 	// 68000 registers:
 	struct Registers {
 		uint32 d0;
@@ -31,6 +33,31 @@ extern "C" {
 		uint32 pc;
 	};
 
+	// Scatter/gather descriptor for umdkReadV() and umdkWriteV(). For writes, the data is only read.
+	struct MemVec {
+		uint32 address;
+		uint32 length;
+		uint8 *data;
+	};
+
+	// When to give up waiting in umdkAcquire(). A zero timeout means wait forever; isCancelled may
+	// be NULL, otherwise it is called between polls, and a true result abandons the wait. No polls
+	// are in flight when it is called, so it may itself use the direct-access memory areas.
+	struct Deadline {
+		uint32 timeout;             // milliseconds
+		bool (*isCancelled)(struct UmdkSession *session);
+	};
+
+	// Tuning for umdkAcquire(). It first spins with up to "depth" polls in flight, then after
+	// "spinPolls" misses it backs off, doubling the time between polls up to "maxSleep"
+	// milliseconds. Single-steps are given up after "stepTimeout" milliseconds.
+	struct AcquireConfig {
+		uint32 depth;
+		uint32 spinPolls;
+		uint32 maxSleep;
+		uint32 stepTimeout;
+	};
+
 	typedef enum {
 		D0, D1, D2, D3, D4, D5, D6, D7,
 		A0, A1, A2, A3, A4, A5, FP, SP,
@@ -56,22 +83,64 @@ extern "C" {
 	#define TR_VEC   0x000024
 	#define VB_VEC   0x000078
 	#define MONITOR  0x400000
+	#define CB_VERSION (MONITOR + 0x3FE)  // the last word of the monitor image: its MON_PROTOCOL
 	#define CB_FLAG  (MONITOR + 0x400)
 	#define CB_INDEX (MONITOR + 0x402)
 	#define CB_ADDR  (MONITOR + 0x404)
 	#define CB_LEN   (MONITOR + 0x408)
 	#define CB_REGS  (MONITOR + 0x40C)
 	#define CB_MEM   (MONITOR + 0x454)
+	#define CB_MEM2  (CB_MEM + CB_MEM_SIZE)
+	#define CB_MEM_SIZE 0x8000  // size of each of the two monitor transfer buffers
+	#define CMD_BUF2 0x0100     // OR'd into a CMD_READ or CMD_WRITE to use the second buffer
+
+	// Bumped whenever the command block or the commands change, so a bridge and monitor which don't
+	// match are caught when the session opens (see monitor/monitor.s)
+	#define MON_PROTOCOL 1
+
+	// The SSF2 mapper divides the bottom 8MiB of address-space into 16 banks of 512KiB, each mapped
+	// to one of the 32 pages of SDRAM. Writing page P to the register at 0xA130F1 + 2N maps bank N to
+	// it, or bank N+8 if bit 6 of the value is set. There is no register for banks 0 and 8, so they
+	// stay at their reset pages, 0 and 31: the MD's vectors and the monitor are always there.
+	#define SSF2_NUM_BANKS 16
+	#define SSF2_NUM_PAGES 32
+	#define SSF2_BANK_SIZE 0x80000
+	#define SSF2_REG_FIRST 0xA130F3
+	#define SSF2_REG_LAST  0xA130FF
+
+	// Return codes from umdkAcquire() (and hence umdkStep()) when the deadline is not met
+	#define ACQ_TIMEOUT   40
+	#define ACQ_CANCELLED 41
 
 	// ---------------------------------------------------------------------------------------------
 	// Issuing commands
 	//
 	int umdkRemoteAcquire(
-		struct FLContext *handle, struct Registers *regs, const char **error
+		struct UmdkSession *session, struct Registers *regs, const char **error
+	) WARN_UNUSED_RESULT;
+
+	int umdkAcquire(
+		struct UmdkSession *session, struct Registers *regs, const struct Deadline *deadline,
+		const char **error
+	) WARN_UNUSED_RESULT;
+
+	bool umdkIsDirect(const struct UmdkSession *session, uint32 address, uint32 count);
+
+	void umdkSetBankPage(struct UmdkSession *session, uint32 bank, uint32 page);
+	void umdkForgetBank(struct UmdkSession *session, uint32 bank);
+	bool umdkGetBankPage(const struct UmdkSession *session, uint32 bank, uint32 *page);
+
+	int umdkAddMirror(
+		struct UmdkSession *session, uint32 physAddr, uint32 length, const uint8 *data,
+		const char **error
 	) WARN_UNUSED_RESULT;
+	void umdkDropMirror(struct UmdkSession *session);
+
+	void umdkGetAcquireConfig(struct UmdkSession *session, struct AcquireConfig *config);
+	void umdkSetAcquireConfig(struct UmdkSession *session, const struct AcquireConfig *config);
 
 	int umdkExecuteCommand(
-		struct FLContext *handle, Command command, uint32 address, uint32 length,
+		struct UmdkSession *session, Command command, uint32 address, uint32 length,
 		const uint8 *sendData, uint8 *recvData, struct Registers *regs,
 		const char **error
 	) WARN_UNUSED_RESULT;
@@ -80,109 +149,130 @@ extern "C" {
 	// Direct read/write operations
 	//
 	int umdkPhysicalWriteBytes(
-		struct FLContext *handle, uint32 address, uint32 count, const uint8 *data,
+		struct UmdkSession *session, uint32 address, uint32 count, const uint8 *data,
 		const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDirectWriteFile(
-		struct FLContext *handle, uint32 address, const char *fileName, const char **error
+		struct UmdkSession *session, uint32 address, const char *fileName, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDirectWriteBytes(
-		struct FLContext *handle, uint32 address, uint32 count, const uint8 *data,
+		struct UmdkSession *session, uint32 address, uint32 count, const uint8 *data,
 		const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDirectWriteWord(
-		struct FLContext *handle, uint32 address, uint16 value, const char **error
+		struct UmdkSession *session, uint32 address, uint16 value, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDirectWriteLong(
-		struct FLContext *handle, uint32 address, uint32 value, const char **error
+		struct UmdkSession *session, uint32 address, uint32 value, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDirectReadBytes(
-		struct FLContext *handle, uint32 address, uint32 count, uint8 *data,
+		struct UmdkSession *session, uint32 address, uint32 count, uint8 *data,
 		const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDirectReadBytesAsync(
-		struct FLContext *handle, uint32 address, uint32 count, const char **error
+		struct UmdkSession *session, uint32 address, uint32 count, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDirectReadWord(
-		struct FLContext *handle, uint32 address, uint16 *pValue, const char **error
+		struct UmdkSession *session, uint32 address, uint16 *pValue, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDirectReadLong(
-		struct FLContext *handle, uint32 address, uint32 *pValue, const char **error
+		struct UmdkSession *session, uint32 address, uint32 *pValue, const char **error
 	) WARN_UNUSED_RESULT;
 
 	// ---------------------------------------------------------------------------------------------
 	// Generic read/write operations (delegate to direct/indirect as needed)
 	//
 	int umdkWriteBytes(
-		struct FLContext *handle, uint32 address, uint32 count, const uint8 *data,
+		struct UmdkSession *session, uint32 address, uint32 count, const uint8 *data,
 		const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkWriteWord(
-		struct FLContext *handle, uint32 address, uint16 value, const char **error
+		struct UmdkSession *session, uint32 address, uint16 value, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkWriteLong(
-		struct FLContext *handle, uint32 address, uint32 value, const char **error
+		struct UmdkSession *session, uint32 address, uint32 value, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkReadBytes(
-		struct FLContext *handle, uint32 address, uint32 count, uint8 *data,
+		struct UmdkSession *session, uint32 address, uint32 count, uint8 *data,
 		const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkReadWord(
-		struct FLContext *handle, uint32 address, uint16 *pValue, const char **error
+		struct UmdkSession *session, uint32 address, uint16 *pValue, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkReadLong(
-		struct FLContext *handle, uint32 address, uint32 *pValue, const char **error
+		struct UmdkSession *session, uint32 address, uint32 *pValue, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkDumpRAM(
-		struct FLContext *handle, const char *fileName, const char **error
+		struct UmdkSession *session, const char *fileName, const char **error
+	) WARN_UNUSED_RESULT;
+
+	// ---------------------------------------------------------------------------------------------
+	// Scatter/gather read/write operations (direct descriptors are pipelined together)
+	//
+	int umdkReadV(
+		struct UmdkSession *session, const struct MemVec *vec, uint32 count, const char **error
+	) WARN_UNUSED_RESULT;
+
+	int umdkWriteV(
+		struct UmdkSession *session, const struct MemVec *vec, uint32 count, const char **error
 	) WARN_UNUSED_RESULT;
 
 	// ---------------------------------------------------------------------------------------------
 	// Control flow operations
 	//
 	int umdkStep(
-		struct FLContext *handle, struct Registers *regs, const char **error
+		struct UmdkSession *session, struct Registers *regs, const char **error
+	) WARN_UNUSED_RESULT;
+
+	int umdkStepRange(
+		struct UmdkSession *session, uint32 start, uint32 end,
+		bool (*isStop)(struct UmdkSession *session, const struct Registers *regs),
+		struct Registers *regs, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkContWait(
-		struct FLContext *handle, struct Registers *regs, const char **error
+		struct UmdkSession *session, struct Registers *regs, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkContinue(
-		struct FLContext *handle, const char **error
+		struct UmdkSession *session, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkOpenTrace(
-		const char *fileName
+		struct UmdkSession *session, const char *fileName
 	) WARN_UNUSED_RESULT;
 
 	// ---------------------------------------------------------------------------------------------
 	// Register set/get operations
 	//
 	int umdkSetRegister(
-		struct FLContext *handle, Register reg, uint32 value, const char **error
+		struct UmdkSession *session, Register reg, uint32 value, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkGetRegister(
-		struct FLContext *handle, Register reg, uint32 *value, const char **error
+		struct UmdkSession *session, Register reg, uint32 *value, const char **error
+	) WARN_UNUSED_RESULT;
+
+	int umdkGetRegisters(
+		struct UmdkSession *session, struct Registers *regs, const char **error
 	) WARN_UNUSED_RESULT;
 
 	int umdkReset(
-		struct FLContext *handle, const char **error
+		struct UmdkSession *session, const char **error
 	) WARN_UNUSED_RESULT;
 
 #ifdef __cplusplus
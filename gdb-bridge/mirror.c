@@ -0,0 +1,151 @@
+// Host-side copies of the images uploaded to SDRAM. It knows nothing of how the MD sees them: mem.c
+// translates MD addresses through the bank map, serves reads from the pages which still match what
+// was uploaded, and marks pages stale as the host writes to them.
+//
+#include <stdlib.h>
+#include <string.h>
+#include "mirror.h"
+
+static bool findOverlap(
+	const struct MirrorImage *image, uint32 physAddr, uint32 count, uint32 *first, uint32 *last);
+static void freeImage(struct MirrorImage *image);
+
+// Keep a copy of an image just written to SDRAM at the given address. Any images it overlaps are
+// left with those pages stale. Returns nonzero if the copy couldn't be allocated.
+//
+int mirrorAdd(struct Mirror *mirror, uint32 physAddr, uint32 length, const uint8 *data) {
+	const uint32 numPages = (length + MIRROR_PAGE_SIZE - 1) / MIRROR_PAGE_SIZE;
+	struct MirrorImage image = {physAddr, length, NULL, NULL};
+	struct MirrorImage *images;
+	if ( length == 0 ) {
+		return 0;
+	}
+	image.data = (uint8 *)malloc(length);
+	image.stale = (uint8 *)calloc(numPages, 1);
+	images = (struct MirrorImage *)realloc(
+		mirror->images, (mirror->numImages + 1) * sizeof(struct MirrorImage));
+	if ( !image.data || !image.stale || !images ) {
+		freeImage(&image);
+		if ( images ) {
+			mirror->images = images;
+		}
+		return 1;
+	}
+	memcpy(image.data, data, length);
+	mirror->images = images;
+	mirrorInvalidate(mirror, physAddr, length);
+	mirror->images[mirror->numImages++] = image;
+	return 0;
+}
+
+// Copy the given range from the newest image which holds it, if one does and none of the range's
+// pages have gone stale. Returns false, having copied nothing, if it must be read from SDRAM.
+//
+bool mirrorRead(struct Mirror *mirror, uint32 physAddr, uint32 count, uint8 *data) {
+	const struct MirrorImage *image;
+	uint32 i, offset, page, last;
+	for ( i = mirror->numImages; i--; ) {
+		image = mirror->images + i;
+		offset = physAddr - image->physAddr;
+		if (
+			physAddr >= image->physAddr && offset < image->length &&
+			count <= image->length - offset )
+		{
+			last = (offset + count - 1) / MIRROR_PAGE_SIZE;
+			for ( page = offset / MIRROR_PAGE_SIZE; page <= last && count; page++ ) {
+				if ( image->stale[page] ) {
+					return false;
+				}
+			}
+			memcpy(data, image->data + offset, count);
+			mirror->hits++;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Update the copies of any images the given write touches, so their pages stay good: for when the
+// host knows exactly what it's writing to SDRAM.
+//
+void mirrorWrite(struct Mirror *mirror, uint32 physAddr, uint32 count, const uint8 *data) {
+	const struct MirrorImage *image;
+	uint32 i, first, last;
+	for ( i = 0; i < mirror->numImages; i++ ) {
+		image = mirror->images + i;
+		if ( findOverlap(image, physAddr, count, &first, &last) ) {
+			memcpy(image->data + first, data + image->physAddr + first - physAddr, last - first);
+		}
+	}
+}
+
+// Mark stale the pages of any images the given range touches: for when the host writes to SDRAM in
+// a way the mirror can't follow.
+//
+void mirrorInvalidate(struct Mirror *mirror, uint32 physAddr, uint32 count) {
+	const struct MirrorImage *image;
+	uint32 i, first, last;
+	for ( i = 0; i < mirror->numImages; i++ ) {
+		image = mirror->images + i;
+		if ( findOverlap(image, physAddr, count, &first, &last) ) {
+			first /= MIRROR_PAGE_SIZE;
+			last = (last - 1) / MIRROR_PAGE_SIZE;
+			memset(image->stale + first, 1, last - first + 1);
+		}
+	}
+}
+
+// Count the pages of the given image which have gone stale.
+//
+uint32 mirrorCountStale(const struct MirrorImage *image) {
+	const uint32 numPages = (image->length + MIRROR_PAGE_SIZE - 1) / MIRROR_PAGE_SIZE;
+	uint32 i, stale = 0;
+	for ( i = 0; i < numPages; i++ ) {
+		if ( image->stale[i] ) {
+			stale++;
+		}
+	}
+	return stale;
+}
+
+// Drop all the images.
+//
+void mirrorDestroy(struct Mirror *mirror) {
+	uint32 i;
+	for ( i = 0; i < mirror->numImages; i++ ) {
+		freeImage(mirror->images + i);
+	}
+	free(mirror->images);
+	mirror->images = NULL;
+	mirror->numImages = 0;
+}
+
+
+// *************************************************************************************************
+// **                               Operations private to this file                               **
+// *************************************************************************************************
+
+// Find the part of the image the given range overlaps, as offsets into it, the last exclusive.
+// Returns false if they don't overlap.
+//
+static bool findOverlap(
+	const struct MirrorImage *image, uint32 physAddr, uint32 count, uint32 *first, uint32 *last)
+{
+	if (
+		count == 0 || physAddr >= image->physAddr + image->length ||
+		physAddr + count <= image->physAddr )
+	{
+		return false;
+	}
+	*first = (physAddr > image->physAddr) ? physAddr - image->physAddr : 0;
+	*last = physAddr + count - image->physAddr;
+	if ( *last > image->length ) {
+		*last = image->length;
+	}
+	return true;
+}
+
+static void freeImage(struct MirrorImage *image) {
+	free(image->data);
+	free(image->stale);
+}
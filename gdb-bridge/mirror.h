@@ -0,0 +1,43 @@
+#ifndef MIRROR_H
+#define MIRROR_H
+
+#include <makestuff.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// Each image's pages are tracked at the same granularity as the page cache's
+	#define MIRROR_PAGE_SIZE 256
+
+	// A copy of an image the host wrote to SDRAM, and which of its pages may since have changed
+	struct MirrorImage {
+		uint32 physAddr;  // the SDRAM address the image was written at
+		uint32 length;
+		uint8 *data;
+		uint8 *stale;     // one flag per page: nonzero if the page no longer matches SDRAM
+	};
+
+	// The images the host has uploaded, keyed by the SDRAM range they occupy. The MD doesn't
+	// normally write to its own ROM, so the unchanged pages of an image are good whether it's
+	// running or not.
+	// All zeros is empty.
+	struct Mirror {
+		struct MirrorImage *images;
+		uint32 numImages;
+		uint32 hits;
+	};
+
+	int mirrorAdd(struct Mirror *mirror, uint32 physAddr, uint32 length, const uint8 *data)
+		WARN_UNUSED_RESULT;
+	bool mirrorRead(struct Mirror *mirror, uint32 physAddr, uint32 count, uint8 *data);
+	void mirrorWrite(struct Mirror *mirror, uint32 physAddr, uint32 count, const uint8 *data);
+	void mirrorInvalidate(struct Mirror *mirror, uint32 physAddr, uint32 count);
+	uint32 mirrorCountStale(const struct MirrorImage *image);
+	void mirrorDestroy(struct Mirror *mirror);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
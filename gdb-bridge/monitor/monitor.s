@@ -2,6 +2,7 @@
 
 	monBase	= 0x400000
 	cmdFlag	= monBase + 0x400
+	protocol	= 1	/* bump with MON_PROTOCOL in mem.h when the command block or commands change */
 	cmdIdx	= cmdFlag + 2
 	address	= cmdFlag + 4*1
 	length	= cmdFlag + 4*2
@@ -11,6 +12,7 @@
 	srSave	= svBase + 4*16
 	pcSave	= svBase + 4*17
 	ramSave	= svBase + 4*18
+	bufSize	= 0x8000	/* size of each of the two transfer buffers at ramSave */
 
 	SPIDATW	= 0x0000 /* SPI word read/write */
 	SPIDATB	= 0x0002 /* SPI byte read/write */
@@ -123,8 +125,11 @@ doNothing:
 read:
 	move.l	address, a0
 	lea	ramSave, a1
-	move.l	length, d0
-	asr	#1, d0
+	btst	#0, cmdIdx		/* bit 8 of the command index selects... */
+	beq.s	1f
+	adda.l	#bufSize, a1		/* ...the second transfer buffer */
+1:	move.l	length, d0
+	lsr.l	#1, d0
 	subq	#1, d0
 rdLoop:	move.w	(a0)+, (a1)+
 	dbra	d0, rdLoop
@@ -133,8 +138,11 @@ rdLoop:	move.w	(a0)+, (a1)+
 write:
 	move.l	address, a1
 	lea	ramSave, a0
-	move.l	length, d0
-	asr	#1, d0
+	btst	#0, cmdIdx		/* bit 8 of the command index selects... */
+	beq.s	1f
+	adda.l	#bufSize, a0		/* ...the second transfer buffer */
+1:	move.l	length, d0
+	lsr.l	#1, d0
 	subq	#1, d0
 wrLoop:	move.w	(a0)+, (a1)+
 	dbra	d0, wrLoop
@@ -155,5 +163,6 @@ jTab:
 	dc.l	doNothing-lda2-2
 	dc.l	doNothing-lda2-2
 
+	/* The last word is the protocol version, which the host checks when it opens a session */
 	.org    0x0004FE
-	dc.w	0x0000
+	dc.w	protocol
@@ -0,0 +1,331 @@
+// GDB remote protocol packet I/O. Incoming bytes are read into a ring in as few recv() calls as
+// the socket allows, and framed into packets from there, so a large X packet no longer costs a
+// syscall per byte, and several pipelined packets can arrive in one read. Outgoing acks and
+// packets are queued in one buffer and sent with a single send().
+//
+#include <string.h>
+#ifdef WIN32
+	#include <winsock2.h>
+#else
+	#include <sys/select.h>
+	#include <sys/socket.h>
+#endif
+#include "packet.h"
+#include "codec.h"
+
+#define RING_MASK (PKT_RING_SIZE - 1)
+
+static bool skipToPacket(struct PacketReader *reader);
+static int hexValue(uint8 ch);
+static void beginFrame(struct PacketWriter *writer, char start);
+
+
+// *************************************************************************************************
+// **                                       Reading packets                                       **
+// *************************************************************************************************
+
+// Receive whatever the socket has, up to the free space at the end of the ring. If wait is false,
+// this returns zero straight away if there is nothing to read; otherwise it blocks until something
+// arrives. Returns the number of bytes received, or -1 if the connection has closed (in which case
+// the closed flag is also set) or failed.
+//
+int pktFill(struct PacketReader *reader, SOCKET conn, bool wait) {
+	const uint32 offset = reader->tail & RING_MASK;
+	uint32 space = PKT_RING_SIZE - (reader->tail - reader->head);
+	int numRead;
+	if ( space > PKT_RING_SIZE - offset ) {
+		space = PKT_RING_SIZE - offset;
+	}
+	if ( space == 0 ) {
+		return 0;
+	}
+	if ( !wait ) {
+		fd_set readSet;
+		struct timeval timeout = {0, 0};
+		FD_ZERO(&readSet);
+		FD_SET(conn, &readSet);
+		if ( select((int)conn + 1, &readSet, NULL, NULL, &timeout) <= 0 ) {
+			return 0;
+		}
+	}
+	numRead = recv(conn, (char *)reader->ring + offset, (int)space, 0);
+	if ( numRead <= 0 ) {
+		if ( numRead == 0 ) {
+			reader->closed = true;
+		}
+		return -1;
+	}
+	reader->tail += (uint32)numRead;
+	return numRead;
+}
+
+// Append bytes received by some other means. Anything that doesn't fit in the ring is dropped.
+//
+void pktFeed(struct PacketReader *reader, const uint8 *data, uint32 count) {
+	const uint32 space = PKT_RING_SIZE - (reader->tail - reader->head);
+	if ( count > space ) {
+		count = space;
+	}
+	while ( count-- ) {
+		reader->ring[reader->tail++ & RING_MASK] = *data++;
+	}
+}
+
+// Frame the next packet from the ring. On PKT_MESSAGE or PKT_BAD_CHECKSUM the packet body (without
+// the '$', '#' and checksum) is copied to buf and NUL-terminated, and its length is returned in
+// *length. Acks between packets are skipped; a 0x03 between packets is returned as PKT_INTERRUPT.
+// Successive calls carry on scanning from where the last one got to, so a large packet arriving in
+// pieces is only scanned once.
+//
+PacketStatus pktNext(struct PacketReader *reader, char *buf, uint32 bufSize, uint32 *length) {
+	uint32 hash, count, offset, first, segment;
+	int upper, lower;
+	const uint8 *start, *found;
+	if ( skipToPacket(reader) ) {
+		return PKT_INTERRUPT;
+	}
+	if ( reader->head == reader->tail ) {
+		return PKT_NONE;
+	}
+	if ( reader->scan == reader->head ) {
+		// A new packet: start the checksum after the '$'
+		reader->scan = reader->head + 1;
+		reader->sum = 0;
+	}
+
+	// Look for the '#', carrying on from where the last call got to, a contiguous segment of the
+	// ring at a time
+	while ( reader->scan != reader->tail ) {
+		offset = reader->scan & RING_MASK;
+		segment = reader->tail - reader->scan;
+		if ( segment > PKT_RING_SIZE - offset ) {
+			segment = PKT_RING_SIZE - offset;
+		}
+		start = reader->ring + offset;
+		found = (const uint8 *)memchr(start, '#', segment);
+		if ( found ) {
+			segment = (uint32)(found - start);
+		}
+		reader->sum = codecChecksum((const char *)start, segment, reader->sum);
+		reader->scan += segment;
+		if ( found ) {
+			break;
+		}
+	}
+	if ( reader->tail - reader->scan < 3 ) {
+		// Still waiting for the '#' or the checksum digits
+		if ( reader->tail - reader->head == PKT_RING_SIZE ) {
+			// The packet is bigger than the ring, so it can never be framed: drop it
+			reader->head = reader->scan = reader->tail;
+			return PKT_OVERFLOW;
+		}
+		return PKT_NONE;
+	}
+
+	// We have the whole packet: consume it, then see whether the caller can have it
+	hash = reader->scan;
+	count = hash - reader->head - 1;
+	offset = (reader->head + 1) & RING_MASK;
+	upper = hexValue(reader->ring[(hash + 1) & RING_MASK]);
+	lower = hexValue(reader->ring[(hash + 2) & RING_MASK]);
+	reader->head = reader->scan = hash + 3;
+	if ( count >= bufSize ) {
+		return PKT_OVERFLOW;
+	}
+	first = PKT_RING_SIZE - offset;
+	if ( first > count ) {
+		first = count;
+	}
+	memcpy(buf, reader->ring + offset, first);
+	memcpy(buf + first, reader->ring, count - first);
+	buf[count] = '\0';
+	*length = count;
+	if ( upper < 0 || lower < 0 || (uint8)((upper << 4) | lower) != reader->sum ) {
+		return PKT_BAD_CHECKSUM;
+	}
+	return PKT_MESSAGE;
+}
+
+// Consume a 0x03 if GDB has sent one since the last packet, skipping any acks before it. A packet
+// arriving in the meantime is left alone for pktNext().
+//
+bool pktTakeInterrupt(struct PacketReader *reader) {
+	return skipToPacket(reader);
+}
+
+
+// *************************************************************************************************
+// **                                       Writing packets                                       **
+// *************************************************************************************************
+
+// Queue an ack (or a request for retransmission) for the packet just received.
+//
+void pktAck(struct PacketWriter *writer, bool good) {
+	if ( writer->length < PKT_WRITE_SIZE ) {
+		writer->buf[writer->length++] = good ? '+' : '-';
+	}
+}
+
+// Start a new packet. Any number of packets may be queued before they are flushed.
+//
+void pktBegin(struct PacketWriter *writer) {
+	beginFrame(writer, '$');
+}
+
+// Start a new notification: framed like a packet, but starting with '%', and never acked.
+//
+void pktBeginNotification(struct PacketWriter *writer) {
+	beginFrame(writer, '%');
+}
+
+// Append raw payload to the packet being built. The caller is responsible for escaping.
+//
+void pktAppend(struct PacketWriter *writer, const char *data, uint32 count) {
+	const uint32 space = pktSpace(writer);
+	if ( count > space ) {
+		count = space;
+		writer->overflow = true;
+	}
+	memcpy(writer->buf + writer->length, data, count);
+	writer->sum = codecChecksum(data, count, writer->sum);
+	writer->length += count;
+}
+
+// Append the hex representation of some binary data to the packet being built.
+//
+void pktAppendHex(struct PacketWriter *writer, const uint8 *data, uint32 count) {
+	if ( 2 * count > pktSpace(writer) ) {
+		count = pktSpace(writer) / 2;
+		writer->overflow = true;
+	}
+	writer->sum = codecHexEncode(writer->buf + writer->length, data, count, writer->sum);
+	writer->length += 2 * count;
+}
+
+// Append some binary data to the packet being built, escaping the bytes GDB can't take raw ('#',
+// '$', '}' and the run-length marker '*') as '}' followed by the byte XOR 0x20. Escaping may make
+// the data too big for the writer, so this returns the number of bytes actually appended.
+//
+uint32 pktAppendBinary(struct PacketWriter *writer, const uint8 *data, uint32 count) {
+	char *const begin = writer->buf + writer->length;
+	char *ptr = begin;
+	const char *const end = ptr + pktSpace(writer);
+	uint32 i;
+	uint8 byte;
+	for ( i = 0; i < count; i++ ) {
+		byte = data[i];
+		if ( byte == '#' || byte == '$' || byte == '}' || byte == '*' ) {
+			if ( end - ptr < 2 ) {
+				break;
+			}
+			*ptr++ = '}';
+			*ptr++ = (char)(byte ^ 0x20);
+		} else {
+			if ( ptr == end ) {
+				break;
+			}
+			*ptr++ = (char)byte;
+		}
+	}
+	if ( i < count ) {
+		writer->overflow = true;
+	}
+	writer->sum = codecChecksum(begin, (uint32)(ptr - begin), writer->sum);
+	writer->length = (uint32)(ptr - writer->buf);
+	return i;
+}
+
+// Finish the packet being built by appending the '#' and the checksum kept while it was built.
+//
+void pktEnd(struct PacketWriter *writer) {
+	if ( writer->length + 3 > PKT_WRITE_SIZE ) {
+		writer->overflow = true;
+		return;
+	}
+	writer->buf[writer->length++] = '#';
+	codecHexEncode(writer->buf + writer->length, &writer->sum, 1, 0);
+	writer->length += 2;
+}
+
+// How much more payload the packet being built can take, leaving room for its checksum.
+//
+uint32 pktSpace(const struct PacketWriter *writer) {
+	return (writer->length + 3 < PKT_WRITE_SIZE) ? PKT_WRITE_SIZE - 3 - writer->length : 0;
+}
+
+// Send everything queued, in one send() unless the socket takes it in pieces.
+//
+int pktFlush(struct PacketWriter *writer, SOCKET conn) {
+	const char *ptr = writer->buf;
+	uint32 remaining = writer->length;
+	int numSent;
+	writer->length = 0;
+	while ( remaining ) {
+		numSent = send(conn, ptr, (int)remaining, 0);
+		if ( numSent <= 0 ) {
+			return -1;
+		}
+		ptr += numSent;
+		remaining -= (uint32)numSent;
+	}
+	return 0;
+}
+
+// Queue a whole packet with the given body, and send it along with anything already queued.
+//
+int pktSend(struct PacketWriter *writer, SOCKET conn, const char *body, uint32 count) {
+	pktBegin(writer);
+	pktAppend(writer, body, count);
+	pktEnd(writer);
+	return pktFlush(writer, conn);
+}
+
+
+// *************************************************************************************************
+// **                               Operations private to this file                               **
+// *************************************************************************************************
+
+// Skip the acks (and any other noise) between packets, stopping at the start of the next packet.
+// Returns true if a 0x03 was consumed on the way.
+//
+static bool skipToPacket(struct PacketReader *reader) {
+	uint8 ch;
+	if ( reader->scan != reader->head ) {
+		return false;  // part-way through framing a packet already
+	}
+	while ( reader->head != reader->tail ) {
+		ch = reader->ring[reader->head & RING_MASK];
+		if ( ch == '$' ) {
+			break;
+		}
+		reader->head++;
+		reader->scan = reader->head;
+		if ( ch == 0x03 ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void beginFrame(struct PacketWriter *writer, char start) {
+	writer->start = writer->length;
+	writer->sum = 0;
+	writer->overflow = false;
+	if ( writer->length < PKT_WRITE_SIZE ) {
+		writer->buf[writer->length++] = start;
+	} else {
+		writer->overflow = true;
+	}
+}
+
+static int hexValue(uint8 ch) {
+	if ( ch >= '0' && ch <= '9' ) {
+		return ch - '0';
+	} else if ( ch >= 'a' && ch <= 'f' ) {
+		return ch - 'a' + 10;
+	} else if ( ch >= 'A' && ch <= 'F' ) {
+		return ch - 'A' + 10;
+	} else {
+		return -1;
+	}
+}
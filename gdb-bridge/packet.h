@@ -0,0 +1,72 @@
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <makestuff.h>
+#include "sock.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// The largest packet body we accept, advertised to GDB as our PacketSize
+	#define PKT_MAX_SIZE   0x8000
+
+	// Both buffers must be a power of two in size, and have room for a whole packet and more
+	#define PKT_RING_SIZE  0x10000
+	#define PKT_WRITE_SIZE 0x10000
+
+	typedef enum {
+		PKT_NONE,          // no complete packet buffered yet
+		PKT_MESSAGE,       // a packet with a good checksum was framed
+		PKT_INTERRUPT,     // GDB sent a 0x03 between packets
+		PKT_BAD_CHECKSUM,  // a packet was framed, but its checksum was wrong
+		PKT_OVERFLOW       // a packet was too big for the caller's buffer (or the ring), and dropped
+	} PacketStatus;
+
+	// Bytes received from GDB but not yet framed into packets. The indices are free-running, so
+	// the ring is empty when they are equal and full when they are PKT_RING_SIZE apart.
+	struct PacketReader {
+		uint8 ring[PKT_RING_SIZE];
+		uint32 head;     // first byte not yet consumed
+		uint32 tail;     // where the next byte received will go
+		uint32 scan;     // how far the search for the end of the current packet has got
+		uint8 sum;       // running checksum of the current packet, up to scan
+		bool closed;     // GDB closed the connection
+	};
+
+	// Acks and packets queued for GDB, sent all together by pktFlush()
+	struct PacketWriter {
+		char buf[PKT_WRITE_SIZE];
+		uint32 length;   // bytes queued
+		uint32 start;    // offset of the '$' of the packet being built
+		uint8 sum;       // running checksum of the packet being built
+		bool overflow;   // something didn't fit, so the packet being built has been truncated
+	};
+
+	// ---------------------------------------------------------------------------------------------
+	// Reading packets
+	//
+	int pktFill(struct PacketReader *reader, SOCKET conn, bool wait);
+	void pktFeed(struct PacketReader *reader, const uint8 *data, uint32 count);
+	PacketStatus pktNext(struct PacketReader *reader, char *buf, uint32 bufSize, uint32 *length);
+	bool pktTakeInterrupt(struct PacketReader *reader);
+
+	// ---------------------------------------------------------------------------------------------
+	// Writing packets
+	//
+	void pktAck(struct PacketWriter *writer, bool good);
+	void pktBegin(struct PacketWriter *writer);
+	void pktBeginNotification(struct PacketWriter *writer);
+	void pktAppend(struct PacketWriter *writer, const char *data, uint32 count);
+	void pktAppendHex(struct PacketWriter *writer, const uint8 *data, uint32 count);
+	uint32 pktAppendBinary(struct PacketWriter *writer, const uint8 *data, uint32 count);
+	void pktEnd(struct PacketWriter *writer);
+	uint32 pktSpace(const struct PacketWriter *writer);
+	int pktFlush(struct PacketWriter *writer, SOCKET conn);
+	int pktSend(struct PacketWriter *writer, SOCKET conn, const char *body, uint32 count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
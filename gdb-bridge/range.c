@@ -39,3 +39,16 @@ bool isOverlapEnd(uint32 r1start, uint32 r1length, uint32 r2start, uint32 r2leng
 		return false;
 	}
 }
+
+// Copy a one-word patch at patchAddress (e.g the opcode saved from under a breakpoint) into buf,
+// which holds the bufSize bytes of memory starting at targetAddress. Only the part of the patch
+// that lies within buf is copied, so either byte may be left out at the ends of buf.
+void patch(uint8 *buf, uint32 targetAddress, uint32 bufSize, const uint8 *patchData, uint32 patchAddress) {
+	uint32 i, offset;
+	for ( i = 0; i < 2; i++ ) {
+		offset = patchAddress + i - targetAddress;
+		if ( offset < bufSize ) {
+			buf[offset] = patchData[i];
+		}
+	}
+}
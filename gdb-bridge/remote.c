@@ -1,9 +1,9 @@
 // This module has just one entry point:
-//   int processMessage(const char *buf, int size, SOCKET conn)
+//   int processMessage(const char *buf, int size, struct UmdkSession *session)
 //     buf - an incoming GDB remote message.
 //     size - the number of bytes in the message.
-//     conn - the file handle to write the response to: can be a TCP socket or something else.
-//     handle - an FPGALink handle
+//     session - the board to act on; responses are queued on its writer after the ack for the
+//               message, and sent to its conn, which can be a TCP socket or something else.
 //
 #include <stdio.h>
 #include <stdlib.h>
@@ -20,36 +20,19 @@
 #include "sock.h"
 #include "remote.h"
 #include "mem.h"
-
-// Hex digits used in cmdReadMemory() and checksum():
-static const char hexDigits[] = {
-	'0', '1', '2', '3', '4', '5', '6', '7', 
-	'8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
-};
+#include "escape.h"
+#include "stats.h"
+#include "session.h"
+#include "packet.h"
+#include "codec.h"
+#include "trace.h"
 
 // GDB remote protocol standard responses:
-#define RESPONSE_OK    "+$OK#9A"
-#define RESPONSE_EMPTY "+$#00"
-#define RESPONSE_SIG   "+$S05#B8"
+#define RESPONSE_OK    "OK"
+#define RESPONSE_EMPTY ""
+#define RESPONSE_SIG   "T05"
 #define VL(x) x, (sizeof(x)-1)
 
-// Breakpoint stuff:
-#define NUM_BRKPOINTS 8
-struct BreakInfo {
-	uint32 addr;
-	uint16 save;
-};
-static struct BreakInfo breakpoints[] = {
-	{0x00000000, 0x0000},
-	{0x00000000, 0x0000},
-	{0x00000000, 0x0000},
-	{0x00000000, 0x0000},
-	{0x00000000, 0x0000},
-	{0x00000000, 0x0000},
-	{0x00000000, 0x0000},
-	{0x00000000, 0x0000}
-};
-
 // Parse a series of somechar-separated hex numbers
 // e.g parseList("a9,0a:cafe", NULL, &v1, ',', &v2, ':', &v3, '\0', NULL);
 // Remember the NULL at the end!
@@ -75,16 +58,17 @@ static int parseList(const char *buf, const char **endPtr, ...) {
 	return 0;
 }
 
-// Calculate the checksum of a #-terminated series of chars. Write the two-digit checksum after it
-static void checksum(char *message) {
-	uint8 checksum = 0;
-	while ( *message != '#' ) {
-		checksum = (uint8)(checksum + *message);
-		message++;
-	}
-	message++;
-	*message++ = hexDigits[checksum >> 4];
-	*message = hexDigits[checksum & 0x0F];
+// Send a response packet with the given body, along with the ack queued before it
+static int sendPacket(struct UmdkSession *session, const char *body, uint32 count) {
+	return pktSend(&session->writer, session->conn, body, count);
+}
+
+// Send response, hex-encoded
+static int sendResponse(const uint8 *bytes, uint32 numBytes, struct UmdkSession *session) {
+	pktBegin(&session->writer);
+	pktAppendHex(&session->writer, bytes, numBytes);
+	pktEnd(&session->writer);
+	return pktFlush(&session->writer, session->conn);
 }
 
 static const char *regNames[] = {
@@ -94,11 +78,10 @@ static const char *regNames[] = {
 };
 
 // TODO: Fix debug/error handling
-static const char *g_error = NULL;
-#define CHKERR(s) do { if ( s ) { if ( g_error ) { printf("%s\n", g_error); flFreeError(g_error); g_error = NULL; } else { printf("Error code %d\n", status); } } } while(0)
+#define CHKERR(s) do { if ( s ) { if ( session->error ) { printf("%s\n", session->error); flFreeError(session->error); session->error = NULL; } else { printf("Error code %d\n", status); } } } while(0)
 
 // Process GDB write-register command
-static int cmdWriteRegister(const char *cmd, SOCKET conn, struct FLContext *handle) {
+static int cmdWriteRegister(const char *cmd, struct UmdkSession *session) {
 	char *end;
 	uint32 reg;
 	uint32 val;
@@ -111,343 +94,1055 @@ static int cmdWriteRegister(const char *cmd, SOCKET conn, struct FLContext *hand
 		cmd = end + 1;
 		val = strtoul(cmd, NULL, 16);
 		printf("%s = 0x%08X\n", regNames[reg], val);
-		status = umdkSetRegister(handle, reg, val, &g_error);
+		status = umdkSetRegister(session, reg, val, &session->error);
 		CHKERR(status);
 	}
-	return send(conn, VL(RESPONSE_OK), 0);
+	return sendPacket(session, VL(RESPONSE_OK));
+}
+
+// Registers go to GDB in target (i.e big-endian) byte order
+static void putLong(uint8 *buf, uint32 val) {
+	buf[0] = (uint8)(val >> 24);
+	buf[1] = (uint8)(val >> 16);
+	buf[2] = (uint8)(val >> 8);
+	buf[3] = (uint8)val;
+}
+
+// Read memory as GDB should see it, with the original opcodes in place of the breakpoints in it.
+// Then GDB can leave its breakpoints inserted while it looks at the code.
+static int readMemory(struct UmdkSession *session, uint32 address, uint32 count, uint8 *buf) {
+	int status = umdkReadBytes(session, address, count, buf, &session->error);
+	if ( status == 0 ) {
+		brkPatch(&session->breakpoints, buf, address, count);
+	}
+	return status;
+}
+
+// Append a T packet body carrying the registers GDB needs to show where the MD stopped, so it
+// doesn't have to ask for them with 'g'. In non-stop mode GDB wants to know the thread, though
+// there's only one; and a stop it asked for with vCont;t is reported as signal 0.
+static void appendStopReply(struct UmdkSession *session, const struct Registers *regs) {
+	static const Register expedited[] = {FP, SP, SR, PC};
+	struct PacketWriter *const writer = &session->writer;
+	const uint32 *const src = &regs->d0;
+	char field[4];
+	uint8 value[4];
+	uint32 i;
+	if ( session->stopRequested ) {
+		pktAppend(writer, VL("T00"));
+		session->stopRequested = false;
+	} else {
+		pktAppend(writer, VL(RESPONSE_SIG));
+	}
+	for ( i = 0; i < sizeof(expedited)/sizeof(*expedited); i++ ) {
+		sprintf(field, "%02x:", expedited[i]);
+		pktAppend(writer, field, 3);
+		putLong(value, src[expedited[i]]);
+		pktAppendHex(writer, value, 4);
+		pktAppend(writer, ";", 1);
+	}
+	if ( session->nonStop ) {
+		pktAppend(writer, VL("thread:1;"));
+	}
+}
+
+// Reply to a command with the stop it caused, or to a halt-reason query with the last one
+static int sendStopReply(struct UmdkSession *session, const struct Registers *regs) {
+	pktBegin(&session->writer);
+	appendStopReply(session, regs);
+	pktEnd(&session->writer);
+	return pktFlush(&session->writer, session->conn);
+}
+
+// Report the MD stopping after a command set it running: as the reply to the command in all-stop
+// mode, or in non-stop mode as a Stop notification, the command having had its OK already
+static int reportStop(struct UmdkSession *session, const struct Registers *regs) {
+	if ( !session->nonStop ) {
+		return sendStopReply(session, regs);
+	}
+	pktBeginNotification(&session->writer);
+	pktAppend(&session->writer, VL("Stop:"));
+	appendStopReply(session, regs);
+	pktEnd(&session->writer);
+	return pktFlush(&session->writer, session->conn);
+}
+
+// Answer a command which sets the MD running. In all-stop mode the answer is the stop reply, which
+// may be a long time coming, so just the ack goes now; in non-stop mode it's an OK, and the stop is
+// reported later by reportStop()
+static int acceptResume(struct UmdkSession *session) {
+	if ( session->nonStop ) {
+		return sendPacket(session, VL(RESPONSE_OK));
+	}
+	return pktFlush(&session->writer, session->conn);
 }
 
 // Process GDB read-register command
-static int cmdReadRegister(const char *cmd, SOCKET conn, struct FLContext *handle) {
+static int cmdReadRegister(const char *cmd, struct UmdkSession *session) {
 	uint32 reg, val;
-	char response[13];
+	uint8 response[4];
 	int status;
 	reg = strtoul(cmd, NULL, 16);
 	if ( reg < 18 ) {
-		status = umdkGetRegister(handle, reg, &val, &g_error);
-		CHKERR(status);
-		sprintf(response, "+$%08X#", val);
-		checksum(response + 2);
-		return send(conn, response, 13, 0);
+		if ( session->trace.current >= 0 ) {
+			struct Registers regs;
+			traceFrameRegisters(&session->trace, &regs);
+			val = (&regs.d0)[reg];
+		} else {
+			status = umdkGetRegister(session, reg, &val, &session->error);
+			CHKERR(status);
+		}
+		putLong(response, val);
+		return sendResponse(response, 4, session);
 	} else {
-		return send(conn, VL(RESPONSE_EMPTY), 0);
+		return sendPacket(session, VL(RESPONSE_EMPTY));
 	}
 }
 
-// Process GDB read-all-registers command
-static int cmdReadRegisters(SOCKET conn, struct FLContext *handle) {
-	char response[2+8*18+3];
+// Process GDB read-all-registers command. These usually come from the cache filled at the last stop,
+// or from the trace frame GDB has selected
+static int cmdReadRegisters(struct UmdkSession *session) {
+	uint8 response[4*18];
 	struct Registers regs;
-	int status = umdkRemoteAcquire(handle, &regs, &g_error);
-	CHKERR(status);
-	sprintf(
-		response, "+$%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X%08X#",
-		regs.d0, regs.d1, regs.d2, regs.d3, regs.d4, regs.d5, regs.d6, regs.d7,
-		regs.a0, regs.a1, regs.a2, regs.a3, regs.a4, regs.a5, regs.fp, regs.sp,
-		regs.sr, regs.pc
-	);
-	checksum(response + 2);
-	return send(conn, response, 2+8*18+3, 0);
+	const uint32 *const src = &regs.d0;
+	int i, status = 0;
+	if ( session->trace.current >= 0 ) {
+		traceFrameRegisters(&session->trace, &regs);
+	} else {
+		status = umdkGetRegisters(session, &regs, &session->error);
+		CHKERR(status);
+	}
+	for ( i = 0; i < 18; i++ ) {
+		putLong(response + 4*i, src[i]);
+	}
+	return sendResponse(response, 4*18, session);
 }
 
 void printMessage(const unsigned char *data, int length);
 
-// Process GDB write-memory command
-static int cmdWriteMemory(const char *cmd, SOCKET conn, struct FLContext *handle) {
-	uint32 address, length, numBytes;
-	uint8 ioBuf[SOCKET_BUFFER_SIZE], *binary = ioBuf, byte;
+// Process GDB write-memory command. The data is unescaped and written a chunk at a time; after the
+// first, the chunks start on even addresses so none but the first and last are unaligned.
+static int cmdWriteMemory(const char *cmd, const char *end, struct UmdkSession *session) {
+	uint32 address, length, numBytes, chunkSize;
+	uint8 *binary, byte;
 	int status;
 	const char *binPtr;
 	if ( parseList(cmd, &binPtr, &address, ',', &length, ':', NULL) ) {
 		return -1;
 	}
-	numBytes = length;
-	while ( numBytes-- ) {
-		byte = (uint8)*binPtr++;
-		if ( byte == '}' ) {
-			// An escaped byte follows; unescape it
-			byte = (uint8)(*binPtr++ | 0x20);
-		}
-		*binary++ = byte;
-	}
 	address &= 0x00FFFFFF;
 	//printf("cmdWriteMemory(): %d bytes at 0x%06X:\n", length, address);
-	//printMessage(ioBuf, length);
-	if ( address & 1 || length & 1 ) {
-		printf("Nonaligned write: %du bytes to 0x%08X\n", length, address);
-	} else {
-		status = umdkWriteBytes(handle, address, length, ioBuf, &g_error);
+	chunkSize = IO_CHUNK_SIZE - (address & 1);
+	while ( length ) {
+		if ( chunkSize > length ) {
+			chunkSize = length;
+		}
+		binary = session->ioBuf;
+		numBytes = chunkSize;
+		while ( numBytes-- ) {
+			if ( binPtr >= end ) {
+				return -2;
+			}
+			byte = (uint8)*binPtr++;
+			if ( byte == '}' ) {
+				// An escaped byte follows; unescape it
+				byte = (uint8)(*binPtr++ | 0x20);
+			}
+			*binary++ = byte;
+		}
+		//printMessage(session->ioBuf, chunkSize);
+		status = umdkWriteBytes(session, address, chunkSize, session->ioBuf, &session->error);
 		CHKERR(status);
+		brkOverwritten(&session->breakpoints, address, chunkSize);
+		address += chunkSize;
+		length -= chunkSize;
+		chunkSize = IO_CHUNK_SIZE;
 	}
-	return send(conn, VL(RESPONSE_OK), 0);
+	return sendPacket(session, VL(RESPONSE_OK));
 }
 
-static bool getHexNibble(char hexDigit, uint8 *nibble) {
-	if ( hexDigit >= '0' && hexDigit <= '9' ) {
-		*nibble = (uint8)(hexDigit - '0');
-		return false;
-	} else if ( hexDigit >= 'a' && hexDigit <= 'f' ) {
-		*nibble = (uint8)(hexDigit - 'a' + 10);
-		return false;
-	} else if ( hexDigit >= 'A' && hexDigit <= 'F' ) {
-		*nibble = (uint8)(hexDigit - 'A' + 10);
-		return false;
-	} else {
-		return true;
+// De-hexify a request, up to the given size. A request that isn't valid hex comes out empty.
+static uint32 readRequest(const char *inBuf, uint8 *const outBuf, uint32 outSize) {
+	uint32 numBytes = (uint32)(strlen(inBuf) / 2);
+	if ( numBytes > outSize ) {
+		numBytes = outSize;
 	}
+	return codecHexDecode(outBuf, inBuf, numBytes) ? 0 : numBytes;
 }
 
-static int getHexByte(const char *p, uint8 *byte) {
-	uint8 upperNibble;
-	uint8 lowerNibble;
-	if ( !getHexNibble(p[0], &upperNibble) && !getHexNibble(p[1], &lowerNibble) ) {
-		*byte = (uint8)((upperNibble << 4) | lowerNibble);
-		return 0;
-	} else {
-		return 1;
+// Send text to the GDB console as a series of O packets, in reply to a qRcmd. GDB still expects a
+// final reply after these. The packets are sent together, as far as the writer will take them.
+static int sendConsoleOutput(const char *text, struct UmdkSession *session) {
+	struct PacketWriter *const writer = &session->writer;
+	uint32 numBytes = (uint32)strlen(text), chunkSize;
+	while ( numBytes ) {
+		chunkSize = (SOCKET_BUFFER_SIZE - 6) / 2;
+		if ( chunkSize > numBytes ) {
+			chunkSize = numBytes;
+		}
+		if ( pktSpace(writer) < 2 + 2 * chunkSize && pktFlush(writer, session->conn) < 0 ) {
+			return -1;
+		}
+		pktBegin(writer);
+		pktAppend(writer, "O", 1);
+		pktAppendHex(writer, (const uint8 *)text, chunkSize);
+		pktEnd(writer);
+		text += chunkSize;
+		numBytes -= chunkSize;
 	}
+	return sendPacket(session, VL(RESPONSE_OK));
 }
 
-// De-hexify a request
-static uint32 readRequest(const char *inBuf, uint8 *const outBuf) {
-	uint8 *outPtr = outBuf;
-	while ( *inBuf != '\0' ) {
-		getHexByte(inBuf, outPtr);
-		inBuf += 2;
-		outPtr++;
+// Process GDB read-memory command
+static int cmdReadMemory(const char *cmd, struct UmdkSession *session) {
+	struct PacketWriter *const writer = &session->writer;
+	uint32 address, length, chunkSize;
+	int status;
+	if ( parseList(cmd, NULL, &address, ',', &length, '\0', NULL) ) {
+		return -8;
 	}
-	return (uint32)(outPtr - outBuf);
+	address &= 0x00FFFFFF;
+	if ( length > PKT_MAX_SIZE / 2 ) {
+		length = PKT_MAX_SIZE / 2;  // GDB shouldn't ask for more than fits in a packet
+	}
+
+	// With a trace frame selected, the memory is whatever of it the frame collected
+	if ( session->trace.current >= 0 ) {
+		length = traceFrameMemory(
+			&session->trace, address, (length > IO_CHUNK_SIZE) ? IO_CHUNK_SIZE : length, session->ioBuf);
+		if ( !length ) {
+			return sendPacket(session, VL("E01"));
+		}
+		return sendResponse(session->ioBuf, length, session);
+	}
+
+	// Read a chunk at a time, hexifying straight into the reply
+	pktBegin(writer);
+	while ( length ) {
+		chunkSize = (length > IO_CHUNK_SIZE) ? IO_CHUNK_SIZE : length;
+		status = readMemory(session, address, chunkSize, session->ioBuf);
+		CHKERR(status);
+		pktAppendHex(writer, session->ioBuf, chunkSize);
+		address += chunkSize;
+		length -= chunkSize;
+	}
+	pktEnd(writer);
+	return pktFlush(writer, session->conn);
 }
 
-// Send response, with checksum
-static int sendResponse(const uint8 *bytes, uint32 numBytes, SOCKET conn) {
-	char rspBuf[SOCKET_BUFFER_SIZE];
-	char *textPtr = rspBuf;
-	const uint8 *binPtr = bytes;
-	uint8 checksum, byte;
-	checksum = 0;
-	*textPtr++ = '+';
-	*textPtr++ = '$';
-	while ( numBytes-- ) {
-		byte = *binPtr++;
-		textPtr[0] = hexDigits[byte >> 4];
-		textPtr[1] = hexDigits[byte & 0x0F];
-		checksum = (uint8)(checksum + textPtr[0]);
-		checksum = (uint8)(checksum + textPtr[1]);
-		textPtr += 2;
-	}
-	*textPtr++ = '#';
-	*textPtr++ = hexDigits[checksum >> 4];
-	*textPtr++ = hexDigits[checksum & 0x0F];
-	return send(conn, rspBuf, (unsigned int)(textPtr-rspBuf), 0);
+// Read memory into the packet being built as escaped binary, a chunk at a time. Returns the number
+// of bytes appended, which may be fewer than asked for if escaping made them too big for the packet.
+static uint32 appendMemoryBinary(struct UmdkSession *session, uint32 address, uint32 length) {
+	uint32 chunkSize, numAppended, total = 0;
+	int status;
+	while ( length ) {
+		chunkSize = (length > IO_CHUNK_SIZE) ? IO_CHUNK_SIZE : length;
+		status = readMemory(session, address, chunkSize, session->ioBuf);
+		CHKERR(status);
+		numAppended = pktAppendBinary(&session->writer, session->ioBuf, chunkSize);
+		total += numAppended;
+		if ( numAppended < chunkSize ) {
+			break;
+		}
+		address += chunkSize;
+		length -= chunkSize;
+	}
+	return total;
 }
 
-// Process GDB read-memory command
-static int cmdReadMemory(const char *cmd, SOCKET conn, struct FLContext *handle) {
+// Process GDB binary read-memory command. The reply is the data prefixed with 'b', so it can't be
+// mistaken for an error reply. GDB copes with getting fewer bytes than it asked for.
+static int cmdReadMemoryBinary(const char *cmd, struct UmdkSession *session) {
+	struct PacketWriter *const writer = &session->writer;
 	uint32 address, length;
-	uint8 binBuf[SOCKET_BUFFER_SIZE];
-	int status;
 	if ( parseList(cmd, NULL, &address, ',', &length, '\0', NULL) ) {
 		return -8;
 	}
 	address &= 0x00FFFFFF;
-	status = umdkReadBytes(handle, address, length, binBuf, &g_error);
-	CHKERR(status);
-	return sendResponse(binBuf, length, conn);
+	if ( length > PKT_MAX_SIZE ) {
+		length = PKT_MAX_SIZE;
+	}
+	if ( session->trace.current >= 0 ) {
+		// A trace frame is selected, so the memory is whatever of it the frame collected
+		length = traceFrameMemory(
+			&session->trace, address, (length > IO_CHUNK_SIZE) ? IO_CHUNK_SIZE : length, session->ioBuf);
+		if ( !length ) {
+			return sendPacket(session, VL("E01"));
+		}
+		pktBegin(writer);
+		pktAppend(writer, "b", 1);
+		pktAppendBinary(writer, session->ioBuf, length);
+		pktEnd(writer);
+		return pktFlush(writer, session->conn);
+	}
+	pktBegin(writer);
+	pktAppend(writer, "b", 1);
+	appendMemoryBinary(session, address, length);
+	pktEnd(writer);
+	return pktFlush(writer, session->conn);
 }
 
-// Process GDB create-breakpoint command
-static int cmdCreateBreakpoint(const char *cmd, SOCKET conn, struct FLContext *handle) {
-	uint32 type, addr, kind;
-	int i, status;
-	if ( parseList(cmd, NULL, &type, ',', &addr, ',', &kind, '\0', NULL) ) {
+// Regions readable in bulk with qXfer:umdk-memory:read:<annex>:<offset>,<length>. The empty annex
+// is the whole 68000 address space.
+static const struct XferRegion {
+	const char *annex;
+	uint32 base;
+	uint32 size;
+} xferRegions[] = {
+	{"",     0x000000, 0x1000000},
+	{"cart", 0x000000, 0x400000},
+	{"wram", 0xFF0000, 0x10000},
+	{NULL,   0x000000, 0x000000}
+};
+
+// Process GDB qXfer read of the umdk-memory object. The reply is prefixed with 'l' if it reaches the
+// end of the region, or 'm' if there is more to come.
+static int cmdXferMemory(const char *cmd, struct UmdkSession *session) {
+	struct PacketWriter *const writer = &session->writer;
+	const struct XferRegion *region;
+	const char *const colon = strchr(cmd, ':');
+	uint32 offset, length, numAppended;
+	if ( !colon ) {
+		return -8;
+	}
+	for ( region = xferRegions; region->annex; region++ ) {
+		if ( strlen(region->annex) == (size_t)(colon - cmd) && !strncmp(cmd, region->annex, (size_t)(colon - cmd)) ) {
+			break;
+		}
+	}
+	if ( !region->annex ) {
+		return sendPacket(session, VL("E00"));
+	}
+	if ( parseList(colon + 1, NULL, &offset, ',', &length, '\0', NULL) ) {
+		return -8;
+	}
+	if ( offset >= region->size ) {
+		return sendPacket(session, VL("l"));
+	}
+	if ( length > region->size - offset ) {
+		length = region->size - offset;
+	}
+	if ( length > PKT_MAX_SIZE ) {
+		length = PKT_MAX_SIZE;
+	}
+	pktBegin(writer);
+	pktAppend(writer, "m", 1);
+	numAppended = appendMemoryBinary(session, region->base + offset, length);
+	if ( offset + numAppended == region->size ) {
+		// It all fitted, and that's the end: so make that an 'l', keeping the checksum right
+		writer->buf[writer->start + 1] = 'l';
+		writer->sum = (uint8)(writer->sum + 'l' - 'm');
+	}
+	pktEnd(writer);
+	return pktFlush(writer, session->conn);
+}
+
+// Parse an agent expression "<len>,<bytecode>" into the given buffer, returning its length, or zero
+// if it's malformed or longer than maxLength. The end pointer is left after the bytecode.
+static uint32 parseExpression(const char *cmd, char **end, uint8 *buf, uint32 maxLength) {
+	const uint32 length = strtoul(cmd, end, 16);
+	if ( **end != ',' || length == 0 || length > maxLength || strlen(*end + 1) < 2 * length ) {
+		return 0;
+	}
+	if ( codecHexDecode(buf, *end + 1, length) ) {
+		return 0;
+	}
+	*end += 1 + 2 * length;
+	return length;
+}
+
+// Process GDB create-breakpoint command. The breakpoint only goes into memory when the MD next runs
+static int cmdCreateBreakpoint(const char *cmd, struct UmdkSession *session) {
+	uint32 type, addr, length, condLength = 0;
+	uint8 *const cond = session->ioBuf;
+	char *end;
+	if ( parseList(cmd, &cmd, &type, ',', &addr, ',', NULL) ) {
 		return -1;
 	}
 	if ( type != 0 ) {
 		return -2;
 	}
+	addr &= 0x00FFFFFF;
+	strtoul(cmd, &end, 16);  // kind
 
-	// Make sure there isn't already a breakpoint at this address
-	for ( i = 0; i < NUM_BRKPOINTS; i++ ) {
-		if ( breakpoints[i].addr == addr ) {
-			return -3;
+	// Gather the conditions, each an agent expression ";X<len>,<bytecode>", into one list of
+	// length-prefixed expressions. Any commands after them are for GDB to run.
+	while ( end[0] == ';' && end[1] == 'X' ) {
+		if ( condLength + 2 >= IO_CHUNK_SIZE ) {
+			return -5;
+		}
+		length = parseExpression(
+			end + 2, &end, cond + condLength + 2, IO_CHUNK_SIZE - condLength - 2);
+		if ( !length ) {
+			return -5;
 		}
+		cond[condLength++] = (uint8)(length >> 8);
+		cond[condLength++] = (uint8)length;
+		condLength += length;
 	}
-
-	// Find a free slot
-	i = 0;
-	while ( i < NUM_BRKPOINTS && breakpoints[i].addr ) {
-		i++;
+	if ( brkInsert(&session->breakpoints, addr) ) {
+		return -4;
 	}
-	if ( i == NUM_BRKPOINTS ) {
+	if ( brkSetCondition(&session->breakpoints, addr, cond, condLength) ) {
 		return -4;
 	}
-
-	// Insert the breakpoint into the free slot:
-	breakpoints[i].addr = addr;
-	status = umdkReadWord(handle, addr, &breakpoints[i].save, &g_error);
-	CHKERR(status);
-	status = umdkWriteWord(handle, addr, ILLEGAL, &g_error);
-	CHKERR(status);
-	return send(conn, VL(RESPONSE_OK), 0);
+	return sendPacket(session, VL(RESPONSE_OK));
 }
 
-// Process GDB delete-breakpoint command
-static int cmdDeleteBreakpoint(const char *cmd, SOCKET conn, struct FLContext *handle) {
+// Process GDB delete-breakpoint command. The opcode only goes back when the MD next runs
+static int cmdDeleteBreakpoint(const char *cmd, struct UmdkSession *session) {
 	uint32 type, addr, kind;
-	int i, status;
 	if ( parseList(cmd, NULL, &type, ',', &addr, ',', &kind, '\0', NULL) ) {
 		return -1;
 	}
 	if ( type != 0 ) {
 		return -2;
 	}
+	if ( !brkRemove(&session->breakpoints, addr & 0x00FFFFFF) ) {
+		return -3;
+	}
+	return sendPacket(session, VL(RESPONSE_OK));
+}
+
+// Induce a suspend at the next vblank, by temporarily replacing the first opcode of the vertical
+// interrupt routine with an illegal instruction
+static void suspendAtVBlank(struct UmdkSession *session, struct Registers *regs) {
+	uint32 vbAddr;
+	uint16 oldOp;
+	int status;
+
+	// Read address of VDP vertical interrupt vector & read 1st opcode
+	status = umdkDirectReadLong(session, VB_VEC, &vbAddr, &session->error);
+	CHKERR(status);
+	status = umdkDirectReadWord(session, vbAddr, &oldOp, &session->error);
+	CHKERR(status);
+	//printf("vbAddr = 0x%06X, opCode = 0x%04X\n", vbAddr, oldOp);
+	
+	// Replace illegal instruction vector
+	status = umdkDirectWriteLong(session, IL_VEC, MONITOR, &session->error);
+	CHKERR(status);
+	
+	// Write illegal instruction opcode
+	status = umdkDirectWriteWord(session, vbAddr, ILLEGAL, &session->error);
+	CHKERR(status);
+	
+	// Acquire the monitor
+	status = umdkRemoteAcquire(session, regs, &session->error);
+	CHKERR(status);
+	
+	// Restore old opcode to vbAddr
+	status = umdkDirectWriteWord(session, vbAddr, oldOp, &session->error);
+	CHKERR(status);
+}
+
+// Process GDB execute-step command
+static int cmdStep(struct UmdkSession *session) {
+	struct Registers regs;
+	int status;
+	if ( session->nonStop && acceptResume(session) < 0 ) {
+		return -1;
+	}
+	status = brkCommit(session, &session->error);
+	CHKERR(status);
+	status = brkStep(session, &regs, &session->error);
+	CHKERR(status);
+	if ( status == ACQ_TIMEOUT ) {
+		// Probably stepping supervisor-mode code, so the MD is off running; bring it back
+		suspendAtVBlank(session, &regs);
+	}
+	return reportStop(session, &regs);
+}
+
+// Stop a range-step early if the PC lands on a breakpoint or tracepoint, or GDB sends an interrupt
+static bool isRangeStop(struct UmdkSession *session, const struct Registers *regs) {
+	return brkIsInserted(&session->breakpoints, regs->pc) || isInterrupted(session);
+}
 
-	// Find the breakpoint
-	for ( i = 0; i < NUM_BRKPOINTS; i++ ) {
-		if ( breakpoints[i].addr == addr ) {
-			status = umdkWriteWord(handle, addr, breakpoints[i].save, &g_error);
+// Process GDB range-step action: keep stepping until the PC leaves [start, end), and report just
+// the one stop at the end. Breakpoints and tracepoints in the range are dealt with as they are by
+// cmdContinue()
+static int cmdStepRange(uint32 start, uint32 end, struct UmdkSession *session) {
+	struct BreakTable *const table = &session->breakpoints;
+	struct Registers regs;
+	int status;
+	if ( session->nonStop && acceptResume(session) < 0 ) {
+		return -1;
+	}
+	start &= 0x00FFFFFF;
+	end &= 0x00FFFFFF;
+	status = brkCommit(session, &session->error);
+	CHKERR(status);
+	status = brkStep(session, &regs, &session->error);
+	CHKERR(status);
+	while ( status == 0 && regs.pc >= start && regs.pc < end ) {
+		if ( !brkIsInserted(table, regs.pc) ) {
+			status = umdkStepRange(session, start, end, isRangeStop, &regs, &session->error);
 			CHKERR(status);
-			breakpoints[i].addr = 0x00000000;
-			return send(conn, VL(RESPONSE_OK), 0);
+			if ( status || regs.pc < start || regs.pc >= end || !brkIsInserted(table, regs.pc) ) {
+				break;  // out of the range, or interrupted
+			}
+		}
+		status = traceHit(session, &regs, &session->error);
+		CHKERR(status);
+		if ( status || brkShouldStop(session, &regs) ) {
+			break;
 		}
+		status = brkStepOver(session, &regs, &session->error);
+		CHKERR(status);
+	}
+	if ( status == ACQ_TIMEOUT ) {
+		suspendAtVBlank(session, &regs);
 	}
-	return -3;
+	return reportStop(session, &regs);
 }
 
-// Process GDB execute-step command
-static int cmdStep(SOCKET conn, struct FLContext *handle) {
+// Process GDB execute-continue command
+static int cmdContinue(struct UmdkSession *session) {
 	struct Registers regs;
-	int status = umdkStep(handle, &regs, &g_error);
+	int status;
+
+	if ( acceptResume(session) < 0 ) {
+		return -1;
+	}
+	status = brkCommit(session, &session->error);
 	CHKERR(status);
-	return send(conn, VL(RESPONSE_SIG), 0);
+	status = umdkContWait(session, &regs, &session->error);
+	CHKERR(status);
+
+	// Collect a frame at each tracepoint hit, and resume silently from tracepoints and from
+	// breakpoints whose condition is false, or which are still being ignored
+	while ( status == 0 ) {
+		status = traceHit(session, &regs, &session->error);
+		CHKERR(status);
+		if ( status || brkShouldStop(session, &regs) ) {
+			break;
+		}
+		status = brkStepOver(session, &regs, &session->error);
+		CHKERR(status);
+		if ( status == 0 ) {
+			status = umdkContWait(session, &regs, &session->error);
+			CHKERR(status);
+		} else if ( status == ACQ_TIMEOUT ) {
+			suspendAtVBlank(session, &regs);
+		}
+	}
+	return reportStop(session, &regs);
 }
 
-// Process GDB execute-continue command
-static int cmdContinue(SOCKET conn, struct FLContext *handle) {
+// Process GDB tracepoint-definition command. The first packet for a tracepoint creates it:
+//   QTDP:<n>:<addr>:<E|D>:<step>:<pass>[:X<len>,<condition>][-]
+// and any more add actions to it:
+//   QTDP:-<n>:<addr>:<actions>[-]
+// where the actions are R<mask> (registers, which are always collected anyway), M<reg>,<offset>,<len>
+// (memory, at an offset from a register, or from zero if the register is -1) and X<len>,<bytecode>
+// (memory named by an expression's trace bytecodes). The while-stepping actions (prefixed with S)
+// are accepted, but nothing is collected for them.
+static int cmdDefineTracepoint(const char *cmd, struct UmdkSession *session) {
+	struct TraceState *const trace = &session->trace;
+	const bool isAction = (*cmd == '-');
+	uint32 number, addr, step, pass, length, offset;
+	int32 basereg;
+	bool enabled;
+	char *end;
+	number = strtoul(cmd + isAction, &end, 16);
+	if ( *end != ':' ) {
+		return sendPacket(session, VL("E01"));
+	}
+	addr = strtoul(end + 1, &end, 16) & 0x00FFFFFF;
+	if ( *end != ':' ) {
+		return sendPacket(session, VL("E01"));
+	}
+	end++;
+	if ( !isAction ) {
+		if ( (*end != 'E' && *end != 'D') || end[1] != ':' ) {
+			return sendPacket(session, VL("E01"));
+		}
+		enabled = (*end == 'E');
+		step = strtoul(end + 2, &end, 16);
+		if ( *end != ':' ) {
+			return sendPacket(session, VL("E01"));
+		}
+		pass = strtoul(end + 1, &end, 16);
+		if ( traceCreate(trace, number, addr, enabled, step, pass) ) {
+			return sendPacket(session, VL("E02"));
+		}
+		while ( *end == ':' ) {
+			if ( end[1] != 'X' ) {
+				return sendPacket(session, VL("E01"));  // fast tracepoints and the like
+			}
+			length = parseExpression(end + 2, &end, session->ioBuf, IO_CHUNK_SIZE);
+			if ( !length ) {
+				return sendPacket(session, VL("E01"));
+			}
+			if ( traceSetCondition(trace, number, addr, session->ioBuf, length) ) {
+				return sendPacket(session, VL("E02"));
+			}
+		}
+		return sendPacket(session, VL(RESPONSE_OK));
+	}
+	if ( *end == 'S' ) {
+		return sendPacket(session, VL(RESPONSE_OK));
+	}
+	while ( *end && *end != '-' ) {
+		switch ( *end ) {
+		case 'R':
+			strtoul(end + 1, &end, 16);
+			break;
+		case 'M':
+			basereg = (int32)strtol(end + 1, &end, 16);
+			if ( *end != ',' ) {
+				return sendPacket(session, VL("E01"));
+			}
+			offset = strtoul(end + 1, &end, 16);
+			if ( *end != ',' ) {
+				return sendPacket(session, VL("E01"));
+			}
+			length = strtoul(end + 1, &end, 16);
+			if ( length > TRACE_BUFFER_SIZE || traceAddRange(trace, number, addr, basereg, offset, length) ) {
+				return sendPacket(session, VL("E02"));
+			}
+			break;
+		case 'X':
+			length = parseExpression(end + 1, &end, session->ioBuf, IO_CHUNK_SIZE);
+			if ( !length ) {
+				return sendPacket(session, VL("E01"));
+			}
+			if ( traceAddExpression(trace, number, addr, session->ioBuf, length) ) {
+				return sendPacket(session, VL("E02"));
+			}
+			break;
+		default:
+			return sendPacket(session, VL("E01"));
+		}
+	}
+	return sendPacket(session, VL(RESPONSE_OK));
+}
+
+// Process GDB select-trace-frame command, replying with the frame found and the tracepoint which
+// collected it, or F-1 if there is no such frame
+static int cmdSelectFrame(const char *cmd, struct UmdkSession *session) {
+	TraceFind how = TRACE_FIND_NUMBER;
+	uint32 a, b = 0;
+	int32 frame;
+	char response[24];
+	if ( strncmp(cmd, "pc:", 3) == 0 ) {
+		how = TRACE_FIND_PC;
+		cmd += 3;
+	} else if ( strncmp(cmd, "tdp:", 4) == 0 ) {
+		how = TRACE_FIND_TRACEPOINT;
+		cmd += 4;
+	} else if ( strncmp(cmd, "range:", 6) == 0 ) {
+		how = TRACE_FIND_RANGE;
+		cmd += 6;
+	} else if ( strncmp(cmd, "outside:", 8) == 0 ) {
+		how = TRACE_FIND_OUTSIDE;
+		cmd += 8;
+	}
+	if ( how == TRACE_FIND_RANGE || how == TRACE_FIND_OUTSIDE ) {
+		if ( parseList(cmd, NULL, &a, ':', &b, '\0', NULL) ) {
+			return -1;
+		}
+		a &= 0x00FFFFFF;
+		b &= 0x00FFFFFF;
+	} else {
+		a = strtoul(cmd, NULL, 16);
+		if ( how == TRACE_FIND_PC ) {
+			a &= 0x00FFFFFF;
+		}
+	}
+	frame = traceFindFrame(&session->trace, how, a, b);
+	if ( frame < 0 ) {
+		return sendPacket(session, VL("F-1"));
+	}
+	sprintf(response, "F%XT%X", (uint32)frame, traceFrameTracepoint(&session->trace));
+	return sendPacket(session, response, (uint32)strlen(response));
+}
+
+// Process GDB tracepoint-upload queries: qTfP asks for the first tracepoint, and qTsP for each of
+// the rest, until we reply 'l'
+static int cmdListTracepoint(bool first, struct UmdkSession *session) {
+	struct TraceState *const trace = &session->trace;
+	const struct Tracepoint *tp;
+	char response[64];
+	if ( first ) {
+		trace->cursor = 0;
+	}
+	if ( trace->cursor >= trace->numPoints ) {
+		return sendPacket(session, VL("l"));
+	}
+	tp = trace->points + trace->cursor++;
+	sprintf(response, "T%X:%08X:%c:%X:%X", tp->number, tp->addr, tp->enabled ? 'E' : 'D', tp->step, tp->pass);
+	return sendPacket(session, response, (uint32)strlen(response));
+}
+
+// Process GDB tracepoint-status query "qTP:<n>:<addr>", replying with the tracepoint's hits and the
+// bytes its frames took
+static int cmdTracepointStatus(const char *cmd, struct UmdkSession *session) {
+	struct TraceState *const trace = &session->trace;
+	uint32 number, addr, i;
+	char response[32];
+	if ( parseList(cmd, NULL, &number, ':', &addr, '\0', NULL) ) {
+		return -1;
+	}
+	addr &= 0x00FFFFFF;
+	for ( i = 0; i < trace->numPoints; i++ ) {
+		if ( trace->points[i].number == number && trace->points[i].addr == addr ) {
+			sprintf(response, "V%X:%X", trace->points[i].hits, trace->used);
+			return sendPacket(session, response, (uint32)strlen(response));
+		}
+	}
+	return sendPacket(session, VL("E01"));
+}
+
+// Process the tracing packets starting with 'Q'
+static int cmdTraceControl(const char *cmd, struct UmdkSession *session) {
+	int status;
+	if ( strcmp(cmd, "init") == 0 ) {
+		traceStop(session, "tstop");
+		traceReset(&session->trace);
+	} else if ( strncmp(cmd, "DP:", 3) == 0 ) {
+		return cmdDefineTracepoint(cmd + 3, session);
+	} else if ( strcmp(cmd, "Start") == 0 ) {
+		status = traceStart(session, &session->error);
+		CHKERR(status);
+		if ( status ) {
+			return sendPacket(session, VL("E01"));
+		}
+	} else if ( strcmp(cmd, "Stop") == 0 ) {
+		traceStop(session, "tstop");
+	} else if ( strncmp(cmd, "Frame:", 6) == 0 ) {
+		return cmdSelectFrame(cmd + 6, session);
+	} else if (
+		strncmp(cmd, "DV:", 3) && strncmp(cmd, "ro:", 3) && strncmp(cmd, "Disconnected:", 13) &&
+		strncmp(cmd, "Buffer:", 7) && strncmp(cmd, "Notes:", 6) && strncmp(cmd, "DPsrc:", 6) )
+	{
+		return sendPacket(session, VL(RESPONSE_EMPTY));
+	}
+	// Trace state variables, read-only sections, disconnected tracing, buffer options and notes are
+	// accepted, but make no difference
+	return sendPacket(session, VL(RESPONSE_OK));
+}
+
+// Process the tracing queries, which all start with "qT"
+static int cmdTraceQuery(const char *cmd, struct UmdkSession *session) {
+	char response[160];
+	if ( strcmp(cmd, "Status") == 0 ) {
+		const uint32 length = traceFormatStatus(&session->trace, response, sizeof(response));
+		return sendPacket(session, response, length);
+	} else if ( strcmp(cmd, "fP") == 0 || strcmp(cmd, "sP") == 0 ) {
+		return cmdListTracepoint(*cmd == 'f', session);
+	} else if ( strncmp(cmd, "P:", 2) == 0 ) {
+		return cmdTracepointStatus(cmd + 2, session);
+	} else if ( strcmp(cmd, "fV") == 0 || strcmp(cmd, "sV") == 0 ) {
+		return sendPacket(session, VL("l"));  // no trace state variables
+	}
+	return sendPacket(session, VL(RESPONSE_EMPTY));
+}
+
+// Process GDB halt-reason query: the MD is always stopped when GDB asks
+static int cmdHaltReason(struct UmdkSession *session) {
 	struct Registers regs;
-	int status = umdkContWait(handle, &regs, &g_error);
+	int status = umdkGetRegisters(session, &regs, &session->error);
 	CHKERR(status);
-	return send(conn, VL(RESPONSE_SIG), 0);
+	return sendStopReply(session, &regs);
+}
+
+// Process GDB vCont command. There's only one thread, so the first action is the one that applies,
+// and thread-ids are ignored; so are the signals passed with C and S.
+static int cmdVCont(const char *cmd, struct UmdkSession *session) {
+	uint32 start, end;
+	char *ptr;
+	switch ( *cmd ) {
+	case 'c':
+	case 'C':
+		return cmdContinue(session);
+	case 's':
+	case 'S':
+		return cmdStep(session);
+	case 'r':
+		start = strtoul(cmd+1, &ptr, 16);
+		if ( *ptr != ',' ) {
+			return -1;
+		}
+		end = strtoul(ptr+1, NULL, 16);
+		return cmdStepRange(start, end, session);
+	case 't':
+		return sendPacket(session, VL(RESPONSE_OK));  // already stopped
+	default:
+		return sendPacket(session, VL(RESPONSE_EMPTY));
+	}
+}
+
+// Tell GDB what we can do: in particular, take big packets, so memory transfers aren't chopped up
+// into lots of round-trips
+static int cmdSupported(struct UmdkSession *session) {
+	char response[160];
+	sprintf(response, "PacketSize=%X;QStartNoAckMode+;binary-upload+;qXfer:umdk-memory:read+;ConditionalBreakpoints+;ConditionalTracepoints+", PKT_MAX_SIZE);
+	return sendPacket(session, response, (uint32)strlen(response));
 }
 
 // Process GDB monitor command
-static int cmdMonitorCommand(const char *buf, SOCKET conn, struct FLContext *handle) {
+static int cmdMonitorCommand(const char *buf, struct UmdkSession *session) {
 	char reqBuf[SOCKET_BUFFER_SIZE];
 	char rspBuf[SOCKET_BUFFER_SIZE];
-	uint32 numBytes = readRequest(buf, (uint8*)reqBuf);
+	uint32 numBytes = readRequest(buf, (uint8*)reqBuf, SOCKET_BUFFER_SIZE - 1);
 	reqBuf[numBytes] = '\0';
 	if ( !strncmp(reqBuf, "rd ", 3) ) {
 		const char *const fileName = reqBuf+3;
-		int status = umdkDumpRAM(handle, fileName, &g_error);
+		int status = umdkDumpRAM(session, fileName, &session->error);
 		CHKERR(status);
 		snprintf(rspBuf, SOCKET_BUFFER_SIZE, "OK, WRAM snapshot saved to %s\n", fileName);
 	} else if ( !strncmp(reqBuf, "tr ", 3) ) {
 		const char *const fileName = reqBuf+3;
-		if ( umdkOpenTrace(fileName) ) {
+		if ( umdkOpenTrace(session, fileName) ) {
 			snprintf(rspBuf, SOCKET_BUFFER_SIZE, "Unable to open %s for writing!\n", fileName);
 		} else {
 			snprintf(rspBuf, SOCKET_BUFFER_SIZE, "OK, a trace of the next execution operation will be saved to %s\n", fileName);
 		}
+	} else if ( !strncmp(reqBuf, "ignore ", 7) ) {
+		uint32 addr, count;
+		if ( sscanf(reqBuf+7, "%x %u", &addr, &count) == 2 && brkSetIgnoreCount(&session->breakpoints, addr & 0x00FFFFFF, count) ) {
+			snprintf(rspBuf, SOCKET_BUFFER_SIZE, "OK, the next %u hits of the breakpoint at 0x%06X will be ignored\n", count, addr);
+		} else {
+			snprintf(rspBuf, SOCKET_BUFFER_SIZE, "Usage: ignore <hex address of breakpoint> <count>\n");
+		}
+	} else if ( !strcmp(reqBuf, "bank") ) {
+		char bankBuf[SSF2_NUM_BANKS * 48];
+		uint32 bank, page, offset = 0;
+		for ( bank = 0; bank < SSF2_NUM_BANKS; bank++ ) {
+			offset += (uint32)(umdkGetBankPage(session, bank, &page) ?
+				snprintf(bankBuf + offset, sizeof(bankBuf) - offset, "Bank %2u (0x%06X): page %u\n", bank, bank * SSF2_BANK_SIZE, page) :
+				snprintf(bankBuf + offset, sizeof(bankBuf) - offset, "Bank %2u (0x%06X): unknown\n", bank, bank * SSF2_BANK_SIZE));
+		}
+		return sendConsoleOutput(bankBuf, session);
+	} else if ( !strncmp(reqBuf, "bank ", 5) ) {
+		uint32 bank, page;
+		char what[4];
+		if ( sscanf(reqBuf+5, "%u %3s", &bank, what) != 2 || bank >= SSF2_NUM_BANKS || bank % 8 == 0 ) {
+			snprintf(rspBuf, SOCKET_BUFFER_SIZE, "Usage: bank <1-7 or 9-15> <page 0-31, or ? if unknown>\n");
+		} else if ( !strcmp(what, "?") ) {
+			umdkForgetBank(session, bank);
+					snprintf(rspBuf, SOCKET_BUFFER_SIZE, "OK, bank %u will only be accessed through the monitor\n", bank);
+		} else if ( sscanf(what, "%u", &page) == 1 && page < SSF2_NUM_PAGES ) {
+			umdkSetBankPage(session, bank, page);
+					snprintf(rspBuf, SOCKET_BUFFER_SIZE, "OK, bank %u is mapped to SDRAM page %u, and only changed by the host\n", bank, page);
+		} else {
+			snprintf(rspBuf, SOCKET_BUFFER_SIZE, "Usage: bank <1-7 or 9-15> <page 0-31, or ? if unknown>\n");
+		}
+	} else if ( !strcmp(reqBuf, "mirror") ) {
+		char mirrorBuf[4096];
+		const struct Mirror *const mirror = &session->mirror;
+		uint32 i, offset;
+		offset = (uint32)snprintf(mirrorBuf, sizeof(mirrorBuf), "%u reads served from the mirror\n", mirror->hits);
+		for ( i = 0; i < mirror->numImages && offset < sizeof(mirrorBuf); i++ ) {
+			const struct MirrorImage *const image = mirror->images + i;
+			offset += (uint32)snprintf(
+				mirrorBuf + offset, sizeof(mirrorBuf) - offset, "SDRAM 0x%06X-0x%06X: %u of %u pages changed\n",
+				image->physAddr, image->physAddr + image->length - 1, mirrorCountStale(image),
+				(image->length + MIRROR_PAGE_SIZE - 1) / MIRROR_PAGE_SIZE);
+		}
+		return sendConsoleOutput(mirrorBuf, session);
+	} else if ( !strcmp(reqBuf, "mirror off") ) {
+		umdkDropMirror(session);
+		snprintf(rspBuf, SOCKET_BUFFER_SIZE, "OK, all reads will go to the board\n");
+	} else if ( !strcmp(reqBuf, "stats") ) {
+		char statsBuf[8192];
+		statsFormat(&session->stats, statsBuf, sizeof(statsBuf));
+		return sendConsoleOutput(statsBuf, session);
+	} else if ( !strcmp(reqBuf, "stats reset") ) {
+		statsReset(&session->stats);
+		snprintf(rspBuf, SOCKET_BUFFER_SIZE, "OK, transport statistics reset\n");
 	} else {
 		snprintf(rspBuf, SOCKET_BUFFER_SIZE, "Unrecognised command: %s\n", reqBuf);
 	}
-	return sendResponse((const uint8 *)rspBuf, (uint32)strlen(rspBuf), conn);
+	return sendResponse((const uint8 *)rspBuf, (uint32)strlen(rspBuf), session);
+}
+
+// Process a GDB message which arrived while the MD runs in non-stop mode. Memory in the direct
+// regions is served as usual, since it can be read and written without suspending the MD; a stop
+// request sets stop, to bring the MD back; anything else has to wait until it has stopped.
+static int processRunningMessage(const char *buf, const char *end, struct UmdkSession *session, bool *stop) {
+	uint32 address, length;
+	const char cmd = *buf++;
+	switch ( cmd ) {
+	case 'm':
+	case 'x':
+	case 'X':
+		if ( parseList(buf, NULL, &address, ',', &length, (cmd == 'X') ? ':' : '\0', NULL) ) {
+			return -8;
+		}
+		if ( !umdkIsDirect(session, address & 0x00FFFFFF, length) ) {
+			return sendPacket(session, VL("E01"));
+		}
+		return
+			(cmd == 'm') ? cmdReadMemory(buf, session) :
+			(cmd == 'x') ? cmdReadMemoryBinary(buf, session) :
+			cmdWriteMemory(buf, end, session);
+	case 'v':
+		if ( strcmp(buf, "Cont;t") == 0 || strncmp(buf, "Cont;t:", 7) == 0 ) {
+			session->stopRequested = true;
+			*stop = true;
+			return sendPacket(session, VL(RESPONSE_OK));
+		} else if ( strcmp(buf, "Cont?") == 0 ) {
+			return sendPacket(session, VL("vCont;c;C;s;S;t;r"));
+		}
+		break;
+	case '?':
+		return sendPacket(session, VL(RESPONSE_OK));  // no thread is stopped
+	case 'q':
+		if ( strcmp(buf, "TStatus") == 0 ) {
+			return cmdTraceQuery(buf+1, session);
+		}
+		return sendPacket(session, VL(RESPONSE_EMPTY));
+	case 'Q':
+	case 'H':
+		return sendPacket(session, VL(RESPONSE_EMPTY));
+	}
+	return sendPacket(session, VL("E01"));
+}
+
+// Serve GDB between polls while the MD runs in non-stop mode. Whole packets are processed as they
+// arrive; the one that set the MD running is finished with, so its buffer is reused. Returns true
+// if GDB asked for the MD to be stopped, or has gone away.
+static bool serveWhileRunning(struct UmdkSession *session) {
+	char *const buffer = session->message;
+	uint32 length;
+	bool stop = false, more = true;
+	if ( pktFill(&session->reader, session->conn, false) < 0 ) {
+		return true;
+	}
+	while ( more ) {
+		switch ( pktNext(&session->reader, buffer, sizeof(session->message), &length) ) {
+		case PKT_NONE:
+			more = false;
+			break;
+		case PKT_MESSAGE:
+			if ( !session->noAck ) {
+				pktAck(&session->writer, true);
+			}
+			if ( processRunningMessage(buffer, buffer + length, session, &stop) < 0 ) {
+				printf("Message did not process correctly!\n");
+			}
+			break;
+		case PKT_INTERRUPT:
+			stop = true;
+			break;
+		default:
+			if ( !session->noAck ) {
+				pktAck(&session->writer, false);
+			}
+			break;
+		}
+	}
+	if ( session->writer.length && pktFlush(&session->writer, session->conn) < 0 ) {
+		return true;
+	}
+	return stop;
 }
 
 // External interface: process incoming GDB RSP message
-int processMessage(const char *buf, int size, SOCKET conn, struct FLContext *handle) {
-	int returnCode = 0;
+int processMessage(const char *buf, int size, struct UmdkSession *session) {
 	const char *const end = buf + size;
-	char ch = *buf;
-	int status;
+	int returnCode = 0;
 	struct Registers regs;
-	while ( buf < end && (ch == '$' || ch == '+' || ch == 0x03) ) {
-		uint32 vbAddr;
-		uint16 oldOp;
-		if ( ch == 0x03 ) {
-			//printf("GDB gave the interrupt signal!\n");
-			
-			// Read address of VDP vertical interrupt vector & read 1st opcode
-			status = umdkDirectReadLong(handle, VB_VEC, &vbAddr, &g_error);
-			CHKERR(status);
-			status = umdkDirectReadWord(handle, vbAddr, &oldOp, &g_error);
-			CHKERR(status);
-			//printf("vbAddr = 0x%06X, opCode = 0x%04X\n", vbAddr, oldOp);
-			
-			// Replace illegal instruction vector
-			status = umdkDirectWriteLong(handle, IL_VEC, MONITOR, &g_error);
-			CHKERR(status);
-			
-			// Write illegal instruction opcode
-			status = umdkDirectWriteWord(handle, vbAddr, ILLEGAL, &g_error);
-			CHKERR(status);
-			
-			// Acquire the monitor
-			status = umdkRemoteAcquire(handle, &regs, &g_error);
-			CHKERR(status);
-			
-			// Restore old opcode to vbAddr
-			status = umdkDirectWriteWord(handle, vbAddr, oldOp, &g_error);
-			CHKERR(status);
-		}
-		ch = *++buf;
-	}
-	if ( buf == end ) {
+	if ( size <= 0 ) {
 		return -1;
 	}
 	switch ( *buf++ ) {
+	// Interrupt, delivered by the packet reader as a one-byte message:
+	case 0x03:
+		//printf("GDB gave the interrupt signal!\n");
+		suspendAtVBlank(session, &regs);
+		returnCode = sendStopReply(session, &regs);
+		break;
+
 	// Memory read/write:
 	case 'X':
-		returnCode = cmdWriteMemory(buf, conn, handle);
+		returnCode = cmdWriteMemory(buf, end, session);
 		break;
 	case 'm':
-		returnCode = cmdReadMemory(buf, conn, handle);
+		returnCode = cmdReadMemory(buf, session);
+		break;
+	case 'x':
+		returnCode = cmdReadMemoryBinary(buf, session);
 		break;
 	// Register read/write:
 	case 'g':
-		returnCode = cmdReadRegisters(conn, handle);
+		returnCode = cmdReadRegisters(session);
 		break;
 	case 'p':
-		returnCode = cmdReadRegister(buf, conn, handle);
+		returnCode = cmdReadRegister(buf, session);
 		break;
 	case 'P':
-		returnCode = cmdWriteRegister(buf, conn, handle);
+		returnCode = cmdWriteRegister(buf, session);
 		break;
 
 	// Execution:
 	case 's':
-		returnCode = cmdStep(conn, handle);
+		returnCode = cmdStep(session);
 		break;
 	case 'c':
-		returnCode = cmdContinue(conn, handle);
+		returnCode = cmdContinue(session);
+		break;
+	case 'v':
+		if ( strcmp(buf, "Cont?") == 0 ) {
+			returnCode = sendPacket(session, VL("vCont;c;C;s;S;t;r"));
+		} else if ( strncmp(buf, "Cont;", 5) == 0 ) {
+			returnCode = cmdVCont(buf+5, session);
+		} else if ( strcmp(buf, "Stopped") == 0 ) {
+			returnCode = sendPacket(session, VL(RESPONSE_OK));  // the one stop was in the notification
+		} else {
+			returnCode = sendPacket(session, VL(RESPONSE_EMPTY));
+		}
 		break;
 
 	// Breakpoints:
 	case 'Z':
-		returnCode = cmdCreateBreakpoint(buf, conn, handle);
+		returnCode = cmdCreateBreakpoint(buf, session);
 		break;
 	case 'z':
-		returnCode = cmdDeleteBreakpoint(buf, conn, handle);
+		returnCode = cmdDeleteBreakpoint(buf, session);
 		break;
 
 	// Status:
 	case '?':
-		returnCode = send(conn, VL(RESPONSE_SIG), 0);
+		returnCode = cmdHaltReason(session);
 		break;
 
-	// General monitor command
+	// Feature negotiation, general monitor command & tracing
 	case 'q':
-		if ( strncmp(buf, "Rcmd,", 5) == 0 ) {
-			returnCode = cmdMonitorCommand(buf+5, conn, handle);
+		if ( strncmp(buf, "Supported", 9) == 0 ) {
+			returnCode = cmdSupported(session);
+		} else if ( strncmp(buf, "Xfer:umdk-memory:read:", 22) == 0 ) {
+			returnCode = cmdXferMemory(buf+22, session);
+		} else if ( strncmp(buf, "Rcmd,", 5) == 0 ) {
+			returnCode = cmdMonitorCommand(buf+5, session);
+		} else if ( *buf == 'T' ) {
+			returnCode = cmdTraceQuery(buf+1, session);
+		} else {
+			returnCode = sendPacket(session, VL(RESPONSE_EMPTY));
+		}
+		break;
+
+	// Stop acking packets, once the OK for this one has gone (with its ack), & tracing:
+	case 'Q':
+		if ( strcmp(buf, "StartNoAckMode") == 0 ) {
+			returnCode = sendPacket(session, VL(RESPONSE_OK));
+			session->noAck = true;
+		} else if ( strncmp(buf, "NonStop:", 8) == 0 ) {
+			session->nonStop = (buf[8] == '1');
+			session->whileRunning = session->nonStop ? serveWhileRunning : NULL;
+			returnCode = sendPacket(session, VL(RESPONSE_OK));
+		} else if ( *buf == 'T' ) {
+			returnCode = cmdTraceControl(buf+1, session);
 		} else {
-			returnCode = send(conn, VL(RESPONSE_EMPTY), 0);
+			returnCode = sendPacket(session, VL(RESPONSE_EMPTY));
 		}
 		break;
 
 	// Everything else not supported:
 	default:
-		returnCode = send(conn, VL(RESPONSE_EMPTY), 0);
+		returnCode = sendPacket(session, VL(RESPONSE_EMPTY));
 	}
 	if ( returnCode < 0 ) {
 		printf("Message did not process correctly!\n");
@@ -4,7 +4,7 @@
 #include "sock.h"
 
 #define SOCKET_BUFFER_SIZE 1024
-struct FLContext;
-int processMessage(const char *buf, int size, SOCKET conn, struct FLContext *handle);
+struct UmdkSession;
+int processMessage(const char *buf, int size, struct UmdkSession *session);
 
 #endif
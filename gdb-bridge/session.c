@@ -0,0 +1,67 @@
+#include <stdlib.h>
+#include <libfpgalink.h>
+#include <liberror.h>
+#include "session.h"
+
+// Open a session on the board at the given VID:PID, and check its monitor speaks the same protocol
+// as the bridge. The session starts with no breakpoints, no trace and zeroed statistics; it's up to
+// the caller to attach a connection.
+//
+int umdkOpenSession(const char *vp, struct UmdkSession **session, const char **error) {
+	int retVal = 0, uStatus;
+	FLStatus fStatus;
+	uint16 protocol;
+	struct UmdkSession *newSession = (struct UmdkSession *)calloc(1, sizeof(struct UmdkSession));
+	CHECK_STATUS(!newSession, 1, cleanup, "umdkOpenSession(): Memory allocation error!");
+
+	// Four polls in flight, back off after 16 misses, at most 8ms between polls, give up on a step
+	// after 1s
+	newSession->acqConfig.depth = 4;
+	newSession->acqConfig.spinPolls = 16;
+	newSession->acqConfig.maxSleep = 8;
+	newSession->acqConfig.stepTimeout = 1000;
+	newSession->trace.current = -1;
+
+	// Only banks 0 and 8 are known to start with: they have no register, so they're always at their
+	// reset pages. The others are wherever the menu or the game last put them, which the host can't
+	// see, so they're accessed through the monitor until their pages are learnt (see
+	// umdkSetBankPage()). Nothing is pinned: the MD may write to any bank.
+	newSession->bankPages[MONITOR / SSF2_BANK_SIZE] = SSF2_NUM_PAGES - 1;
+	newSession->banksKnown = (uint16)(1U | (1U << (MONITOR / SSF2_BANK_SIZE)));
+
+	fStatus = flOpen(vp, &newSession->handle, error);
+	CHECK_STATUS(fStatus, 2, cleanup);
+	fStatus = flSelectConduit(newSession->handle, 0x01, error);
+	CHECK_STATUS(fStatus, 3, cleanup);
+
+	// A monitor assembled for another protocol would misread the command block, so refuse to talk
+	// to it
+	uStatus = umdkDirectReadWord(newSession, CB_VERSION, &protocol, error);
+	CHECK_STATUS(uStatus, 4, cleanup);
+	CHECK_STATUS(
+		protocol != MON_PROTOCOL, 5, cleanup,
+		"umdkOpenSession(): Monitor protocol is %u, but the bridge needs %u; reflash the monitor!",
+		protocol, MON_PROTOCOL);
+	*session = newSession;
+	newSession = NULL;
+cleanup:
+	umdkCloseSession(newSession);
+	return retVal;
+}
+
+// Close the board and release everything the session owns.
+//
+void umdkCloseSession(struct UmdkSession *session) {
+	if ( session ) {
+		if ( session->traceFile ) {
+			fclose(session->traceFile);
+		}
+		if ( session->handle ) {
+			flClose(session->handle);
+		}
+		brkDestroy(&session->breakpoints);
+		traceDestroy(&session->trace);
+		mirrorDestroy(&session->mirror);
+		free(session);
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdio.h>
+#include <makestuff.h>
+#include "sock.h"
+#include "mem.h"
+#include "stats.h"
+#include "packet.h"
+#include "break.h"
+#include "trace.h"
+#include "cache.h"
+#include "mirror.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// Memory reads and writes for GDB are split into chunks of this size: one monitor buffer's worth
+	#define IO_CHUNK_SIZE CB_MEM_SIZE
+
+	// Everything the bridge knows about one board: the FPGALink connection to it, the state of the
+	// debug session running on it, and the GDB connection driving it. Nothing here is shared, so
+	// one process can serve several boards, each from its own thread.
+	struct UmdkSession {
+		struct FLContext *handle;
+		FILE *traceFile;
+		struct AcquireConfig acqConfig;
+		struct Stats stats;
+		struct BreakTable breakpoints;
+		struct TraceState trace;
+		struct Registers regCache;           // the registers saved at the last stop, with any edits
+		bool regsValid;                      // the MD is stopped, and regCache holds its registers
+		uint32 regsDirty;                    // bit N set: register N was edited but not written back
+		uint8 bankPages[SSF2_NUM_BANKS];     // the SDRAM page each cartridge bank is mapped to
+		uint16 banksKnown;                   // bit N set: bankPages[N] is known to be right
+		uint16 banksPinned;                  // bit N set: bank N was declared, so may stay cached
+		const char *error;
+		SOCKET conn;
+		bool noAck;                          // GDB asked for QStartNoAckMode
+		bool nonStop;                        // GDB asked for QNonStop:1
+		bool stopRequested;                  // GDB asked for the running MD to be stopped
+		bool (*whileRunning)(struct UmdkSession *session);  // serves GDB in umdkContWait(), or NULL
+		struct PageCache cache;              // copies of memory GDB has read
+		struct Mirror mirror;                // copies of the images the host uploaded
+		struct PacketReader reader;
+		struct PacketWriter writer;
+		char message[PKT_MAX_SIZE + 1];      // the packet being processed
+		uint8 ioBuf[IO_CHUNK_SIZE];          // one chunk of a memory read or write
+	};
+
+	int umdkOpenSession(
+		const char *vp, struct UmdkSession **session, const char **error
+	) WARN_UNUSED_RESULT;
+
+	void umdkCloseSession(struct UmdkSession *session);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,725 @@
+// Simulated FPGALink backend for the UMDKv2. This implements the subset of the libfpgalink API used
+// by gdb-bridge, against an in-memory model of the FPGA design in vhdl/umdkv2_rtl.vhdl:
+//   channel 0 - SDRAM command/response pipe (mem_pipe) in front of 16MiB of SDRAM
+//   channel 1 - reg1 (bit 0: hold MD in reset, bit 1: enable tracing)
+//   channel 2 - trace FIFO data, as a stream of 7-byte records
+//   channel 3 - trcValid & "00" & tfDepth(12 downto 8)
+//   channel 4 - tfDepth(7 downto 0)
+//
+// It also models just enough of the 68000 monitor (monitor/monitor.s) to service commands issued
+// through the command block at 0x400400, so the umdk*() functions work end-to-end without a board.
+// The MD side of the model maps the cartridge space through the SSF2 bank registers exactly as
+// mem_arbiter.vhdl does, and has its own 64KiB of WRAM.
+//
+// Each operation is applied to the model at the moment it is issued, which matches the strictly
+// in-order behaviour of the real FPGALink/FX2 pipeline. A configurable latency is charged whenever
+// the host has to block waiting for the device, so pipelined transfers are cheaper than serial
+// ones in the same proportion as they are on real hardware.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+#include <makestuff.h>
+#include <libfpgalink.h>
+#include <liberror.h>
+#include "../mem.h"
+#include "sim.h"
+
+#define SDRAM_SIZE  0x1000000
+#define WRAM_SIZE   0x10000
+#define TRACE_REC   7
+#define TRACE_MAX   (8191*TRACE_REC)  // tfDepth is 13 bits wide
+#define XFER_SIZE   0x10000           // async writes are sent to the FX2 in chunks of this size
+#define MON_PHYS    0xF80000          // the monitor lives in the top 512KiB page of SDRAM
+#define PHYS(x)     ((x) - MONITOR + MON_PHYS)
+
+// A read which has been submitted, but not yet awaited
+struct AsyncRead {
+	uint8 *data;
+	uint32 count;
+	bool owned;
+	uint64 readyTime;
+};
+
+// A simple byte FIFO, used for the mem_pipe response data and the trace FIFO
+struct ByteFifo {
+	uint8 *data;
+	uint32 head;
+	uint32 length;
+	uint32 capacity;
+};
+
+struct FLContext {
+	// The SDRAM, its logical->physical mapping and the MD's own RAM
+	uint8 *sdram;
+	uint8 wram[WRAM_SIZE];
+	uint8 bank[16];
+
+	// Channel 0: the mem_pipe command decoder
+	uint8 cmdBuf[4];
+	uint32 cmdLength;
+	uint32 wordAddr;
+	uint32 writeWords;
+	uint8 writeByte;
+	bool haveByte;
+	struct ByteFifo rsp;
+
+	// Channels 1-4: host config register and trace FIFO
+	uint8 reg1;
+	struct ByteFifo trace;
+	uint32 traceSeq;
+
+	// The monitor model
+	bool monitor;
+	bool running;
+	uint32 runLength;
+	uint32 pollsLeft;
+
+	// The transport model
+	uint32 latency;
+	uint32 pendingOut;
+	bool unconfirmed;
+	struct AsyncRead *queue;
+	uint32 queueHead;
+	uint32 queueLength;
+	uint32 queueCapacity;
+	uint8 *lastData;
+	struct SimStats stats;
+};
+
+// *************************************************************************************************
+// **                                      Timing & accounting                                    **
+// *************************************************************************************************
+
+static uint64 nowUsec(void) {
+	#ifdef WIN32
+		LARGE_INTEGER freq, count;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&count);
+		return (uint64)(count.QuadPart * 1000000 / freq.QuadPart);
+	#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64)ts.tv_sec * 1000000 + (uint64)ts.tv_nsec / 1000;
+	#endif
+}
+
+static void sleepUntil(uint64 when) {
+	uint64 now = nowUsec();
+	if ( when > now ) {
+		#ifdef WIN32
+			Sleep((DWORD)((when - now + 999) / 1000));
+		#else
+			struct timespec ts;
+			const uint64 delta = when - now;
+			ts.tv_sec = (time_t)(delta / 1000000);
+			ts.tv_nsec = (long)(delta % 1000000) * 1000;
+			nanosleep(&ts, NULL);
+		#endif
+	}
+}
+
+// Send any queued-up async writes to the device
+static void flushWrites(struct FLContext *handle) {
+	if ( handle->pendingOut ) {
+		handle->stats.writeTransfers += (handle->pendingOut + XFER_SIZE - 1) / XFER_SIZE;
+		handle->pendingOut = 0;
+		handle->unconfirmed = true;
+	}
+}
+
+// The host blocks for one full USB round trip
+static void roundTrip(struct FLContext *handle) {
+	handle->stats.roundTrips++;
+	handle->unconfirmed = false;
+	sleepUntil(nowUsec() + handle->latency);
+}
+
+// *************************************************************************************************
+// **                                          Byte FIFOs                                         **
+// *************************************************************************************************
+
+static bool fifoPush(struct ByteFifo *fifo, const uint8 *data, uint32 count) {
+	if ( fifo->head + fifo->length + count > fifo->capacity ) {
+		if ( fifo->head ) {
+			memmove(fifo->data, fifo->data + fifo->head, fifo->length);
+			fifo->head = 0;
+		}
+		if ( fifo->length + count > fifo->capacity ) {
+			uint32 newCapacity = fifo->capacity ? fifo->capacity : 1024;
+			uint8 *newData;
+			while ( newCapacity < fifo->length + count ) {
+				newCapacity *= 2;
+			}
+			newData = (uint8*)realloc(fifo->data, newCapacity);
+			if ( !newData ) {
+				return false;
+			}
+			fifo->data = newData;
+			fifo->capacity = newCapacity;
+		}
+	}
+	memcpy(fifo->data + fifo->head + fifo->length, data, count);
+	fifo->length += count;
+	return true;
+}
+
+static void fifoPop(struct ByteFifo *fifo, uint8 *data, uint32 count) {
+	memcpy(data, fifo->data + fifo->head, count);
+	fifo->head += count;
+	fifo->length -= count;
+	if ( !fifo->length ) {
+		fifo->head = 0;
+	}
+}
+
+// *************************************************************************************************
+// **                                The MD address-space & monitor                               **
+// *************************************************************************************************
+
+static uint16 getWord(const uint8 *p) {
+	return (uint16)((p[0] << 8) | p[1]);
+}
+
+static uint32 getLong(const uint8 *p) {
+	return ((uint32)getWord(p) << 16) | getWord(p + 2);
+}
+
+static void putWord(uint8 *p, uint16 value) {
+	p[0] = (uint8)(value >> 8);
+	p[1] = (uint8)value;
+}
+
+static void putLong(uint8 *p, uint32 value) {
+	putWord(p, (uint16)(value >> 16));
+	putWord(p + 2, (uint16)value);
+}
+
+// Map an MD logical address to the byte backing it, or NULL if it's not backed by anything
+static uint8 *mdByte(struct FLContext *handle, uint32 address) {
+	address &= 0xFFFFFF;
+	if ( address < 0x800000 ) {
+		return handle->sdram + (((uint32)handle->bank[address >> 19] << 19) | (address & 0x7FFFF));
+	} else if ( address >= 0xE00000 ) {
+		return handle->wram + (address & 0xFFFF);
+	}
+	return NULL;
+}
+
+static uint8 mdRead(struct FLContext *handle, uint32 address) {
+	const uint8 *const p = mdByte(handle, address);
+	return p ? *p : 0xFF;
+}
+
+static void mdWrite(struct FLContext *handle, uint32 address, uint8 value) {
+	uint8 *const p = mdByte(handle, address);
+	address &= 0xFFFFFF;
+	if ( p ) {
+		*p = value;
+	} else if ( (address & 0xFFFFF1) == 0xA130F1 && address != 0xA130F1 ) {
+		// SSF2 bank register: bit 6 of the data selects the upper eight slots
+		handle->bank[((value >> 3) & 0x08) | ((address >> 1) & 0x07)] = value & 0x1F;
+	}
+}
+
+// The monitor has finished whatever it was doing, and is ready for another command
+static void monitorReady(struct FLContext *handle) {
+	handle->running = false;
+	handle->pollsLeft = 0;
+	putWord(handle->sdram + PHYS(CB_FLAG), CF_READY);
+}
+
+// The MD has been released to run user code. If the illegal-instruction (or trace) vector points at
+// the monitor, it will be back after a while; otherwise it will never return.
+static void monitorRun(struct FLContext *handle, uint32 vector) {
+	uint32 target = 0;
+	uint32 i;
+	for ( i = 0; i < 4; i++ ) {
+		target = (target << 8) | mdRead(handle, vector + i);
+	}
+	handle->running = true;
+	handle->pollsLeft = (target == MONITOR) ? handle->runLength + 1 : 0;
+	putWord(handle->sdram + PHYS(CB_FLAG), CF_RUNNING);
+}
+
+// Execute the command the host has just left in the command block
+static void monitorCommand(struct FLContext *handle) {
+	uint8 *const cb = handle->sdram + PHYS(CB_FLAG);
+	const uint16 command = getWord(cb + CB_INDEX - CB_FLAG);
+	const uint32 address = getLong(cb + CB_ADDR - CB_FLAG);
+	const uint32 length = getLong(cb + CB_LEN - CB_FLAG);
+	uint8 *const pcSave = cb + CB_REGS - CB_FLAG + 4*PC;
+	uint8 *const mem = cb + ((command & CMD_BUF2) ? CB_MEM2 : CB_MEM) - CB_FLAG;
+	uint32 i;
+	switch ( command & 0x07 ) {
+	case CMD_STEP:
+		// Every opcode is taken to be one word long, except ILLEGAL, which traps back to the monitor
+		// without moving the PC
+		i = getLong(pcSave);
+		if ( ((mdRead(handle, i) << 8) | mdRead(handle, i + 1)) == ILLEGAL ) {
+			monitorRun(handle, IL_VEC);
+		} else {
+			monitorRun(handle, TR_VEC);
+			i += 2;
+		}
+		if ( handle->pollsLeft ) {
+			putLong(pcSave, i);
+			monitorReady(handle);
+		}
+		break;
+	case CMD_CONT:
+		monitorRun(handle, IL_VEC);
+		break;
+	case CMD_READ:
+		for ( i = 0; i < length && mem + i < handle->sdram + SDRAM_SIZE; i++ ) {
+			mem[i] = mdRead(handle, address + i);
+		}
+		monitorReady(handle);
+		break;
+	case CMD_WRITE:
+		for ( i = 0; i < length && mem + i < handle->sdram + SDRAM_SIZE; i++ ) {
+			mdWrite(handle, address + i, mem[i]);
+		}
+		monitorReady(handle);
+		break;
+	case CMD_RESET:
+		handle->running = true;
+		handle->pollsLeft = 0;
+		putWord(cb, CF_RUNNING);
+		break;
+	default:
+		monitorReady(handle);
+	}
+}
+
+// *************************************************************************************************
+// **                                       The FPGA channels                                     **
+// *************************************************************************************************
+
+// Channel 0 writes: decode the mem_pipe command stream
+static void memPipeWrite(struct FLContext *handle, const uint8 *data, size_t count) {
+	while ( count-- ) {
+		const uint8 byte = *data++;
+		if ( handle->writeWords ) {
+			// Data phase of a 0x80 write command
+			if ( handle->haveByte ) {
+				const uint32 byteAddr = 2 * handle->wordAddr;
+				handle->sdram[byteAddr] = handle->writeByte;
+				handle->sdram[byteAddr + 1] = byte;
+				handle->haveByte = false;
+				handle->wordAddr = (handle->wordAddr + 1) & (SDRAM_SIZE/2 - 1);
+				handle->writeWords--;
+				if ( handle->monitor && byteAddr == PHYS(CB_FLAG) && getWord(handle->sdram + byteAddr) == CF_CMD ) {
+					monitorCommand(handle);
+				}
+			} else {
+				handle->writeByte = byte;
+				handle->haveByte = true;
+			}
+		} else {
+			// Command phase: one opcode byte then a 24-bit big-endian parameter
+			handle->cmdBuf[handle->cmdLength++] = byte;
+			if ( handle->cmdLength == 4 ) {
+				const uint32 param =
+					((uint32)handle->cmdBuf[1] << 16) | ((uint32)handle->cmdBuf[2] << 8) | handle->cmdBuf[3];
+				handle->cmdLength = 0;
+				switch ( handle->cmdBuf[0] & 0xC0 ) {
+				case 0x00:
+					handle->wordAddr = param & (SDRAM_SIZE/2 - 1);
+					break;
+				case 0x40: {
+					uint32 i;
+					for ( i = 0; i < param; i++ ) {
+						const uint32 byteAddr = 2 * handle->wordAddr;
+						if ( handle->running && handle->pollsLeft && byteAddr == PHYS(CB_FLAG) ) {
+							// The host is polling the command flag while the MD runs
+							if ( --handle->pollsLeft == 0 ) {
+								monitorReady(handle);
+							}
+						}
+						fifoPush(&handle->rsp, handle->sdram + byteAddr, 2);
+						handle->wordAddr = (handle->wordAddr + 1) & (SDRAM_SIZE/2 - 1);
+					}
+					break;
+				}
+				case 0x80:
+					handle->writeWords = param;
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	}
+}
+
+// Generate synthetic 56-bit trace records, as the MD would while running with tracing enabled. The
+// host is draining the FIFO as fast as it fills, so there is no need to honour TRACE_MAX here.
+static void traceGenerate(struct FLContext *handle, uint32 count) {
+	uint8 rec[TRACE_REC];
+	while ( handle->trace.length < count ) {
+		const uint32 seq = handle->traceSeq++;
+		rec[0] = 0x00;
+		rec[1] = (uint8)(seq >> 8);
+		rec[2] = (uint8)seq;
+		rec[3] = 0x00;
+		rec[4] = (uint8)(seq >> 7);
+		rec[5] = (uint8)(seq << 1);
+		rec[6] = 0x4E;
+		fifoPush(&handle->trace, rec, TRACE_REC);
+	}
+}
+
+// Channel 3/4 value: the 56->8 converter holds the partially-consumed head record, and tfDepth
+// counts the complete records still in the FIFO behind it.
+static uint8 traceStatus(const struct FLContext *handle, uint8 chan) {
+	const uint32 total = handle->trace.length;
+	const uint32 inConv = total ? ((total - 1) % TRACE_REC) + 1 : 0;
+	uint32 depth = (total - inConv) / TRACE_REC;
+	if ( depth > TRACE_MAX/TRACE_REC ) {
+		depth = TRACE_MAX/TRACE_REC;
+	}
+	if ( chan == 3 ) {
+		return (uint8)((total ? 0x80 : 0x00) | ((depth >> 8) & 0x1F));
+	} else {
+		return (uint8)depth;
+	}
+}
+
+// Apply a host write to the model
+static FLStatus channelWrite(
+	struct FLContext *handle, uint8 chan, size_t count, const uint8 *data, const char **error)
+{
+	FLStatus retVal = FL_SUCCESS;
+	switch ( chan ) {
+	case 0:
+		memPipeWrite(handle, data, count);
+		break;
+	case 1:
+		if ( count ) {
+			handle->reg1 = data[count-1] & 0x03;
+			if ( handle->reg1 & 0x01 ) {
+				handle->running = false;
+				handle->pollsLeft = 0;
+			}
+		}
+		break;
+	default:
+		CHECK_STATUS(
+			true, FL_PROTOCOL_ERR, cleanup,
+			"channelWrite(): Channel %d does not accept writes; the host would block forever!", chan);
+	}
+	handle->stats.bytesOut += count;
+	handle->pendingOut += (uint32)count;
+cleanup:
+	return retVal;
+}
+
+// Apply a host read to the model
+static FLStatus channelRead(
+	struct FLContext *handle, uint8 chan, uint32 count, uint8 *data, const char **error)
+{
+	FLStatus retVal = FL_SUCCESS;
+	switch ( chan ) {
+	case 0:
+		CHECK_STATUS(
+			handle->rsp.length < count, FL_PROTOCOL_ERR, cleanup,
+			"channelRead(): Read of %u bytes from channel 0 with only %u available; the host would block forever!",
+			count, handle->rsp.length);
+		fifoPop(&handle->rsp, data, count);
+		break;
+	case 1:
+		memset(data, handle->reg1, count);
+		break;
+	case 2:
+		if ( (handle->reg1 & 0x03) == 0x02 ) {
+			// The 68000 is out of reset, so it's executing something even when it's just spinning in
+			// the monitor's command loop, and every bus cycle is traced.
+			traceGenerate(handle, count);
+		}
+		CHECK_STATUS(
+			handle->trace.length < count, FL_PROTOCOL_ERR, cleanup,
+			"channelRead(): Read of %u bytes from trace FIFO with only %u available; the host would block forever!",
+			count, handle->trace.length);
+		fifoPop(&handle->trace, data, count);
+		break;
+	case 3:
+	case 4:
+		memset(data, traceStatus(handle, chan), count);
+		break;
+	default:
+		memset(data, 0x00, count);
+	}
+	handle->stats.bytesIn += count;
+	handle->stats.readTransfers++;
+cleanup:
+	return retVal;
+}
+
+// *************************************************************************************************
+// **                                    The libfpgalink API                                      **
+// *************************************************************************************************
+
+FLStatus flInitialise(int logLevel, const char **error) {
+	(void)logLevel;
+	(void)error;
+	return FL_SUCCESS;
+}
+
+void flFreeError(const char *err) {
+	errFree(err);
+}
+
+FLStatus flOpen(const char *vp, struct FLContext **handle, const char **error) {
+	FLStatus retVal = FL_SUCCESS;
+	struct FLContext *newHandle = (struct FLContext *)calloc(1, sizeof(struct FLContext));
+	uint8 i;
+	(void)vp;
+	CHECK_STATUS(!newHandle, FL_ALLOC_ERR, cleanup, "flOpen(): Allocation error!");
+	newHandle->sdram = (uint8*)calloc(1, SDRAM_SIZE);
+	CHECK_STATUS(!newHandle->sdram, FL_ALLOC_ERR, cleanup, "flOpen(): Allocation error!");
+
+	// Power-on mapping, as BANK_INIT in mem_arbiter.vhdl: slot 8 is the monitor page
+	for ( i = 0; i < 16; i++ ) {
+		newHandle->bank[i] = i;
+	}
+	newHandle->bank[8] = 31;
+
+	// Start with the MD already suspended at the monitor
+	newHandle->monitor = true;
+	newHandle->runLength = 16;
+	putWord(newHandle->sdram + PHYS(CB_VERSION), MON_PROTOCOL);
+	putWord(newHandle->sdram + PHYS(CB_FLAG), CF_READY);
+	*handle = newHandle;
+	newHandle = NULL;
+cleanup:
+	if ( newHandle ) {
+		free(newHandle->sdram);
+		free(newHandle);
+	}
+	return retVal;
+}
+
+void flClose(struct FLContext *handle) {
+	if ( handle ) {
+		while ( handle->queueLength ) {
+			struct AsyncRead *const rd = &handle->queue[handle->queueHead];
+			if ( rd->owned ) {
+				free(rd->data);
+			}
+			handle->queueHead = (handle->queueHead + 1) % handle->queueCapacity;
+			handle->queueLength--;
+		}
+		free(handle->queue);
+		free(handle->lastData);
+		free(handle->rsp.data);
+		free(handle->trace.data);
+		free(handle->sdram);
+		free(handle);
+	}
+}
+
+FLStatus flSelectConduit(struct FLContext *handle, uint8 conduit, const char **error) {
+	(void)handle;
+	(void)conduit;
+	(void)error;
+	return FL_SUCCESS;
+}
+
+FLStatus flWriteChannelAsync(
+	struct FLContext *handle, uint8 chan, size_t count, const uint8 *data, const char **error)
+{
+	return channelWrite(handle, chan, count, data, error);
+}
+
+FLStatus flFlushAsyncWrites(struct FLContext *handle, const char **error) {
+	(void)error;
+	flushWrites(handle);
+	return FL_SUCCESS;
+}
+
+FLStatus flAwaitAsyncWrites(struct FLContext *handle, const char **error) {
+	(void)error;
+	flushWrites(handle);
+	if ( handle->unconfirmed ) {
+		roundTrip(handle);
+	}
+	return FL_SUCCESS;
+}
+
+FLStatus flWriteChannel(
+	struct FLContext *handle, uint8 chan, size_t count, const uint8 *data, const char **error)
+{
+	FLStatus retVal = channelWrite(handle, chan, count, data, error);
+	CHECK_STATUS(retVal, retVal, cleanup);
+	flushWrites(handle);
+	roundTrip(handle);
+cleanup:
+	return retVal;
+}
+
+FLStatus flReadChannel(
+	struct FLContext *handle, uint8 chan, size_t count, uint8 *buf, const char **error)
+{
+	FLStatus retVal = FL_SUCCESS;
+	CHECK_STATUS(
+		handle->queueLength, FL_BAD_STATE, cleanup,
+		"flReadChannel(): Synchronous read issued with %u async reads outstanding!", handle->queueLength);
+	flushWrites(handle);
+	retVal = channelRead(handle, chan, (uint32)count, buf, error);
+	CHECK_STATUS(retVal, retVal, cleanup);
+	roundTrip(handle);
+cleanup:
+	return retVal;
+}
+
+FLStatus flReadChannelAsyncSubmit(
+	struct FLContext *handle, uint8 chan, uint32 count, uint8 *buffer, const char **error)
+{
+	FLStatus retVal = FL_SUCCESS;
+	struct AsyncRead *rd;
+	CHECK_STATUS(
+		count > 0x10000, FL_PROTOCOL_ERR, cleanup,
+		"flReadChannelAsyncSubmit(): Async reads are limited to 64KiB!");
+	if ( handle->queueLength == handle->queueCapacity ) {
+		const uint32 newCapacity = handle->queueCapacity ? 2 * handle->queueCapacity : 16;
+		struct AsyncRead *const newQueue =
+			(struct AsyncRead *)malloc(newCapacity * sizeof(struct AsyncRead));
+		uint32 i;
+		CHECK_STATUS(!newQueue, FL_ALLOC_ERR, cleanup, "flReadChannelAsyncSubmit(): Allocation error!");
+		for ( i = 0; i < handle->queueLength; i++ ) {
+			newQueue[i] = handle->queue[(handle->queueHead + i) % handle->queueCapacity];
+		}
+		free(handle->queue);
+		handle->queue = newQueue;
+		handle->queueHead = 0;
+		handle->queueCapacity = newCapacity;
+	}
+	rd = &handle->queue[(handle->queueHead + handle->queueLength) % handle->queueCapacity];
+	rd->owned = (buffer == NULL);
+	rd->data = buffer ? buffer : (uint8*)malloc(count ? count : 1);
+	CHECK_STATUS(!rd->data, FL_ALLOC_ERR, cleanup, "flReadChannelAsyncSubmit(): Allocation error!");
+	rd->count = count;
+	flushWrites(handle);
+	retVal = channelRead(handle, chan, count, rd->data, error);
+	if ( retVal ) {
+		if ( rd->owned ) {
+			free(rd->data);
+		}
+		FAIL(retVal, cleanup);
+	}
+	rd->readyTime = nowUsec() + handle->latency;
+	handle->queueLength++;
+cleanup:
+	return retVal;
+}
+
+FLStatus flReadChannelAsyncAwait(
+	struct FLContext *handle, const uint8 **recvData, uint32 *requestLength, uint32 *actualLength,
+	const char **error)
+{
+	FLStatus retVal = FL_SUCCESS;
+	struct AsyncRead *rd;
+	CHECK_STATUS(
+		!handle->queueLength, FL_BAD_STATE, cleanup,
+		"flReadChannelAsyncAwait(): No async reads outstanding!");
+	rd = &handle->queue[handle->queueHead];
+	handle->queueHead = (handle->queueHead + 1) % handle->queueCapacity;
+	handle->queueLength--;
+	if ( nowUsec() < rd->readyTime ) {
+		handle->stats.roundTrips++;
+		handle->unconfirmed = false;
+		sleepUntil(rd->readyTime);
+	}
+	free(handle->lastData);
+	handle->lastData = rd->owned ? rd->data : NULL;
+	*recvData = rd->data;
+	*requestLength = rd->count;
+	*actualLength = rd->count;
+cleanup:
+	return retVal;
+}
+
+uint8 *flLoadFile(const char *name, size_t *numBytes) {
+	uint8 *buffer = NULL;
+	long length;
+	FILE *file = fopen(name, "rb");
+	if ( !file ) {
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if ( length >= 0 ) {
+		buffer = (uint8*)malloc((size_t)length + 1);
+		if ( buffer && fread(buffer, 1, (size_t)length, file) != (size_t)length ) {
+			free(buffer);
+			buffer = NULL;
+		}
+		if ( buffer && numBytes ) {
+			*numBytes = (size_t)length;
+		}
+	}
+	fclose(file);
+	return buffer;
+}
+
+void flFreeFile(uint8 *buffer) {
+	free(buffer);
+}
+
+void flSleep(uint32 ms) {
+	sleepUntil(nowUsec() + 1000 * (uint64)ms);
+}
+
+// *************************************************************************************************
+// **                                   Simulator-only interface                                  **
+// *************************************************************************************************
+
+// Set the time the host spends blocked on each USB round trip.
+//
+void simSetLatency(struct FLContext *handle, uint32 usec) {
+	handle->latency = usec;
+}
+
+// Set how many times the host may poll the command flag after a continue, before the simulated MD
+// hits a breakpoint and re-enters the monitor.
+//
+void simSetRunLength(struct FLContext *handle, uint32 numPolls) {
+	handle->runLength = numPolls;
+}
+
+// Enable or disable the monitor model. With it disabled, the command block is just memory.
+//
+void simSetMonitor(struct FLContext *handle, bool enabled) {
+	handle->monitor = enabled;
+}
+
+void simGetStats(struct FLContext *handle, struct SimStats *stats) {
+	*stats = handle->stats;
+}
+
+void simResetStats(struct FLContext *handle) {
+	memset(&handle->stats, 0, sizeof(struct SimStats));
+}
+
+// Read from the simulated MD address-space, as the 68000 would see it.
+//
+void simPeek(struct FLContext *handle, uint32 address, uint32 count, uint8 *data) {
+	while ( count-- ) {
+		*data++ = mdRead(handle, address++);
+	}
+}
+
+// Write to the simulated MD address-space, as the 68000 would see it.
+//
+void simPoke(struct FLContext *handle, uint32 address, uint32 count, const uint8 *data) {
+	while ( count-- ) {
+		mdWrite(handle, address++, *data++);
+	}
+}
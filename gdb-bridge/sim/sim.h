@@ -0,0 +1,45 @@
+#ifndef SIM_H
+#define SIM_H
+
+#include <libfpgalink.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// Transport statistics gathered by the simulator. A "round trip" is any point at which the host
+	// has to block waiting for the device (a synchronous read or write, or an await on an async read
+	// which has not yet completed). Pipelined async reads which are submitted together share a
+	// single round trip.
+	struct SimStats {
+		uint32 roundTrips;
+		uint32 writeTransfers;
+		uint32 readTransfers;
+		uint64 bytesOut;
+		uint64 bytesIn;
+	};
+
+	// ---------------------------------------------------------------------------------------------
+	// Simulator configuration
+	//
+	void simSetLatency(struct FLContext *handle, uint32 usec);
+	void simSetRunLength(struct FLContext *handle, uint32 numPolls);
+	void simSetMonitor(struct FLContext *handle, bool enabled);
+
+	// ---------------------------------------------------------------------------------------------
+	// Statistics
+	//
+	void simGetStats(struct FLContext *handle, struct SimStats *stats);
+	void simResetStats(struct FLContext *handle);
+
+	// ---------------------------------------------------------------------------------------------
+	// Backdoor access to the simulated MegaDrive address-space (does not touch the stats)
+	//
+	void simPeek(struct FLContext *handle, uint32 address, uint32 count, uint8 *data);
+	void simPoke(struct FLContext *handle, uint32 address, uint32 count, const uint8 *data);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+	#include <windows.h>
+	#define snprintf _snprintf
+#else
+	#include <time.h>
+#endif
+#include "stats.h"
+
+static const char *const opNames[] = {
+	"umdkDirectWriteFile",
+	"umdkPhysicalWriteBytes",
+	"umdkDirectWriteBytes",
+	"umdkDirectReadBytes",
+	"umdkDirectReadBytesAsync",
+	"umdkWriteBytes",
+	"umdkReadBytes",
+	"umdkWriteV",
+	"umdkReadV",
+	"umdkSetRegister",
+	"umdkGetRegister",
+	"umdkGetRegisters",
+	"umdkAcquire",
+	"umdkExecuteCommand",
+	"umdkReset",
+	"umdkContinue",
+	"umdkStep",
+	"umdkStepRange",
+	"umdkDumpRAM",
+	"umdkContWait"
+};
+
+static uint64 nowUsec(void) {
+	#ifdef WIN32
+		LARGE_INTEGER freq, count;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&count);
+		return (uint64)(count.QuadPart * 1000000 / freq.QuadPart);
+	#else
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return (uint64)ts.tv_sec * 1000000 + (uint64)ts.tv_nsec / 1000;
+	#endif
+}
+
+// Start timing a call to an entry point. Entry points call one another, so the figures are
+// inclusive: the transfers made by a nested call count towards both the callee and the caller.
+//
+struct StatsFrame statsEnter(struct Stats *stats, StatsOp op) {
+	struct StatsFrame frame;
+	frame.stats = stats;
+	frame.op = op;
+	frame.startTime = nowUsec();
+	frame.transfers = stats->transfers;
+	frame.bytesOut = stats->bytesOut;
+	frame.bytesIn = stats->bytesIn;
+	return frame;
+}
+
+// Finish timing a call to an entry point, and account for what it did
+//
+void statsExit(const struct StatsFrame *frame) {
+	const struct Stats *const totals = frame->stats;
+	struct OpStats *const stats = frame->stats->ops + frame->op;
+	const uint64 elapsed = nowUsec() - frame->startTime;
+	uint64 limit = 2;
+	int bucket = 0;
+	while ( elapsed >= limit && bucket < STATS_NUM_BUCKETS - 1 ) {
+		limit <<= 1;
+		bucket++;
+	}
+	stats->calls++;
+	stats->transfers += totals->transfers - frame->transfers;
+	stats->bytesOut += totals->bytesOut - frame->bytesOut;
+	stats->bytesIn += totals->bytesIn - frame->bytesIn;
+	stats->totalTime += elapsed;
+	stats->histogram[bucket]++;
+}
+
+// Account for one FPGALink transfer
+//
+void statsTransfer(struct Stats *stats, uint32 bytesOut, uint32 bytesIn) {
+	stats->transfers++;
+	stats->bytesOut += bytesOut;
+	stats->bytesIn += bytesIn;
+}
+
+void statsGet(const struct Stats *stats, StatsOp op, struct OpStats *opStats) {
+	*opStats = stats->ops[op];
+}
+
+const char *statsName(StatsOp op) {
+	return opNames[op];
+}
+
+void statsReset(struct Stats *stats) {
+	memset(stats->ops, 0, sizeof(stats->ops));
+}
+
+// Render a table of the entry points which have been called since the last reset, each followed by
+// its non-empty latency buckets. Returns the length of the text, which is truncated (but still
+// NUL-terminated) if it doesn't fit.
+//
+size_t statsFormat(const struct Stats *stats, char *buf, size_t bufSize) {
+	size_t length = 0;
+	int op, bucket, n;
+	#define APPEND(...) \
+		n = snprintf(buf + length, bufSize - length, __VA_ARGS__); \
+		if ( n < 0 || (size_t)n >= bufSize - length ) { goto truncated; } \
+		length += (size_t)n
+	APPEND(
+		"%-26s %8s %9s %12s %12s %11s\n",
+		"Entry point", "Calls", "Transfers", "Bytes out", "Bytes in", "Total ms");
+	for ( op = 0; op < STATS_NUM_OPS; op++ ) {
+		const struct OpStats *const opStats = stats->ops + op;
+		if ( !opStats->calls ) {
+			continue;
+		}
+		APPEND(
+			"%-26s %8u %9u %12llu %12llu %11.3f\n",
+			opNames[op], opStats->calls, opStats->transfers,
+			(unsigned long long)opStats->bytesOut, (unsigned long long)opStats->bytesIn,
+			(double)opStats->totalTime / 1000.0);
+		APPEND("    latency:");
+		for ( bucket = 0; bucket < STATS_NUM_BUCKETS; bucket++ ) {
+			if ( opStats->histogram[bucket] ) {
+				if ( bucket == STATS_NUM_BUCKETS - 1 ) {
+					APPEND(" >=%luus:%u", 1UL << bucket, opStats->histogram[bucket]);
+				} else {
+					APPEND(" <%luus:%u", 2UL << bucket, opStats->histogram[bucket]);
+				}
+			}
+		}
+		APPEND("\n");
+	}
+	#undef APPEND
+	return length;
+truncated:
+	if ( bufSize ) {
+		buf[bufSize - 1] = '\0';
+	}
+	return bufSize ? bufSize - 1 : 0;
+}
@@ -0,0 +1,86 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <makestuff.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	// The instrumented entry points in mem.c. Keep in step with the names in stats.c.
+	typedef enum {
+		STATS_DIRECT_WRITE_FILE,
+		STATS_PHYSICAL_WRITE_BYTES,
+		STATS_DIRECT_WRITE_BYTES,
+		STATS_DIRECT_READ_BYTES,
+		STATS_DIRECT_READ_BYTES_ASYNC,
+		STATS_WRITE_BYTES,
+		STATS_READ_BYTES,
+		STATS_WRITE_V,
+		STATS_READ_V,
+		STATS_SET_REGISTER,
+		STATS_GET_REGISTER,
+		STATS_GET_REGISTERS,
+		STATS_ACQUIRE,
+		STATS_EXECUTE_COMMAND,
+		STATS_RESET,
+		STATS_CONTINUE,
+		STATS_STEP,
+		STATS_STEP_RANGE,
+		STATS_DUMP_RAM,
+		STATS_CONT_WAIT,
+		STATS_NUM_OPS
+	} StatsOp;
+
+	// Latency histogram buckets: bucket i counts calls taking [2^i, 2^(i+1)) microseconds, except
+	// the first and last, which also take everything below and above.
+	#define STATS_NUM_BUCKETS 24
+
+	struct OpStats {
+		uint32 calls;
+		uint32 transfers;
+		uint64 bytesOut;
+		uint64 bytesIn;
+		uint64 totalTime;  // microseconds
+		uint32 histogram[STATS_NUM_BUCKETS];
+	};
+
+	// All the statistics for one session, and the running transfer totals the frames take their
+	// deltas from
+	struct Stats {
+		struct OpStats ops[STATS_NUM_OPS];
+		uint32 transfers;
+		uint64 bytesOut;
+		uint64 bytesIn;
+	};
+
+	// Snapshot taken on entry to an entry point, to be passed back to statsExit()
+	struct StatsFrame {
+		struct Stats *stats;
+		StatsOp op;
+		uint64 startTime;
+		uint32 transfers;
+		uint64 bytesOut;
+		uint64 bytesIn;
+	};
+
+	// ---------------------------------------------------------------------------------------------
+	// Recording (used by mem.c)
+	//
+	struct StatsFrame statsEnter(struct Stats *stats, StatsOp op);
+	void statsExit(const struct StatsFrame *frame);
+	void statsTransfer(struct Stats *stats, uint32 bytesOut, uint32 bytesIn);
+
+	// ---------------------------------------------------------------------------------------------
+	// Reporting
+	//
+	void statsGet(const struct Stats *stats, StatsOp op, struct OpStats *opStats);
+	const char *statsName(StatsOp op);
+	void statsReset(struct Stats *stats);
+	size_t statsFormat(const struct Stats *stats, char *buf, size_t bufSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -17,10 +17,11 @@
 #include <iostream>
 #include <UnitTest++.h>
 #include <libfpgalink.h>
+#include "../session.h"
 
 using namespace std;
 
-struct FLContext *g_handle = NULL;
+struct UmdkSession *g_session = NULL;
 
 int main() {
 	int retVal = 0;
@@ -28,13 +29,11 @@ int main() {
 	FLStatus status;
 	status = flInitialise(0, NULL);
 	CHECK_STATUS(status, -1, cleanup);
-	status = flOpen("1d50:602b", &g_handle, NULL);
-	CHECK_STATUS(status, -2, cleanup);
-	status = flSelectConduit(g_handle, 0x01, NULL);
-	CHECK_STATUS(status, -3, cleanup);
+	retVal = umdkOpenSession("1d50:602b", &g_session, NULL);
+	CHECK_STATUS(retVal, -2, cleanup);
 	testResult = UnitTest::RunAllTests();
 	CHECK_STATUS(testResult, testResult, cleanup);
 cleanup:
-	flClose(g_handle);
+	umdkCloseSession(g_session);
 	return retVal;
 }
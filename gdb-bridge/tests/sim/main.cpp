@@ -0,0 +1,64 @@
+/* 
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *  
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <UnitTest++.h>
+#include <TestReporterStdout.h>
+#include <libfpgalink.h>
+#include "../../session.h"
+
+using namespace std;
+
+struct UmdkSession *g_session = NULL;
+
+// The simulator models the monitor's command block, but doesn't execute 68000 code, so these
+// tests (which run code on the MD and check where it ends up) need a real board.
+//
+static const char *const needsBoard[] = {
+	"Range_testCont",
+	"Range_testStep",
+	NULL
+};
+
+struct RunsOnSim {
+	bool operator()(const UnitTest::Test *test) const {
+		for ( const char *const *name = needsBoard; *name; name++ ) {
+			if ( !strcmp(test->m_details.testName, *name) ) {
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+int main() {
+	int retVal = 0;
+	int testResult;
+	FLStatus status;
+	status = flInitialise(0, NULL);
+	CHECK_STATUS(status, -1, cleanup);
+	retVal = umdkOpenSession("1d50:602b", &g_session, NULL);
+	CHECK_STATUS(retVal, -2, cleanup);
+	{
+		UnitTest::TestReporterStdout reporter;
+		UnitTest::TestRunner runner(reporter);
+		testResult = runner.RunTestsIf(UnitTest::Test::GetTestList(), NULL, RunsOnSim(), 0);
+	}
+	CHECK_STATUS(testResult, testResult, cleanup);
+cleanup:
+	umdkCloseSession(g_session);
+	return retVal;
+}
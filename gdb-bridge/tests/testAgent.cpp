@@ -0,0 +1,101 @@
+/* 
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *  
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <UnitTest++.h>
+#include <libfpgalink.h>
+#include "../mem.h"
+#include "../agent.h"
+#include "../session.h"
+
+extern struct UmdkSession *g_session;
+
+static int evaluate(const uint8 *code, uint32 length, const struct Registers *regs, int64 *result) {
+	struct AgentEnv env = {g_session, regs, NULL, NULL};
+	return agentEval(code, length, &env, result, NULL);
+}
+
+TEST(Agent_testArithmetic) {
+	struct Registers regs;
+	int64 result;
+	memset(&regs, 0, sizeof(regs));
+	regs.d0 = 7;
+	regs.a1 = 0xFFFFFFFE;
+
+	// $d0 + 5 == 12
+	const uint8 sum[] = {0x26, 0x00, 0x00, 0x22, 0x05, 0x02, 0x22, 0x0C, 0x13, 0x27};
+	CHECK_EQUAL(0, evaluate(sum, sizeof(sum), &regs, &result));
+	CHECK_EQUAL(1, result);
+
+	// (int)$a1 < 0, sign-extending from 32 bits
+	const uint8 less[] = {0x26, 0x00, 0x09, 0x16, 0x20, 0x22, 0x00, 0x14, 0x27};
+	CHECK_EQUAL(0, evaluate(less, sizeof(less), &regs, &result));
+	CHECK_EQUAL(1, result);
+
+	// if ( $d0 ) 3 else 4, by way of if_goto and goto
+	const uint8 branch[] = {
+		0x26, 0x00, 0x00, 0x20, 0x00, 0x0B, 0x22, 0x04, 0x21, 0x00, 0x0D, 0x22, 0x03, 0x27
+	};
+	CHECK_EQUAL(0, evaluate(branch, sizeof(branch), &regs, &result));
+	CHECK_EQUAL(3, result);
+
+	// INT64_MIN / -1 and INT64_MIN % -1 overflow, so they wrap rather than trap
+	uint8 minOverMinusOne[] = {
+		0x25, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22, 0xFF, 0x16, 0x08, 0x05, 0x27
+	};
+	CHECK_EQUAL(0, evaluate(minOverMinusOne, sizeof(minOverMinusOne), &regs, &result));
+	CHECK(result == (int64)0x8000000000000000ULL);
+	minOverMinusOne[13] = 0x07;
+	CHECK_EQUAL(0, evaluate(minOverMinusOne, sizeof(minOverMinusOne), &regs, &result));
+	CHECK_EQUAL(0, result);
+
+	// INT64_MAX + 1 wraps too
+	const uint8 maxPlusOne[] = {
+		0x25, 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x22, 0x01, 0x02, 0x27
+	};
+	CHECK_EQUAL(0, evaluate(maxPlusOne, sizeof(maxPlusOne), &regs, &result));
+	CHECK(result == (int64)0x8000000000000000ULL);
+}
+
+TEST(Agent_testMemory) {
+	struct Registers regs;
+	int64 result;
+	int retVal;
+	memset(&regs, 0, sizeof(regs));
+	retVal = umdkWriteLong(g_session, 0x001200, 0xCAFEBABE, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// *(uint16*)0x1202 == 0xBABE
+	const uint8 ref[] = {0x23, 0x12, 0x02, 0x18, 0x23, 0xBA, 0xBE, 0x13, 0x27};
+	CHECK_EQUAL(0, evaluate(ref, sizeof(ref), &regs, &result));
+	CHECK_EQUAL(1, result);
+}
+
+TEST(Agent_testBadExpressions) {
+	struct Registers regs;
+	int64 result;
+	memset(&regs, 0, sizeof(regs));
+	const uint8 underflow[] = {0x02, 0x27};
+	const uint8 noEnd[] = {0x22, 0x01};
+	const uint8 divZero[] = {0x22, 0x01, 0x22, 0x00, 0x05, 0x27};
+	const uint8 badJump[] = {0x21, 0x00, 0x40};
+	const uint8 floating[] = {0x01, 0x27};
+	CHECK(evaluate(underflow, sizeof(underflow), &regs, &result) != 0);
+	CHECK(evaluate(noEnd, sizeof(noEnd), &regs, &result) != 0);
+	CHECK(evaluate(divZero, sizeof(divZero), &regs, &result) != 0);
+	CHECK(evaluate(badJump, sizeof(badJump), &regs, &result) != 0);
+	CHECK(evaluate(floating, sizeof(floating), &regs, &result) != 0);
+}
@@ -0,0 +1,126 @@
+/* 
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *  
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <UnitTest++.h>
+#include <libfpgalink.h>
+#include "../mem.h"
+#include "../break.h"
+#include "../session.h"
+
+extern struct UmdkSession *g_session;
+
+TEST(Break_testTable) {
+	struct BreakTable table;
+	uint32 i;
+	memset(&table, 0, sizeof(table));
+
+	// Far more breakpoints than the old fixed table could take
+	for ( i = 0; i < 1000; i++ ) {
+		CHECK_EQUAL(0, brkInsert(&table, 0x200 + 2*i));
+	}
+	CHECK_EQUAL(1000U, table.count);
+	CHECK(brkIsWanted(&table, 0x200));
+	CHECK(brkIsWanted(&table, 0x200 + 2*999));
+	CHECK(!brkIsWanted(&table, 0x200 + 2*1000));
+
+	// None of them reached memory, so removing them forgets them straight away
+	for ( i = 0; i < 1000; i += 2 ) {
+		CHECK(brkRemove(&table, 0x200 + 2*i));
+	}
+	CHECK(!brkRemove(&table, 0x200));
+	CHECK_EQUAL(500U, table.count);
+	for ( i = 0; i < 1000; i++ ) {
+		CHECK_EQUAL((i & 1) != 0, brkIsWanted(&table, 0x200 + 2*i));
+	}
+	brkDestroy(&table);
+	CHECK(brkFind(&table, 0x202) == NULL);
+}
+
+TEST(Break_testCommit) {
+	const uint32 addr = 0x001000;
+	uint16 word;
+	uint8 buf[4];
+	int retVal;
+	struct BreakTable *const table = &g_session->breakpoints;
+	retVal = umdkWriteWord(g_session, addr, 0x4E71, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Nothing reaches memory until the commit
+	CHECK_EQUAL(0, brkInsert(table, addr));
+	retVal = umdkReadWord(g_session, addr, &word, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(0x4E71, word);
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadWord(g_session, addr, &word, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(ILLEGAL, word);
+	CHECK_EQUAL(0x4E71, brkFind(table, addr)->save);
+
+	// Reads can be patched to hide it
+	retVal = umdkReadBytes(g_session, addr - 1, 4, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	brkPatch(table, buf, addr - 1, 4);
+	CHECK_EQUAL(0x4E, buf[1]);
+	CHECK_EQUAL(0x71, buf[2]);
+
+	// A remove and reinsert cancel out, leaving nothing to do
+	CHECK(brkRemove(table, addr));
+	CHECK_EQUAL(0, brkInsert(table, addr));
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadWord(g_session, addr, &word, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(ILLEGAL, word);
+
+	// A remove puts the opcode back at the next commit
+	CHECK(brkRemove(table, addr));
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadWord(g_session, addr, &word, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(0x4E71, word);
+	CHECK(brkFind(table, addr) == NULL);
+}
+
+TEST(Break_testOverwritten) {
+	const uint32 addr = 0x001100;
+	const uint8 newCode[] = {0x70, 0x01};
+	uint16 word;
+	int retVal;
+	struct BreakTable *const table = &g_session->breakpoints;
+	retVal = umdkWriteWord(g_session, addr, 0x4E71, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(0, brkInsert(table, addr));
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// GDB writes new code over the breakpoint: it goes back in at the next commit, over the new code
+	retVal = umdkWriteBytes(g_session, addr, 2, newCode, NULL);
+	CHECK_EQUAL(0, retVal);
+	brkOverwritten(table, addr, 2);
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadWord(g_session, addr, &word, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(ILLEGAL, word);
+	CHECK_EQUAL(0x7001, brkFind(table, addr)->save);
+
+	CHECK(brkRemove(table, addr));
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <UnitTest++.h>
+#include <libfpgalink.h>
+#include "../mem.h"
+#include "../cache.h"
+#include "../session.h"
+
+extern struct UmdkSession *g_session;
+
+TEST(Cache_testPages) {
+	struct PageCache *const cache = (struct PageCache *)calloc(1, sizeof(struct PageCache));
+	uint8 page[CACHE_PAGE_SIZE];
+	const uint8 update[] = {0xCA, 0xFE, 0xBA, 0xBE};
+	const uint8 *data;
+	uint32 i;
+	for ( i = 0; i < CACHE_PAGE_SIZE; i++ ) {
+		page[i] = (uint8)i;
+	}
+
+	// Empty to start with
+	CHECK(cacheLookup(cache, 0, true) == NULL);
+
+	// An unpinned page is only good while the MD is stopped; a pinned one always is
+	cacheInsert(cache, 0x10, false, page);
+	cacheInsert(cache, 0x11, true, page);
+	CHECK(cacheLookup(cache, 0x10, true) != NULL);
+	CHECK(cacheLookup(cache, 0x10, false) == NULL);
+	CHECK(cacheLookup(cache, 0x11, false) != NULL);
+	CHECK(cacheLookup(cache, 0x12, true) == NULL);
+
+	// A write straddling the two pages updates both
+	cacheWrite(cache, 0x11FE, 4, update);
+	data = cacheLookup(cache, 0x11, true);
+	CHECK(data != NULL);
+	if ( data ) {
+		CHECK_ARRAY_EQUAL(update, data + CACHE_PAGE_SIZE - 2, 2);
+		CHECK_EQUAL(0x02, data[2]);
+	}
+	data = cacheLookup(cache, 0x12, true);
+	CHECK(data == NULL);
+	data = cacheLookup(cache, 0x10, true);
+	CHECK(data != NULL);
+	if ( data ) {
+		CHECK_EQUAL(0xFE, data[0xFE]);
+	}
+
+	// Resuming drops the unpinned page, but keeps the pinned one
+	cacheResume(cache);
+	CHECK(cacheLookup(cache, 0x10, true) == NULL);
+	CHECK(cacheLookup(cache, 0x11, true) != NULL);
+
+	// Pinned pages can still be invalidated explicitly
+	cacheInvalidate(cache, 0x11FF, 1);
+	CHECK(cacheLookup(cache, 0x11, true) == NULL);
+
+	// A page pushes out whichever page was in its slot
+	cacheInsert(cache, 0x20, true, page);
+	cacheInsert(cache, 0x20 + CACHE_NUM_SLOTS * CACHE_NUM_SLOTS, true, page);
+	CHECK(cacheLookup(cache, 0x20, true) == NULL);
+	cacheClear(cache);
+	CHECK(cacheLookup(cache, 0x20 + CACHE_NUM_SLOTS * CACHE_NUM_SLOTS, true) == NULL);
+	free(cache);
+}
+
+TEST(Cache_testReadThrough) {
+	const uint8 bytes[] = {0xCA, 0xFE, 0xBA, 0xBE, 0xDE, 0xAD, 0xF0, 0x0D};
+	const uint8 overwrite[] = {0x12, 0x34, 0x56};
+	const uint8 expected[] = {0xCA, 0xFE, 0x12, 0x34, 0x56, 0xAD, 0xF0, 0x0D};
+	uint8 buf[8];
+	uint32 hits;
+	int retVal;
+
+	// The MD may write to cartridge banks, so they aren't cached while it's running...
+	retVal = umdkWriteBytes(g_session, 0x070000, 8, bytes, NULL);
+	CHECK_EQUAL(0, retVal);
+	hits = g_session->cache.hits;
+	retVal = umdkReadBytes(g_session, 0x070000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadBytes(g_session, 0x070000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(hits, g_session->cache.hits);
+
+	// ...unless they're declared, which pins them
+	umdkSetBankPage(g_session, 0, 0);
+	retVal = umdkReadBytes(g_session, 0x070000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(bytes, buf, 8);
+	hits = g_session->cache.hits;
+	retVal = umdkReadBytes(g_session, 0x070004, 4, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(bytes + 4, buf, 4);
+	CHECK_EQUAL(hits + 1, g_session->cache.hits);
+
+	// Writes go through the cache
+	retVal = umdkWriteBytes(g_session, 0x070002, 3, overwrite, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadBytes(g_session, 0x070000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(expected, buf, 8);
+	CHECK_EQUAL(hits + 2, g_session->cache.hits);
+	retVal = umdkDirectReadBytes(g_session, 0x070000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(expected, buf, 8);
+
+	// Large reads bypass it
+	hits = g_session->cache.hits;
+	retVal = umdkReadBytes(g_session, 0x060000, 0x8000, g_session->ioBuf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(hits, g_session->cache.hits);
+	g_session->banksPinned = 0;
+}
+
+TEST(Cache_testWramAliases) {
+	const uint8 bytes[] = {0xCA, 0xFE, 0xBA, 0xBE, 0xDE, 0xAD, 0xF0, 0x0D};
+	const uint8 overwrite[] = {0x12, 0x34, 0x56};
+	const uint8 expected[] = {0xCA, 0xFE, 0x12, 0x34, 0x56, 0xAD, 0xF0, 0x0D};
+	struct Registers regs;
+	uint8 buf[8];
+	uint32 hits;
+	int retVal;
+
+	// WRAM is only cached while the MD is stopped
+	retVal = umdkGetRegisters(g_session, &regs, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkWriteBytes(g_session, 0xFF1000, 8, bytes, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadBytes(g_session, 0xFF1000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Its aliases are read from the same pages...
+	hits = g_session->cache.hits;
+	retVal = umdkReadBytes(g_session, 0xE01000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(bytes, buf, 8);
+	CHECK_EQUAL(hits + 1, g_session->cache.hits);
+
+	// ...and written through to them
+	retVal = umdkWriteBytes(g_session, 0xE51002, 3, overwrite, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadBytes(g_session, 0xFF1000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(expected, buf, 8);
+	CHECK_EQUAL(hits + 2, g_session->cache.hits);
+	retVal = umdkReadBytes(g_session, 0xFE1000, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(expected, buf, 8);
+	CHECK_EQUAL(hits + 3, g_session->cache.hits);
+
+	// A read straddling two aliases bypasses the cache
+	retVal = umdkReadBytes(g_session, 0xFEFFFC, 8, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(hits + 3, g_session->cache.hits);
+	g_session->regsValid = false;
+	cacheClear(&g_session->cache);
+}
+
+TEST(Cache_testStream) {
+	struct PageCache *const cache = (struct PageCache *)calloc(1, sizeof(struct PageCache));
+
+	// Ascending: it takes three reads, each moving on from the last, to make a stream
+	CHECK_EQUAL(0, cacheTrackStream(cache, 0x1000, 4));
+	CHECK_EQUAL(0, cacheTrackStream(cache, 0x1004, 2));
+	CHECK_EQUAL(1, cacheTrackStream(cache, 0x1006, 16));
+	CHECK_EQUAL(1, cacheTrackStream(cache, 0x1016 + CACHE_PAGE_SIZE, 4));
+
+	// Reading the same thing again breaks it
+	CHECK_EQUAL(0, cacheTrackStream(cache, 0x1016 + CACHE_PAGE_SIZE, 4));
+
+	// Descending, as when reading down a stack
+	CHECK_EQUAL(0, cacheTrackStream(cache, 0xFFFF00, 8));
+	CHECK_EQUAL(0, cacheTrackStream(cache, 0xFFFEF8, 8));
+	CHECK_EQUAL(-1, cacheTrackStream(cache, 0xFFFEE0, 8));
+
+	// A jump elsewhere breaks it too
+	CHECK_EQUAL(0, cacheTrackStream(cache, 0x2000, 8));
+	free(cache);
+}
+
+TEST(Cache_testReadAhead) {
+	uint8 buf[16], expected[16];
+	uint32 misses, address;
+	int retVal;
+
+	// Read through nine pages, sixteen bytes at a time. The first page is fetched on its own, but by
+	// the time the reads reach the second page they're a stream, so it comes with the rest.
+	umdkSetBankPage(g_session, 0, 0);
+	cacheClear(&g_session->cache);
+	misses = g_session->cache.misses;
+	for ( address = 0x071000; address < 0x071000 + 9*CACHE_PAGE_SIZE; address += 16 ) {
+		retVal = umdkReadBytes(g_session, address, 16, buf, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkDirectReadBytes(g_session, address, 16, expected, NULL);
+		CHECK_EQUAL(0, retVal);
+		CHECK_ARRAY_EQUAL(expected, buf, 16);
+	}
+	CHECK_EQUAL(misses + 2, g_session->cache.misses);
+	g_session->banksPinned = 0;
+}
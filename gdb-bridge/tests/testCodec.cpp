@@ -0,0 +1,80 @@
+/* 
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *  
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdio>
+#include <cstring>
+#include <UnitTest++.h>
+#include "../codec.h"
+
+// Every kernel must agree with sprintf() and a plain sum, at every length and alignment that
+// exercises the vector loops and their scalar tails
+TEST(Codec_testAllLevels) {
+	uint8 bin[200], decoded[200];
+	char hex[2*200 + 2], expected[2*200 + 2];
+	uint32 length, offset, i;
+	uint8 sum, checksum;
+	int level;
+	const CodecLevel best = codecGetLevel();
+	for ( i = 0; i < sizeof(bin); i++ ) {
+		bin[i] = (uint8)(i * 37 + 11);
+	}
+	for ( level = CODEC_SCALAR; level <= CODEC_AVX2; level++ ) {
+		codecSetLevel((CodecLevel)level);
+		for ( offset = 0; offset < 3; offset++ ) {
+			for ( length = 0; length < 160; length++ ) {
+				sum = 0x5A;
+				for ( i = 0; i < length; i++ ) {
+					sprintf(expected + 2*i, "%02X", bin[offset + i]);
+					sum = (uint8)(sum + expected[2*i] + expected[2*i + 1]);
+				}
+				checksum = codecHexEncode(hex + offset, bin + offset, length, 0x5A);
+				CHECK_EQUAL(sum, checksum);
+				CHECK(!memcmp(expected, hex + offset, 2*length));
+				CHECK_EQUAL(sum, codecChecksum(hex + offset, 2*length, 0x5A));
+				CHECK_EQUAL(0, codecHexDecode(decoded, hex + offset, length));
+				CHECK(!memcmp(bin + offset, decoded, length));
+			}
+		}
+	}
+	codecSetLevel(best);
+}
+
+TEST(Codec_testDecodeInvalid) {
+	char hex[2*100];
+	uint8 decoded[100];
+	uint32 i;
+	int level;
+	const CodecLevel best = codecGetLevel();
+	static const char badChars[] = {'/', ':', '@', 'G', '`', 'g', ' ', '\0', (char)0xB0, (char)0xC1};
+	for ( level = CODEC_SCALAR; level <= CODEC_AVX2; level++ ) {
+		codecSetLevel((CodecLevel)level);
+
+		// Both cases are fine
+		memset(hex, 'a', sizeof(hex));
+		memcpy(hex + 64, "0123456789abcdefABCDEF", 22);
+		CHECK_EQUAL(0, codecHexDecode(decoded, hex, 100));
+		CHECK_EQUAL(0xAB, decoded[37]);
+		CHECK_EQUAL(0xAB, decoded[40]);
+
+		// A bad char anywhere is caught
+		for ( i = 0; i < sizeof(hex); i += 7 ) {
+			memset(hex, '5', sizeof(hex));
+			hex[i] = badChars[i % sizeof(badChars)];
+			CHECK(codecHexDecode(decoded, hex, 100) != 0);
+		}
+	}
+	codecSetLevel(best);
+}
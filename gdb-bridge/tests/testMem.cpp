@@ -20,7 +20,7 @@
 #include <libfpgalink.h>
 #include "../mem.h"
 
-extern struct FLContext *g_handle;
+extern struct UmdkSession *g_session;
 
 using namespace std;
 
@@ -42,29 +42,29 @@ TEST(foo) {
 	uint16 oldOp;
 	
 	// Read address of VDP vertical interrupt vector & read 1st opcode
-	retVal = umdkDirectReadLong(g_handle, VB_VEC, &vbAddr, NULL);
+	retVal = umdkDirectReadLong(g_session, VB_VEC, &vbAddr, NULL);
 	CHECK_EQUAL(0, retVal);
-	retVal = umdkDirectReadWord(g_handle, vbAddr, &oldOp, NULL);
+	retVal = umdkDirectReadWord(g_session, vbAddr, &oldOp, NULL);
 	CHECK_EQUAL(0, retVal);
 	printf("vbAddr = 0x%06X, opCode = 0x%04X\n", vbAddr, oldOp);
 	
 	// Replace illegal instruction vector
-	retVal = umdkDirectWriteLong(g_handle, IL_VEC, MONITOR, NULL);
+	retVal = umdkDirectWriteLong(g_session, IL_VEC, MONITOR, NULL);
 	CHECK_EQUAL(0, retVal);
 	
 	// Write illegal instruction opcode
-	retVal = umdkDirectWriteWord(g_handle, vbAddr, ILLEGAL, NULL);
+	retVal = umdkDirectWriteWord(g_session, vbAddr, ILLEGAL, NULL);
 	CHECK_EQUAL(0, retVal);
 	
 	// Acquire the monitor
-	retVal = umdkRemoteAcquire(g_handle, &regs, NULL);
+	retVal = umdkRemoteAcquire(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	
 	// Restore old opcode to vbAddr
-	retVal = umdkDirectWriteWord(g_handle, vbAddr, oldOp, NULL);
+	retVal = umdkDirectWriteWord(g_session, vbAddr, oldOp, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
-	retVal = umdkSetRegister(g_handle, SR, 0x00002700, NULL);  // disable interrupts
+	retVal = umdkSetRegister(g_session, SR, 0x00002700, NULL);  // disable interrupts
 	CHECK_EQUAL(0, retVal);
 }
 
@@ -73,39 +73,39 @@ TEST(Range_testDirectWriteBytesValidations) {
 	int retVal;
 
 	// Write two bytes to bottom of page 0 (should work)
-	retVal = umdkDirectWriteBytes(g_handle, 0x000000, 2, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x000000, 2, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Write two bytes to top of page 0 (should work)
-	retVal = umdkDirectWriteBytes(g_handle, 0x07FFFE, 2, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x07FFFE, 2, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Write four bytes that span top of page 0 (should fail)
-	retVal = umdkDirectWriteBytes(g_handle, 0x07FFFE, 4, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x07FFFE, 4, bytes, NULL);
 	CHECK_EQUAL(1, retVal);
 
 	// Write four bytes that span bottom of page 8 (should fail)
-	retVal = umdkDirectWriteBytes(g_handle, MONITOR-2, 4, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, MONITOR-2, 4, bytes, NULL);
 	CHECK_EQUAL(1, retVal);
 
 	// Write two bytes to bottom of page 8 (should work) [comment out to avoid corrupting monitor]
-	//retVal = umdkDirectWriteBytes(g_handle, MONITOR, 2, bytes, NULL);
+	//retVal = umdkDirectWriteBytes(g_session, MONITOR, 2, bytes, NULL);
 	//CHECK_EQUAL(0, retVal);
 
 	// Write two bytes to top of page 8 (should work)
-	retVal = umdkDirectWriteBytes(g_handle, MONITOR+512*1024-2, 2, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, MONITOR+512*1024-2, 2, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Write four bytes that span top of page 8 (should fail)
-	retVal = umdkDirectWriteBytes(g_handle, MONITOR+512*1024-2, 4, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, MONITOR+512*1024-2, 4, bytes, NULL);
 	CHECK_EQUAL(1, retVal);
 
 	// Write two bytes to an odd address (should fail)
-	retVal = umdkDirectWriteBytes(g_handle, 0x000001, 2, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x000001, 2, bytes, NULL);
 	CHECK_EQUAL(2, retVal);
 
 	// Write one byte to an even address (should fail)
-	retVal = umdkDirectWriteBytes(g_handle, 0x000000, 1, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x000000, 1, bytes, NULL);
 	CHECK_EQUAL(3, retVal);
 }
 
@@ -114,34 +114,107 @@ TEST(Range_testDirectReadBytesValidations) {
 	int retVal;
 
 	// Read two bytes from bottom of page 0 (should work)
-	retVal = umdkDirectReadBytes(g_handle, 0x000000, 2, bytes, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x000000, 2, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read two bytes from top of page 0 (should work)
-	retVal = umdkDirectReadBytes(g_handle, 0x07FFFE, 2, bytes, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x07FFFE, 2, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read four bytes that span top of page 0 (should fail)
-	retVal = umdkDirectReadBytes(g_handle, 0x07FFFE, 4, bytes, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x07FFFE, 4, bytes, NULL);
 	CHECK_EQUAL(1, retVal);
 
 	// Read four bytes that span bottom of page 8 (should fail)
-	retVal = umdkDirectReadBytes(g_handle, MONITOR-2, 4, bytes, NULL);
+	retVal = umdkDirectReadBytes(g_session, MONITOR-2, 4, bytes, NULL);
 	CHECK_EQUAL(1, retVal);
 
 	// Read two bytes from bottom of page 8 (should work)
-	retVal = umdkDirectReadBytes(g_handle, MONITOR, 2, bytes, NULL);
+	retVal = umdkDirectReadBytes(g_session, MONITOR, 2, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read two bytes from top of page 8 (should work)
-	retVal = umdkDirectReadBytes(g_handle, MONITOR+512*1024-2, 2, bytes, NULL);
+	retVal = umdkDirectReadBytes(g_session, MONITOR+512*1024-2, 2, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read four bytes that span top of page 8 (should fail)
-	retVal = umdkDirectReadBytes(g_handle, MONITOR+512*1024-2, 4, bytes, NULL);
+	retVal = umdkDirectReadBytes(g_session, MONITOR+512*1024-2, 4, bytes, NULL);
 	CHECK_EQUAL(1, retVal);
 }
 
+TEST(Range_testBankMapping) {
+	const uint8 bytes[] = {0xCA, 0xFE, 0xBA, 0xBE};
+	uint8 buf[4];
+	uint32 page;
+	int retVal;
+
+	// Put something recognisable in SDRAM page 5
+	retVal = umdkPhysicalWriteBytes(g_session, 5*512*1024 + 0x100, 4, bytes, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Map bank 1 to page 5 through the monitor; the bridge should notice, and read it directly
+	retVal = umdkWriteWord(g_session, SSF2_REG_FIRST-1, 0x0005, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK(umdkGetBankPage(g_session, 1, &page));
+	CHECK_EQUAL(5U, page);
+	retVal = umdkDirectReadBytes(g_session, 0x080100, 4, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(bytes, buf, 4);
+
+	// The monitor sees the same thing
+	memset(buf, 0, 4);
+	retVal = umdkExecuteCommand(g_session, CMD_READ, 0x080100, 4, NULL, buf, NULL, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(bytes, buf, 4);
+
+	// A forgotten bank can't be accessed directly
+	umdkForgetBank(g_session, 1);
+	CHECK(!umdkIsDirect(g_session, 0x080100, 4));
+	retVal = umdkDirectReadBytes(g_session, 0x080100, 4, buf, NULL);
+	CHECK_EQUAL(1, retVal);
+
+	// Put bank 1 back where it was
+	retVal = umdkWriteWord(g_session, SSF2_REG_FIRST-1, 0x0001, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK(umdkGetBankPage(g_session, 1, &page));
+	CHECK_EQUAL(1U, page);
+	umdkForgetBank(g_session, 1);
+}
+
+TEST(Range_testSplitRequests) {
+	const uint8 bytes[] = {0xCA, 0xFE, 0xBA, 0xBE, 0xDE, 0xAD, 0xF0, 0x0D};
+	const uint8 ex0[] = {0xCA, 0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0x0D};
+	const uint8 overwrite[] = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC};
+	uint8 buf[8];
+	int retVal, i;
+
+	// Straddle banks 0 and 1, first with both direct, then with bank 1 through the monitor
+	umdkSetBankPage(g_session, 1, 1);
+	for ( i = 0; i < 2; i++ ) {
+		if ( i ) {
+			umdkForgetBank(g_session, 1);
+		}
+		retVal = umdkWriteBytes(g_session, 0x07FFFC, 8, bytes, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkWriteBytes(g_session, 0x07FFFD, 6, overwrite, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkReadBytes(g_session, 0x07FFFC, 8, buf, NULL);
+		CHECK_EQUAL(0, retVal);
+		CHECK_ARRAY_EQUAL(ex0, buf, 8);
+
+		// Each half really went where it should
+		retVal = umdkDirectReadBytes(g_session, 0x07FFFC, 4, buf, NULL);
+		CHECK_EQUAL(0, retVal);
+		CHECK_ARRAY_EQUAL(ex0, buf, 4);
+		retVal = umdkPhysicalWriteBytes(g_session, 0x080000, 2, bytes, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkReadBytes(g_session, 0x07FFFE, 4, buf, NULL);
+		CHECK_EQUAL(0, retVal);
+		CHECK_ARRAY_EQUAL(ex0 + 2, buf, 2);
+		CHECK_ARRAY_EQUAL(bytes, buf + 2, 2);
+	}
+}
+
 /*TEST(Range_testStartMonitor) {
 	int retVal;
 	uint8 buf[0x8000];
@@ -151,11 +224,11 @@ TEST(Range_testDirectReadBytesValidations) {
 
 	// Put MD in RESET
 	buf[0] = 5;
-	retVal = flWriteChannel(g_handle, 1, 1, buf, NULL);
+	retVal = flWriteChannel(g_session->handle, 1, 1, buf, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Load boot image
-	retVal = umdkDirectWriteFile(g_handle, 0x000000, "../monitor/boot.bin", NULL);
+	retVal = umdkDirectWriteFile(g_session, 0x000000, "../monitor/boot.bin", NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Load separately for comparison
@@ -163,7 +236,7 @@ TEST(Range_testDirectReadBytesValidations) {
 	CHECK(exampleData);
 	if ( exampleData ) {
 		// Load the monitor image
-		retVal = umdkDirectWriteFile(g_handle, MONITOR, "../monitor/monitor.bin", NULL);
+		retVal = umdkDirectWriteFile(g_session, MONITOR, "../monitor/monitor.bin", NULL);
 		CHECK_EQUAL(0, retVal);
 		
 		// It would be good to have a test that compares a trace log for a known command (e.g
@@ -171,46 +244,46 @@ TEST(Range_testDirectReadBytesValidations) {
 		// cmdFlag" line in the monitor code so the monitor actually executes on entry. Then
 		// enable tracing below and store trace log. It would have to sanitise the trace FIFO too.
 		//
-		//retVal = umdkDirectWriteWord(g_handle, CB_INDEX, CMD_WRITE, NULL);
+		//retVal = umdkDirectWriteWord(g_session, CB_INDEX, CMD_WRITE, NULL);
 		//CHECK_EQUAL(0, retVal);
-		//retVal = umdkDirectWriteLong(g_handle, CB_ADDR, 0x470000, NULL);
+		//retVal = umdkDirectWriteLong(g_session, CB_ADDR, 0x470000, NULL);
 		//CHECK_EQUAL(0, retVal);
-		//retVal = umdkDirectWriteLong(g_handle, CB_LEN, 8, NULL);
+		//retVal = umdkDirectWriteLong(g_session, CB_LEN, 8, NULL);
 		//CHECK_EQUAL(0, retVal);
-		//retVal = umdkDirectWriteLong(g_handle, CB_MEM, 0xCAFEBABE, NULL);
+		//retVal = umdkDirectWriteLong(g_session, CB_MEM, 0xCAFEBABE, NULL);
 		//CHECK_EQUAL(0, retVal);
-		//retVal = umdkDirectWriteLong(g_handle, CB_MEM+4, 0xDEADF00D, NULL);
+		//retVal = umdkDirectWriteLong(g_session, CB_MEM+4, 0xDEADF00D, NULL);
 		//CHECK_EQUAL(0, retVal);
-		//retVal = umdkDirectWriteWord(g_handle, CB_FLAG, 2, NULL);
+		//retVal = umdkDirectWriteWord(g_session, CB_FLAG, 2, NULL);
 		//CHECK_EQUAL(0, retVal);
 
 		// Clear cmdFlag to ensure remote acquire below doesn't spuriously succeed early
-		retVal = umdkDirectWriteWord(g_handle, CB_FLAG, 0, NULL);
+		retVal = umdkDirectWriteWord(g_session, CB_FLAG, 0, NULL);
 		CHECK_EQUAL(0, retVal);
 
 		// Execute readback of the boot ROM, and verify. This is actually necessary to ensure all
 		// the previous direct-writes have completed, before releasing the MD from reset. The MD
 		// actually takes a long time to come out of reset, so it'll probably work without, but
 		// it's safer with it in.
-		retVal = umdkDirectReadBytes(g_handle, 0x000000, exampleLength, buf, NULL);
+		retVal = umdkDirectReadBytes(g_session, 0x000000, exampleLength, buf, NULL);
 		CHECK_EQUAL(0, retVal);
 		CHECK_ARRAY_EQUAL(exampleData, buf, exampleLength);
 		
 		// Release MD from RESET - MD will execute the boot image (incl TMSS) & enter monitor.
 		buf[0] = 0; // run, no tracing
 		//buf[0] = 2; // run, with tracing
-		retVal = flWriteChannelAsync(g_handle, 1, 1, buf, NULL);
+		retVal = flWriteChannelAsync(g_session->handle, 1, 1, buf, NULL);
 		CHECK_EQUAL(0, retVal);
 		
 		// Read some stuff from the trace-FIFO
-		//retVal = flReadChannel(g_handle, 2, 3072, buf, NULL);
+		//retVal = flReadChannel(g_session->handle, 2, 3072, buf, NULL);
 		//CHECK_EQUAL(0, retVal);
 		//FILE *outFile = fopen("trace.bin", "wb");
 		//fwrite(buf, 3072, 1, outFile);
 		//fclose(outFile);
 
 		// Acquire monitor
-		retVal = umdkRemoteAcquire(g_handle, &regs, NULL);
+		retVal = umdkRemoteAcquire(g_session, &regs, NULL);
 		CHECK_EQUAL(0, retVal);
 
 		// Print registers
@@ -218,7 +291,7 @@ TEST(Range_testDirectReadBytesValidations) {
 
 		// Execute remote read of the boot ROM, and verify
 		memset(buf, 0xCC, 0x8000);
-		retVal = umdkExecuteCommand(g_handle, CMD_READ, 0x000000, exampleLength, NULL, buf, NULL, NULL);
+		retVal = umdkExecuteCommand(g_session, CMD_READ, 0x000000, exampleLength, NULL, buf, NULL, NULL);
 		CHECK_EQUAL(0, retVal);
 		CHECK_ARRAY_EQUAL(exampleData, buf, exampleLength);
 		flFreeFile(exampleData);
@@ -235,30 +308,30 @@ TEST(Range_testDirectReadNonAligned) {
 	int retVal;
 
 	// Write eight bytes to page 0 (setup)
-	retVal = umdkDirectWriteBytes(g_handle, 0x000100, 8, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x000100, 8, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read six bytes from an even address
 	memset(buf, 0xCC, 8);
-	retVal = umdkDirectReadBytes(g_handle, 0x000102, 6, buf+1, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x000102, 6, buf+1, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(ex0, buf, 8);
 
 	// Read five bytes from an even address
 	memset(buf, 0xCC, 8);
-	retVal = umdkDirectReadBytes(g_handle, 0x000102, 5, buf+1, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x000102, 5, buf+1, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(ex1, buf, 8);
 
 	// Read six bytes from an odd address
 	memset(buf, 0xCC, 8);
-	retVal = umdkDirectReadBytes(g_handle, 0x000101, 6, buf+1, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x000101, 6, buf+1, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(ex2, buf, 8);
 
 	// Read five bytes from an odd address
 	memset(buf, 0xCC, 8);
-	retVal = umdkDirectReadBytes(g_handle, 0x000101, 5, buf+1, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x000101, 5, buf+1, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(ex3, buf, 8);
 }
@@ -273,41 +346,41 @@ TEST(Range_testIndirectReadNonAligned) {
 	int retVal;
 	
 	// Do indirect write
-	retVal = umdkWriteBytes(g_handle, 0xFF0000, 8, bytes, NULL);
+	retVal = umdkWriteBytes(g_session, 0xFF0000, 8, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Blat CB_MEM area to be sure there's no confusion from leftover data
 	memset(buf, 0xDD, 8);
-	retVal = umdkDirectWriteBytes(g_handle, CB_MEM, 8, buf, NULL);
+	retVal = umdkDirectWriteBytes(g_session, CB_MEM, 8, buf, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Verify all eight
 	memset(buf, 0xCC, 8);
-	retVal = umdkReadBytes(g_handle, 0xFF0000, 8, buf, NULL);
+	retVal = umdkReadBytes(g_session, 0xFF0000, 8, buf, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(bytes, buf, 8);
 
 	// Read six bytes from an even address
 	memset(buf, 0xCC, 8);
-	retVal = umdkReadBytes(g_handle, 0xFF0002, 6, buf+1, NULL);
+	retVal = umdkReadBytes(g_session, 0xFF0002, 6, buf+1, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(ex0, buf, 8);
 
 	// Read five bytes from an even address
 	memset(buf, 0xCC, 8);
-	retVal = umdkReadBytes(g_handle, 0xFF0002, 5, buf+1, NULL);
+	retVal = umdkReadBytes(g_session, 0xFF0002, 5, buf+1, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(ex1, buf, 8);
 
 	// Read six bytes from an odd address
 	memset(buf, 0xCC, 8);
-	retVal = umdkReadBytes(g_handle, 0xFF0001, 6, buf+1, NULL);
+	retVal = umdkReadBytes(g_session, 0xFF0001, 6, buf+1, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(ex2, buf, 8);
 
 	// Read five bytes from an odd address
 	memset(buf, 0xCC, 8);
-	retVal = umdkReadBytes(g_handle, 0xFF0001, 5, buf+1, NULL);
+	retVal = umdkReadBytes(g_session, 0xFF0001, 5, buf+1, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(ex3, buf, 8);
 }
@@ -318,22 +391,22 @@ TEST(Range_testDirectReadbackBytes) {
 	int retVal;
 
 	// Write four bytes to bottom of page 0 (should work)
-	retVal = umdkDirectWriteBytes(g_handle, 0x000000, 4, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x000000, 4, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read them back
-	retVal = umdkDirectReadBytes(g_handle, 0x000000, 4, readback, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x000000, 4, readback, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Compare the response
 	CHECK_ARRAY_EQUAL(bytes, readback, 4);
 
 	// Write four bytes to bottom of page 0 (should work)
-	retVal = umdkDirectWriteBytes(g_handle, CB_FLAG, 4, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, CB_FLAG, 4, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read them back
-	retVal = umdkDirectReadBytes(g_handle, CB_FLAG, 4, readback, NULL);
+	retVal = umdkDirectReadBytes(g_session, CB_FLAG, 4, readback, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Compare the response
@@ -348,15 +421,15 @@ TEST(Range_testDirectWriteRead) {
 	int retVal;
 
 	// Direct-write eight bytes to page 0 (setup)
-	retVal = umdkDirectWriteBytes(g_handle, 0x07FFF8, 8, bytes, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x07FFF8, 8, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Overwrite four bytes
-	retVal = umdkDirectWriteBytes(g_handle, 0x07FFFA, 4, overwrite, NULL);
+	retVal = umdkDirectWriteBytes(g_session, 0x07FFFA, 4, overwrite, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read six bytes from an even address
-	retVal = umdkDirectReadBytes(g_handle, 0x07FFF8, 8, buf, NULL);
+	retVal = umdkDirectReadBytes(g_session, 0x07FFF8, 8, buf, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(expected, buf, 8);
 }
@@ -369,40 +442,168 @@ TEST(Range_testIndirectWriteRead) {
 	int retVal;
 
 	// Direct-write eight bytes to page 1 (setup)
-	retVal = umdkWriteBytes(g_handle, 0xFF0000, 8, bytes, NULL);
+	retVal = umdkWriteBytes(g_session, 0xFF0000, 8, bytes, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Overwrite four bytes
-	retVal = umdkWriteBytes(g_handle, 0xFF0002, 4, overwrite, NULL);
+	retVal = umdkWriteBytes(g_session, 0xFF0002, 4, overwrite, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read six bytes from an even address
-	retVal = umdkReadBytes(g_handle, 0xFF0000, 8, buf, NULL);
+	retVal = umdkReadBytes(g_session, 0xFF0000, 8, buf, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_ARRAY_EQUAL(expected, buf, 8);
 }
 
+TEST(Range_testWriteNonAligned) {
+	const uint8 bytes[] = {0xCA, 0xFE, 0xBA, 0xBE, 0xDE, 0xAD, 0xF0, 0x0D};
+	const uint8 overwrite[] = {0x12, 0x34, 0x56};
+	const uint8 ex0[] = {0xCA, 0x12, 0x34, 0x56, 0xDE, 0xAD, 0xF0, 0x0D}; // odd addr,  odd count
+	const uint8 ex1[] = {0xCA, 0xFE, 0xBA, 0xBE, 0x12, 0x34, 0x56, 0x0D}; // even addr, odd count
+	const uint8 ex2[] = {0xCA, 0xFE, 0xBA, 0x12, 0x34, 0xAD, 0xF0, 0x0D}; // odd addr,  even count
+	const uint32 bases[] = {0x000100, 0xFF0000};  // direct & indirect
+	uint8 buf[8], big[256], exBig[256];
+	int retVal, i;
+
+	for ( i = 0; i < 2; i++ ) {
+		retVal = umdkWriteBytes(g_session, bases[i], 8, bytes, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkWriteBytes(g_session, bases[i]+1, 3, overwrite, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkReadBytes(g_session, bases[i], 8, buf, NULL);
+		CHECK_EQUAL(0, retVal);
+		CHECK_ARRAY_EQUAL(ex0, buf, 8);
+
+		retVal = umdkWriteBytes(g_session, bases[i], 8, bytes, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkWriteBytes(g_session, bases[i]+4, 3, overwrite, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkReadBytes(g_session, bases[i], 8, buf, NULL);
+		CHECK_EQUAL(0, retVal);
+		CHECK_ARRAY_EQUAL(ex1, buf, 8);
+
+		retVal = umdkWriteBytes(g_session, bases[i], 8, bytes, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkWriteBytes(g_session, bases[i]+3, 2, overwrite, NULL);
+		CHECK_EQUAL(0, retVal);
+		retVal = umdkReadBytes(g_session, bases[i], 8, buf, NULL);
+		CHECK_EQUAL(0, retVal);
+		CHECK_ARRAY_EQUAL(ex2, buf, 8);
+	}
+
+	// A long span through the monitor, unaligned at both ends, just has its end words fetched
+	for ( i = 0; i < 256; i++ ) {
+		big[i] = (uint8)i;
+		exBig[i] = (uint8)((i > 0 && i <= 0x80) ? ~i : i);
+	}
+	retVal = umdkWriteBytes(g_session, 0xFF0100, 256, big, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkWriteBytes(g_session, 0xFF0101, 0x80, exBig + 1, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadBytes(g_session, 0xFF0100, 256, big, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(exBig, big, 256);
+}
+
+TEST(Range_testScatterGather) {
+	const uint8 bytes[] = {0xCA, 0xFE, 0xBA, 0xBE, 0xDE, 0xAD, 0xF0, 0x0D};
+	const uint8 ex0[]   = {0xCC, 0xFE, 0xBA, 0xBE, 0xDE, 0xAD, 0xCC, 0xCC}; // odd addr,  odd count
+	uint8 buf0[8], buf1[8], buf2[8], buf3[8];
+	struct MemVec wrVec[] = {
+		{0x000100, 8, (uint8*)bytes},  // direct, page 0
+		{MONITOR+0x70000, 8, (uint8*)bytes},  // direct, page 31
+		{0xFF0000, 8, (uint8*)bytes}   // indirect
+	};
+	struct MemVec rdVec[] = {
+		{0xFF0000, 8, buf0},           // indirect
+		{0x000100, 8, buf1},           // direct, page 0
+		{MONITOR+0x70000, 8, buf2},    // direct, page 31
+		{0x000101, 5, buf3+1}          // direct, odd address & count
+	};
+	int retVal;
+
+	// Write all three regions
+	retVal = umdkWriteV(g_session, wrVec, 3, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Read them back, plus an unaligned read
+	memset(buf0, 0xCC, 8);
+	memset(buf1, 0xCC, 8);
+	memset(buf2, 0xCC, 8);
+	memset(buf3, 0xCC, 8);
+	retVal = umdkReadV(g_session, rdVec, 4, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(bytes, buf0, 8);
+	CHECK_ARRAY_EQUAL(bytes, buf1, 8);
+	CHECK_ARRAY_EQUAL(bytes, buf2, 8);
+	CHECK_ARRAY_EQUAL(ex0, buf3, 8);
+
+	// Writes to an odd address should fail, without writing anything
+	wrVec[0].address = 0x000101;
+	retVal = umdkWriteV(g_session, wrVec, 3, NULL);
+	CHECK_EQUAL(2, retVal);
+}
+
+TEST(Range_testIndirectLarge) {
+	static uint8 bytes[0x10000], buf[0x10000];
+	uint32 i;
+	int retVal;
+	for ( i = 0; i < sizeof(bytes); i++ ) {
+		bytes[i] = (uint8)(i ^ (i >> 8));
+	}
+
+	// Write all of WRAM, which takes two chunks
+	retVal = umdkWriteBytes(g_session, 0xFF0000, 0x10000, bytes, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Read it all back
+	memset(buf, 0xCC, sizeof(buf));
+	retVal = umdkReadBytes(g_session, 0xFF0000, 0x10000, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(bytes, buf, 0x10000);
+
+	// Read an odd-sized region straddling the chunk boundary, from an odd address
+	memset(buf, 0xCC, sizeof(buf));
+	retVal = umdkReadBytes(g_session, 0xFF7FF1, 0x21, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(bytes+0x7FF1, buf, 0x21);
+	CHECK_EQUAL(0xCC, buf[0x21]);
+}
+
+TEST(Range_testAcquire) {
+	struct Registers regs1, regs2;
+	const struct Deadline deadline = {100, NULL};
+	int retVal;
+
+	// Already at the monitor, so the deadline doesn't come into it
+	retVal = umdkRemoteAcquire(g_session, &regs1, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkAcquire(g_session, &regs2, &deadline, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL((const uint32*)&regs1, (const uint32*)&regs2, 18);
+}
+
 TEST(Range_testCont) {
 	int retVal;
 	uint16 oldInsn;
 	struct Registers regs;
 
 	// Load test ROM image
-	retVal = umdkDirectWriteFile(g_handle, 0x000200, "../monitor/test.bin", NULL);
+	retVal = umdkDirectWriteFile(g_session, 0x000200, "../monitor/test.bin", NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Set start address
-	retVal = umdkSetRegister(g_handle, PC, 0x000200, NULL);
+	retVal = umdkSetRegister(g_session, PC, 0x000200, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Read word at 0x220 & replace with a breakpoint
-	retVal = umdkDirectReadWord(g_handle, 0x220, &oldInsn, NULL);
+	retVal = umdkDirectReadWord(g_session, 0x220, &oldInsn, NULL);
 	CHECK_EQUAL(0, retVal);
-	retVal = umdkDirectWriteWord(g_handle, 0x220, ILLEGAL, NULL);
+	retVal = umdkDirectWriteWord(g_session, 0x220, ILLEGAL, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Continue
-	retVal = umdkContWait(g_handle, &regs, NULL);
+	retVal = umdkContWait(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL, regs.pc);
@@ -423,7 +624,7 @@ TEST(Range_testCont) {
 	CHECK_EQUAL(0UL, regs.fp);
 	//CHECK_EQUAL(0, regs.sp);
 
-	retVal = umdkDirectWriteWord(g_handle, 0x220, oldInsn, NULL);
+	retVal = umdkDirectWriteWord(g_session, 0x220, oldInsn, NULL);
 	CHECK_EQUAL(0, retVal);
 }
 
@@ -431,20 +632,20 @@ TEST(Range_testStep) {
 	int retVal;
 	struct Registers regs;
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*1, regs.pc);
 	CHECK_EQUAL(0x410F9343UL, regs.d0);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*2, regs.pc);
 	CHECK_EQUAL(0x410F9343UL, regs.d0);
 	CHECK_EQUAL(0x0E64E2F4UL, regs.d1);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*3, regs.pc);
@@ -452,7 +653,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x0E64E2F4UL, regs.d1);
 	CHECK_EQUAL(0x3371A5B6UL, regs.d2);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*4, regs.pc);
@@ -461,7 +662,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x3371A5B6UL, regs.d2);
 	CHECK_EQUAL(0x83B174BAUL, regs.d3);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*5, regs.pc);
@@ -471,7 +672,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x83B174BAUL, regs.d3);
 	CHECK_EQUAL(0x118C9F22UL, regs.d4);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*6, regs.pc);
@@ -482,7 +683,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x118C9F22UL, regs.d4);
 	CHECK_EQUAL(0x9E175F2AUL, regs.d5);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*7, regs.pc);
@@ -494,7 +695,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x9E175F2AUL, regs.d5);
 	CHECK_EQUAL(0x804D5E0EUL, regs.d6);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*8, regs.pc);
@@ -507,7 +708,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x804D5E0EUL, regs.d6);
 	CHECK_EQUAL(0x22CA3C6FUL, regs.d7);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*9, regs.pc);
@@ -521,7 +722,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x22CA3C6FUL, regs.d7);
 	CHECK_EQUAL(0xAC44C7F0UL, regs.a0);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*10, regs.pc);
@@ -536,7 +737,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0xAC44C7F0UL, regs.a0);
 	CHECK_EQUAL(0xEFBC0062UL, regs.a1);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*11, regs.pc);
@@ -552,7 +753,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0xEFBC0062UL, regs.a1);
 	CHECK_EQUAL(0xC2A6A7A4UL, regs.a2);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*12, regs.pc);
@@ -569,7 +770,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0xC2A6A7A4UL, regs.a2);
 	CHECK_EQUAL(0x99DA044EUL, regs.a3);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*13, regs.pc);
@@ -587,7 +788,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x99DA044EUL, regs.a3);
 	CHECK_EQUAL(0x073763D6UL, regs.a4);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*14, regs.pc);
@@ -606,7 +807,7 @@ TEST(Range_testStep) {
 	CHECK_EQUAL(0x073763D6UL, regs.a4);
 	CHECK_EQUAL(0x32E5A6C1UL, regs.a5);
 
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 	CHECK_EQUAL(0x220UL+6*15, regs.pc);
@@ -633,30 +834,55 @@ TEST(Range_testRegGetSet) {
 	uint32 val;
 
 	// Set D7 to magic value
-	retVal = umdkSetRegister(g_handle, D7, 0xCAFEBABE, NULL);
+	retVal = umdkSetRegister(g_session, D7, 0xCAFEBABE, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Step one instruction
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 
 	// Read D7
-	retVal = umdkGetRegister(g_handle, D7, &val, NULL);
+	retVal = umdkGetRegister(g_session, D7, &val, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_EQUAL(0xCAFEBABE, val);
 
 	// Set D7 to magic value
-	retVal = umdkSetRegister(g_handle, D7, 0xDEADF00D, NULL);
+	retVal = umdkSetRegister(g_session, D7, 0xDEADF00D, NULL);
 	CHECK_EQUAL(0, retVal);
 
 	// Step one instruction
-	retVal = umdkStep(g_handle, &regs, NULL);
+	retVal = umdkStep(g_session, &regs, NULL);
 	CHECK_EQUAL(0, retVal);
 	printRegs(&regs);
 
 	// Read D7
-	retVal = umdkGetRegister(g_handle, D7, &val, NULL);
+	retVal = umdkGetRegister(g_session, D7, &val, NULL);
 	CHECK_EQUAL(0, retVal);
 	CHECK_EQUAL(0xDEADF00D, val);
 }
+
+TEST(Range_testRegCache) {
+	int retVal;
+	struct Registers regs;
+	uint32 val;
+
+	// Make sure the MD is stopped, so its registers are cached
+	retVal = umdkRemoteAcquire(g_session, &regs, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Edits are visible straight away, without waiting for them to be written back
+	retVal = umdkSetRegister(g_session, D3, 0x12345678, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkGetRegister(g_session, D3, &val, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(0x12345678UL, val);
+	retVal = umdkGetRegisters(g_session, &regs, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(0x12345678UL, regs.d3);
+
+	// Re-acquiring doesn't lose the edit
+	retVal = umdkRemoteAcquire(g_session, &regs, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(0x12345678UL, regs.d3);
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <UnitTest++.h>
+#include <libfpgalink.h>
+#include "../mem.h"
+#include "../mirror.h"
+#include "../session.h"
+
+extern struct UmdkSession *g_session;
+
+TEST(Mirror_testImages) {
+	struct Mirror mirror;
+	uint8 image[4*MIRROR_PAGE_SIZE], buf[16];
+	const uint8 update[] = {0x5A, 0xA5};
+	uint32 i;
+	for ( i = 0; i < sizeof(image); i++ ) {
+		image[i] = (uint8)(i ^ (i / MIRROR_PAGE_SIZE));
+	}
+	memset(&mirror, 0, sizeof(mirror));
+
+	// Only ranges wholly inside an image are served
+	CHECK_EQUAL(0, mirrorAdd(&mirror, 0x10000, sizeof(image), image));
+	CHECK(mirrorRead(&mirror, 0x10000 + MIRROR_PAGE_SIZE - 8, 16, buf));
+	CHECK_ARRAY_EQUAL(image + MIRROR_PAGE_SIZE - 8, buf, 16);
+	CHECK(!mirrorRead(&mirror, 0x10000 - 8, 16, buf));
+	CHECK(!mirrorRead(&mirror, 0x10000 + sizeof(image) - 8, 16, buf));
+
+	// A write it knows about is followed, even where it straddles the image's start
+	mirrorWrite(&mirror, 0x10000 - 1, 2, update);
+	CHECK(mirrorRead(&mirror, 0x10000, 1, buf));
+	CHECK_EQUAL(0xA5, buf[0]);
+	image[0] = 0xA5;
+
+	// A write it doesn't stales just the pages it touches
+	mirrorInvalidate(&mirror, 0x10000 + MIRROR_PAGE_SIZE + 4, 2);
+	CHECK(!mirrorRead(&mirror, 0x10000 + MIRROR_PAGE_SIZE - 8, 16, buf));
+	CHECK(mirrorRead(&mirror, 0x10000 + MIRROR_PAGE_SIZE - 8, 8, buf));
+	CHECK(mirrorRead(&mirror, 0x10000 + 2*MIRROR_PAGE_SIZE, 16, buf));
+	CHECK_EQUAL(1U, mirrorCountStale(mirror.images));
+
+	// A new image stales whatever it overlaps in the old one, and serves its own range
+	CHECK_EQUAL(0, mirrorAdd(&mirror, 0x10000 + 3*MIRROR_PAGE_SIZE, 16, image));
+	CHECK_EQUAL(2U, mirror.numImages);
+	CHECK_EQUAL(2U, mirrorCountStale(mirror.images));
+	CHECK(mirrorRead(&mirror, 0x10000 + 3*MIRROR_PAGE_SIZE, 16, buf));
+	CHECK_ARRAY_EQUAL(image, buf, 16);
+	mirrorDestroy(&mirror);
+	CHECK(!mirrorRead(&mirror, 0x10000, 16, buf));
+}
+
+TEST(Mirror_testReads) {
+	uint8 image[2*MIRROR_PAGE_SIZE], buf[16], expected[16];
+	const uint8 update[] = {0xCA, 0xFE, 0xBA};
+	const uint8 illegal[] = {0x4A, 0xFC};
+	struct MemVec vec = {0x072104, 2, (uint8 *)illegal};
+	uint32 i, hits;
+	int retVal;
+	for ( i = 0; i < sizeof(image); i++ ) {
+		image[i] = (uint8)(i * 3);
+	}
+
+	// Upload an image, as -w does, and mirror it
+	retVal = umdkPhysicalWriteBytes(g_session, 0x072000, sizeof(image), image, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkAddMirror(g_session, 0x072000, sizeof(image), image, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Reads of it are served from the mirror
+	hits = g_session->mirror.hits;
+	retVal = umdkReadBytes(g_session, 0x072010, 16, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(image + 0x10, buf, 16);
+	CHECK_EQUAL(hits + 1, g_session->mirror.hits);
+
+	// A write stales its page, so reads of that page go back to the board
+	retVal = umdkWriteBytes(g_session, 0x072011, 3, update, NULL);
+	CHECK_EQUAL(0, retVal);
+	memcpy(expected, image + 0x10, 16);
+	memcpy(expected + 1, update, 3);
+	retVal = umdkReadBytes(g_session, 0x072010, 16, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(expected, buf, 16);
+	CHECK_EQUAL(hits + 1, g_session->mirror.hits);
+
+	// Breakpoints don't: reads behind them still get the original opcodes
+	retVal = umdkWriteV(g_session, &vec, 1, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadBytes(g_session, 0x072100, 16, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(image + MIRROR_PAGE_SIZE, buf, 16);
+	CHECK_EQUAL(hits + 2, g_session->mirror.hits);
+	vec.data = image + MIRROR_PAGE_SIZE + 4;
+	retVal = umdkWriteV(g_session, &vec, 1, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// The monitor's housekeeping writes go straight through to it, so they don't stale anything
+	retVal = umdkDirectWriteWord(g_session, 0x072108, 0x4AFC, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadBytes(g_session, 0x072108, 2, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(illegal, buf, 2);
+	retVal = umdkDirectWriteBytes(g_session, 0x072108, 2, image + MIRROR_PAGE_SIZE + 8, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadBytes(g_session, 0x072100, 16, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(image + MIRROR_PAGE_SIZE, buf, 16);
+	CHECK_EQUAL(hits + 4, g_session->mirror.hits);
+	hits += 2;
+
+	// The mirror is keyed by SDRAM address, so it follows the image to wherever it's mapped
+	umdkSetBankPage(g_session, 1, 0);
+	retVal = umdkReadBytes(g_session, 0x0F2100, 16, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_ARRAY_EQUAL(image + MIRROR_PAGE_SIZE, buf, 16);
+	CHECK_EQUAL(hits + 3, g_session->mirror.hits);
+	umdkForgetBank(g_session, 1);
+	retVal = umdkReadBytes(g_session, 0x0F2100, 16, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(hits + 3, g_session->mirror.hits);
+	umdkDropMirror(g_session);
+}
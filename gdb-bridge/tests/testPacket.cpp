@@ -0,0 +1,114 @@
+/* 
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *  
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <UnitTest++.h>
+#include "../packet.h"
+
+#define FEED(reader, str) pktFeed(reader, (const uint8 *)str, (uint32)(sizeof(str) - 1))
+
+static struct PacketReader g_reader;
+static struct PacketWriter g_writer;
+
+TEST(Packet_testPipelined) {
+	char buf[64];
+	uint32 length;
+	memset(&g_reader, 0, sizeof(g_reader));
+
+	// Two packets and an interrupt in one read, with acks in between
+	FEED(&g_reader, "+$m0,4#fd+$g#67\x03");
+	CHECK_EQUAL(PKT_MESSAGE, pktNext(&g_reader, buf, sizeof(buf), &length));
+	CHECK_EQUAL(4U, length);
+	CHECK(!strcmp("m0,4", buf));
+	CHECK_EQUAL(PKT_MESSAGE, pktNext(&g_reader, buf, sizeof(buf), &length));
+	CHECK(!strcmp("g", buf));
+	CHECK_EQUAL(PKT_INTERRUPT, pktNext(&g_reader, buf, sizeof(buf), &length));
+	CHECK_EQUAL(PKT_NONE, pktNext(&g_reader, buf, sizeof(buf), &length));
+
+	// A packet arriving in pieces, the checksum last
+	FEED(&g_reader, "$OK");
+	CHECK_EQUAL(PKT_NONE, pktNext(&g_reader, buf, sizeof(buf), &length));
+	FEED(&g_reader, "#9");
+	CHECK_EQUAL(PKT_NONE, pktNext(&g_reader, buf, sizeof(buf), &length));
+	FEED(&g_reader, "a");
+	CHECK_EQUAL(PKT_MESSAGE, pktNext(&g_reader, buf, sizeof(buf), &length));
+	CHECK(!strcmp("OK", buf));
+}
+
+TEST(Packet_testBadPackets) {
+	char buf[8];
+	uint32 length;
+	uint32 i;
+	memset(&g_reader, 0, sizeof(g_reader));
+
+	// Corrupted checksum
+	FEED(&g_reader, "$g#68");
+	CHECK_EQUAL(PKT_BAD_CHECKSUM, pktNext(&g_reader, buf, sizeof(buf), &length));
+
+	// Too big for the caller's buffer, but the next packet is still framed
+	FEED(&g_reader, "$0123456789#0d$g#67");
+	CHECK_EQUAL(PKT_OVERFLOW, pktNext(&g_reader, buf, sizeof(buf), &length));
+	CHECK_EQUAL(PKT_MESSAGE, pktNext(&g_reader, buf, sizeof(buf), &length));
+	CHECK(!strcmp("g", buf));
+
+	// Too big for the ring
+	FEED(&g_reader, "$");
+	for ( i = 0; i < PKT_RING_SIZE; i++ ) {
+		FEED(&g_reader, "0");
+	}
+	CHECK_EQUAL(PKT_OVERFLOW, pktNext(&g_reader, buf, sizeof(buf), &length));
+	CHECK_EQUAL(PKT_NONE, pktNext(&g_reader, buf, sizeof(buf), &length));
+}
+
+TEST(Packet_testWriter) {
+	const uint8 data[] = {0xCA, 0xFE};
+	memset(&g_writer, 0, sizeof(g_writer));
+	pktAck(&g_writer, true);
+	pktBegin(&g_writer);
+	pktAppendHex(&g_writer, data, 2);
+	pktEnd(&g_writer);
+	pktBegin(&g_writer);
+	pktAppend(&g_writer, "OK", 2);
+	pktEnd(&g_writer);
+	CHECK_EQUAL(false, g_writer.overflow);
+	CHECK_EQUAL(15U, g_writer.length);
+	CHECK(!memcmp(g_writer.buf, "+$CAFE#0F$OK#9A", 15));
+
+	// Notifications are framed the same way, but with a '%'
+	pktBeginNotification(&g_writer);
+	pktAppend(&g_writer, "Stop:T05", 8);
+	pktEnd(&g_writer);
+	CHECK_EQUAL(27U, g_writer.length);
+	CHECK(!memcmp(g_writer.buf + 15, "%Stop:T05#99", 12));
+}
+
+TEST(Packet_testBinary) {
+	const uint8 data[] = {'a', '#', '$', '}', '*', 0x00, 'z'};
+	const char expected[] = "$a}\x03}\x04}]}\x0A\x00z#";
+	memset(&g_writer, 0, sizeof(g_writer));
+	pktBegin(&g_writer);
+	CHECK_EQUAL(7U, pktAppendBinary(&g_writer, data, 7));
+	pktEnd(&g_writer);
+	CHECK_EQUAL(15U, g_writer.length);
+	CHECK(!memcmp(g_writer.buf, expected, 13));
+
+	// Escaping can overrun the packet: only what fits is appended
+	g_writer.length = PKT_WRITE_SIZE - 5;
+	pktBegin(&g_writer);
+	CHECK_EQUAL(0U, pktAppendBinary(&g_writer, data + 1, 1));
+	CHECK_EQUAL(1U, pktAppendBinary(&g_writer, data, 2));
+	CHECK_EQUAL(true, g_writer.overflow);
+}
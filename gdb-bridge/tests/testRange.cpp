@@ -14,6 +14,7 @@
  * You should have received a copy of the GNU General Public License
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+#include <cstring>
 #include <UnitTest++.h>
 #include "../range.h"
 
@@ -116,3 +117,32 @@ TEST(Range_testIsOverlapEnd) {
 	CHECK(!isOverlapEnd(5,10, 16,4));
 	CHECK(!isOverlapEnd(5,10, 17,4));
 }
+
+TEST(Range_testPatch) {
+	const uint8 opcode[] = {0x4E, 0x71};
+	uint8 buf[4];
+
+	// Patch wholly inside
+	memset(buf, 0xAA, 4);
+	patch(buf, 0x100, 4, opcode, 0x101);
+	CHECK_EQUAL(0xAA, buf[0]);
+	CHECK_EQUAL(0x4E, buf[1]);
+	CHECK_EQUAL(0x71, buf[2]);
+	CHECK_EQUAL(0xAA, buf[3]);
+
+	// Patch hanging off either end
+	memset(buf, 0xAA, 4);
+	patch(buf, 0x100, 4, opcode, 0x0FF);
+	patch(buf, 0x100, 4, opcode, 0x103);
+	CHECK_EQUAL(0x71, buf[0]);
+	CHECK_EQUAL(0xAA, buf[1]);
+	CHECK_EQUAL(0xAA, buf[2]);
+	CHECK_EQUAL(0x4E, buf[3]);
+
+	// Patch outside
+	memset(buf, 0xAA, 4);
+	patch(buf, 0x100, 4, opcode, 0x0FE);
+	patch(buf, 0x100, 4, opcode, 0x104);
+	CHECK_EQUAL(0xAA, buf[0]);
+	CHECK_EQUAL(0xAA, buf[3]);
+}
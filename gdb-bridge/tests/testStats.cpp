@@ -0,0 +1,63 @@
+/* 
+ * Copyright (C) 2009 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *  
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <UnitTest++.h>
+#include <libfpgalink.h>
+#include "../mem.h"
+#include "../stats.h"
+#include "../session.h"
+
+extern struct UmdkSession *g_session;
+
+TEST(Stats_testReadBytes) {
+	struct OpStats stats;
+	uint8 buf[16];
+	char text[4096];
+	uint32 i, histTotal = 0;
+	int retVal;
+
+	// Read from the monitor's bank, which is never cached, so the read really goes to the board
+	statsReset(&g_session->stats);
+	retVal = umdkReadBytes(g_session, MONITOR+0x70000, 16, buf, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// One call, which read at least the sixteen bytes asked for
+	statsGet(&g_session->stats, STATS_READ_BYTES, &stats);
+	CHECK_EQUAL(1U, stats.calls);
+	CHECK(stats.transfers >= 1);
+	CHECK(stats.bytesIn >= 16);
+	for ( i = 0; i < STATS_NUM_BUCKETS; i++ ) {
+		histTotal += stats.histogram[i];
+	}
+	CHECK_EQUAL(1U, histTotal);
+
+	// The nested direct-read is counted too, but nothing else is
+	statsGet(&g_session->stats, STATS_DIRECT_READ_BYTES, &stats);
+	CHECK_EQUAL(1U, stats.calls);
+	statsGet(&g_session->stats, STATS_CONT_WAIT, &stats);
+	CHECK_EQUAL(0U, stats.calls);
+
+	// Only entry points which were actually called are listed
+	statsFormat(&g_session->stats, text, sizeof(text));
+	CHECK(strstr(text, "umdkReadBytes") != NULL);
+	CHECK(strstr(text, "umdkContWait") == NULL);
+
+	// Resetting clears everything
+	statsReset(&g_session->stats);
+	statsGet(&g_session->stats, STATS_READ_BYTES, &stats);
+	CHECK_EQUAL(0U, stats.calls);
+}
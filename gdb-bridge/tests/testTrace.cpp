@@ -0,0 +1,184 @@
+/* 
+ * Copyright (C) 2014 Chris McClelland
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *  
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <UnitTest++.h>
+#include <libfpgalink.h>
+#include "../mem.h"
+#include "../break.h"
+#include "../trace.h"
+#include "../session.h"
+
+extern struct UmdkSession *g_session;
+
+TEST(Trace_testCollect) {
+	const uint32 addr = 0x001200;
+	const uint8 data[] = {0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08};
+	const uint8 traceA1[] = {0x26, 0x00, 0x09, 0x0D, 0x02, 0x27};  // trace_quick 2 bytes at $a1
+	struct TraceState *const trace = &g_session->trace;
+	struct Registers regs, frameRegs;
+	uint8 buf[8];
+	uint16 word;
+	int retVal;
+	traceReset(trace);
+	retVal = umdkWriteWord(g_session, addr, 0x4E71, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkWriteBytes(g_session, 0xFF8000, 8, data, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Four bytes absolute, four bytes at $a0 + 4, and whatever $a1 points at
+	CHECK_EQUAL(0, traceCreate(trace, 1, addr, true, 0, 0));
+	CHECK_EQUAL(0, traceAddRange(trace, 1, addr, -1, 0xFF8000, 4));
+	CHECK_EQUAL(0, traceAddRange(trace, 1, addr, 8, 4, 4));
+	CHECK_EQUAL(0, traceAddExpression(trace, 1, addr, traceA1, sizeof(traceA1)));
+	CHECK(traceAddRange(trace, 2, addr, -1, 0, 4) != 0);
+
+	// The tracepoint goes into memory like a breakpoint, but GDB doesn't stop there
+	retVal = traceStart(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadWord(g_session, addr, &word, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(ILLEGAL, word);
+	memset(&regs, 0, sizeof(regs));
+	regs.pc = addr;
+	regs.a0 = 0xFF8000;
+	regs.a1 = 0xFF8006;
+	CHECK(!brkShouldStop(g_session, &regs));
+
+	// Two hits make two frames; a stop elsewhere makes none
+	regs.d0 = 1;
+	CHECK_EQUAL(0, traceHit(g_session, &regs, NULL));
+	regs.pc = addr + 2;
+	CHECK_EQUAL(0, traceHit(g_session, &regs, NULL));
+	regs.pc = addr;
+	regs.d0 = 2;
+	CHECK_EQUAL(0, traceHit(g_session, &regs, NULL));
+	CHECK_EQUAL(2U, trace->numFrames);
+
+	// Each frame has its own registers, and the memory collected, and nothing else
+	CHECK_EQUAL(1, traceFindFrame(trace, TRACE_FIND_NUMBER, 1, 0));
+	CHECK_EQUAL(1U, traceFrameTracepoint(trace));
+	traceFrameRegisters(trace, &frameRegs);
+	CHECK_EQUAL(2U, frameRegs.d0);
+	CHECK_EQUAL(addr, frameRegs.pc);
+	CHECK_EQUAL(8U, traceFrameMemory(trace, 0xFF8000, 8, buf));
+	CHECK_EQUAL(0, memcmp(buf, data, 8));
+	CHECK_EQUAL(2U, traceFrameMemory(trace, 0xFF8006, 4, buf));
+	CHECK_EQUAL(0x07, buf[0]);
+	CHECK_EQUAL(0U, traceFrameMemory(trace, 0xFF7FFF, 1, buf));
+
+	// The tracepoint itself is hidden from the collected code
+	CHECK_EQUAL(0, traceAddRange(trace, 1, addr, 17, 0, 2));
+	CHECK_EQUAL(0, traceHit(g_session, &regs, NULL));
+	CHECK_EQUAL(2, traceFindFrame(trace, TRACE_FIND_NUMBER, 2, 0));
+	CHECK_EQUAL(2U, traceFrameMemory(trace, addr, 2, buf));
+	CHECK_EQUAL(0x4E, buf[0]);
+	CHECK_EQUAL(0x71, buf[1]);
+
+	// Stopping the trace takes the tracepoint out at the next commit
+	traceStop(g_session, "tstop");
+	CHECK(!trace->running);
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkReadWord(g_session, addr, &word, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(0x4E71, word);
+	CHECK(brkFind(&g_session->breakpoints, addr) == NULL);
+	traceReset(trace);
+}
+
+TEST(Trace_testFindAndPass) {
+	const uint32 addrA = 0x001300, addrB = 0x001340;
+	struct TraceState *const trace = &g_session->trace;
+	struct Registers regs;
+	char status[160];
+	int retVal;
+	traceReset(trace);
+	memset(&regs, 0, sizeof(regs));
+	CHECK_EQUAL(0, traceCreate(trace, 1, addrA, true, 0, 0));
+	CHECK_EQUAL(0, traceCreate(trace, 2, addrB, true, 0, 3));
+	retVal = traceStart(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// A, B, A, B, A, B: the third hit of B reaches its pass count and stops the trace
+	for ( int i = 0; i < 4; i++ ) {
+		regs.pc = addrA;
+		CHECK_EQUAL(0, traceHit(g_session, &regs, NULL));
+		regs.pc = addrB;
+		CHECK_EQUAL(0, traceHit(g_session, &regs, NULL));
+	}
+	CHECK(!trace->running);
+	CHECK_EQUAL(6U, trace->numFrames);
+	traceFormatStatus(trace, status, sizeof(status));
+	CHECK(strncmp(status, "T0;tpasscount:2;tframes:6;", 26) == 0);
+
+	// Searches go forward from the selected frame
+	CHECK_EQUAL(1, traceFindFrame(trace, TRACE_FIND_PC, addrB, 0));
+	CHECK_EQUAL(3, traceFindFrame(trace, TRACE_FIND_PC, addrB, 0));
+	CHECK_EQUAL(4, traceFindFrame(trace, TRACE_FIND_TRACEPOINT, 1, 0));
+	CHECK_EQUAL(5, traceFindFrame(trace, TRACE_FIND_OUTSIDE, addrA, addrA + 0x10));
+	CHECK_EQUAL(-1, traceFindFrame(trace, TRACE_FIND_RANGE, addrA, addrA + 0x10));
+	CHECK_EQUAL(0, traceFindFrame(trace, TRACE_FIND_RANGE, addrA, addrA + 0x10));
+	CHECK_EQUAL(-1, traceFindFrame(trace, TRACE_FIND_NUMBER, 0xFFFFFFFF, 0));
+
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	traceReset(trace);
+}
+
+TEST(Trace_testStepOver) {
+	const uint32 addr = 0x001380;
+	struct TraceState *const trace = &g_session->trace;
+	struct Registers regs;
+	uint16 word;
+	int retVal;
+	traceReset(trace);
+	retVal = umdkWriteLong(g_session, addr, 0x4E714E71, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkWriteLong(g_session, IL_VEC, MONITOR, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// A tracepoint GDB doesn't know about, with the MD stopped on it
+	CHECK_EQUAL(0, traceCreate(trace, 1, addr, true, 0, 0));
+	retVal = traceStart(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	retVal = umdkSetRegister(g_session, PC, addr, NULL);
+	CHECK_EQUAL(0, retVal);
+
+	// Stepping it collects a frame and runs the original opcode, rather than trapping on the spot
+	retVal = brkStep(g_session, &regs, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(addr + 2, regs.pc);
+	CHECK_EQUAL(1U, trace->numFrames);
+	retVal = umdkReadWord(g_session, addr, &word, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(ILLEGAL, word);
+
+	// Anywhere else it's just a step
+	retVal = brkStep(g_session, &regs, NULL);
+	CHECK_EQUAL(0, retVal);
+	CHECK_EQUAL(addr + 4, regs.pc);
+	CHECK_EQUAL(1U, trace->numFrames);
+
+	traceStop(g_session, "tstop");
+	retVal = brkCommit(g_session, NULL);
+	CHECK_EQUAL(0, retVal);
+	traceReset(trace);
+}
@@ -0,0 +1,517 @@
+// Tracepoints. While a trace runs, each tracepoint is an ILLEGAL in the MD's memory like any other
+// breakpoint; but when the MD stops at one, the bridge collects a frame of registers and memory into
+// its own buffer and resumes the MD, without GDB hearing anything about it. GDB gets to look at the
+// frames afterwards, by selecting them with QTFrame and then reading registers and memory as usual.
+//
+#include <stdlib.h>
+#include <string.h>
+#include <liberror.h>
+#include "trace.h"
+#include "break.h"
+#include "agent.h"
+#include "mem.h"
+#include "session.h"
+
+static struct Tracepoint *findPoint(struct TraceState *state, uint32 number, uint32 addr);
+static bool appendBytes(void **array, uint32 *length, const void *data, uint32 count);
+static bool testPoint(struct UmdkSession *session, const struct Tracepoint *tp, const struct Registers *regs);
+static int collectFrame(
+	struct UmdkSession *session, const struct Tracepoint *tp, const struct Registers *regs,
+	const char **error);
+static int collectMemory(struct AgentEnv *env, uint32 address, uint32 length, const char **error);
+static uint32 getLong(const uint8 *buf);
+static void putLong(uint8 *buf, uint32 value);
+
+#define FRAME_HEADER  6
+#define REGS_BLOCK    (1 + 4*18)
+#define MEMORY_HEADER 9
+
+
+// *************************************************************************************************
+// **                                   Defining tracepoints                                      **
+// *************************************************************************************************
+
+// Forget all the tracepoints and frames, as GDB asks with QTinit before it defines a new trace. The
+// trace must not be running.
+//
+void traceReset(struct TraceState *state) {
+	uint32 i;
+	for ( i = 0; i < state->numPoints; i++ ) {
+		free(state->points[i].cond);
+		free(state->points[i].ranges);
+		free(state->points[i].exprs);
+	}
+	free(state->points);
+	state->points = NULL;
+	state->numPoints = 0;
+	state->used = 0;
+	state->numFrames = 0;
+	state->stopReason = NULL;
+	state->current = -1;
+	state->cursor = 0;
+}
+
+// Define a new tracepoint, with no actions yet. Returns nonzero if it couldn't be stored.
+//
+int traceCreate(
+	struct TraceState *state, uint32 number, uint32 addr, bool enabled, uint32 step, uint32 pass)
+{
+	struct Tracepoint tp;
+	uint32 numBytes = state->numPoints * (uint32)sizeof(tp);
+	memset(&tp, 0, sizeof(tp));
+	tp.number = number;
+	tp.addr = addr;
+	tp.enabled = enabled;
+	tp.step = step;
+	tp.pass = pass;
+	if ( !appendBytes((void **)&state->points, &numBytes, &tp, sizeof(tp)) ) {
+		return 1;
+	}
+	state->numPoints++;
+	return 0;
+}
+
+// Make an existing tracepoint conditional. Returns nonzero if there is no such tracepoint, or the
+// condition couldn't be stored.
+//
+int traceSetCondition(
+	struct TraceState *state, uint32 number, uint32 addr, const uint8 *cond, uint32 condLength)
+{
+	struct Tracepoint *const tp = findPoint(state, number, addr);
+	if ( !tp ) {
+		return 1;
+	}
+	free(tp->cond);
+	tp->cond = NULL;
+	tp->condLength = 0;
+	return appendBytes((void **)&tp->cond, &tp->condLength, cond, condLength) ? 0 : 2;
+}
+
+// Add a range of memory to those an existing tracepoint collects. Returns nonzero if there is no
+// such tracepoint, or the range couldn't be stored.
+//
+int traceAddRange(
+	struct TraceState *state, uint32 number, uint32 addr, int32 basereg, uint32 offset,
+	uint32 length)
+{
+	struct Tracepoint *const tp = findPoint(state, number, addr);
+	struct TraceRange range;
+	uint32 numBytes;
+	if ( !tp ) {
+		return 1;
+	}
+	range.basereg = basereg;
+	range.offset = offset;
+	range.length = length;
+	numBytes = tp->numRanges * (uint32)sizeof(range);
+	if ( !appendBytes((void **)&tp->ranges, &numBytes, &range, sizeof(range)) ) {
+		return 2;
+	}
+	tp->numRanges++;
+	return 0;
+}
+
+// Add an agent expression to those an existing tracepoint evaluates, to collect the memory named by
+// its trace bytecodes. Returns nonzero if there is no such tracepoint, or the expression couldn't
+// be stored.
+//
+int traceAddExpression(
+	struct TraceState *state, uint32 number, uint32 addr, const uint8 *code, uint32 length)
+{
+	struct Tracepoint *const tp = findPoint(state, number, addr);
+	uint8 prefix[2];
+	if ( !tp ) {
+		return 1;
+	}
+	prefix[0] = (uint8)(length >> 8);
+	prefix[1] = (uint8)length;
+	if ( !appendBytes((void **)&tp->exprs, &tp->exprsLength, prefix, 2) ) {
+		return 2;
+	}
+	if ( !appendBytes((void **)&tp->exprs, &tp->exprsLength, code, length) ) {
+		tp->exprsLength -= 2;
+		return 2;
+	}
+	return 0;
+}
+
+// Release everything the trace state owns.
+//
+void traceDestroy(struct TraceState *state) {
+	traceReset(state);
+	free(state->buffer);
+	state->buffer = NULL;
+}
+
+
+// *************************************************************************************************
+// **                                      Running a trace                                        **
+// *************************************************************************************************
+
+// Start a trace: throw away the frames of the last one, and plant the enabled tracepoints. They
+// only go into memory when the MD next runs.
+//
+int traceStart(struct UmdkSession *session, const char **error) {
+	int retVal = 0;
+	struct TraceState *const state = &session->trace;
+	uint32 i = 0;
+	if ( !state->buffer ) {
+		state->buffer = (uint8 *)malloc(TRACE_BUFFER_SIZE);
+		CHECK_STATUS(!state->buffer, 1, cleanup, "traceStart(): Memory allocation error!");
+	}
+	state->used = 0;
+	state->numFrames = 0;
+	state->current = -1;
+	state->stopReason = NULL;
+	for ( i = 0; i < state->numPoints; i++ ) {
+		state->points[i].hits = 0;
+		if ( state->points[i].enabled ) {
+			CHECK_STATUS(
+				brkInsertTrace(&session->breakpoints, state->points[i].addr), 2, cleanup,
+				"traceStart(): Memory allocation error!");
+		}
+	}
+	state->running = true;
+cleanup:
+	if ( retVal ) {
+		while ( i-- ) {
+			brkRemoveTrace(&session->breakpoints, state->points[i].addr);
+		}
+	}
+	return retVal;
+}
+
+// Stop the trace, if it's running, giving the reason qTStatus will report. The tracepoints come out
+// of memory when the MD next runs; until then, reads are patched to hide them as usual.
+//
+void traceStop(struct UmdkSession *session, const char *reason) {
+	struct TraceState *const state = &session->trace;
+	uint32 i;
+	if ( state->running ) {
+		for ( i = 0; i < state->numPoints; i++ ) {
+			if ( state->points[i].enabled ) {
+				brkRemoveTrace(&session->breakpoints, state->points[i].addr);
+			}
+		}
+		state->running = false;
+		state->stopReason = reason;
+	}
+}
+
+// The MD has stopped with the given registers. If that's at a tracepoint of the running trace,
+// collect a frame for it (or for each of them, if several share the address), and stop the trace
+// if a pass count has been reached or the buffer is full. A frame which fails to collect stops the
+// trace too.
+//
+int traceHit(struct UmdkSession *session, const struct Registers *regs, const char **error) {
+	int retVal = 0, status;
+	struct TraceState *const state = &session->trace;
+	struct Tracepoint *tp;
+	uint32 i;
+	if ( !state->running ) {
+		return 0;
+	}
+	for ( i = 0; i < state->numPoints && state->running; i++ ) {
+		tp = state->points + i;
+		if ( !tp->enabled || tp->addr != (regs->pc & 0x00FFFFFF) || !testPoint(session, tp, regs) ) {
+			continue;
+		}
+		status = collectFrame(session, tp, regs, error);
+		if ( status == 1 ) {
+			traceStop(session, "tfull");
+			break;
+		}
+		if ( status ) {
+			traceStop(session, "terror");
+			CHECK_STATUS(status, status, cleanup);
+		}
+		tp->hits++;
+		if ( tp->pass && tp->hits >= tp->pass ) {
+			traceStop(session, "tpasscount");
+			state->stopPoint = tp->number;
+		}
+	}
+cleanup:
+	return retVal;
+}
+
+// Write the reply to qTStatus. Returns its length.
+//
+uint32 traceFormatStatus(const struct TraceState *state, char *buf, uint32 bufSize) {
+	char reason[32];
+	int length;
+	if ( state->running ) {
+		strcpy(reason, "trunning:0");
+	} else if ( !state->stopReason ) {
+		strcpy(reason, "tnotrun:0");
+	} else if ( !strcmp(state->stopReason, "tpasscount") ) {
+		sprintf(reason, "tpasscount:%X", state->stopPoint);
+	} else {
+		sprintf(reason, "%s:0", state->stopReason);
+	}
+	length = snprintf(
+		buf, bufSize, "T%d;%s;tframes:%X;tcreated:%X;tsize:%X;tfree:%X;circular:0;disconn:0",
+		state->running ? 1 : 0, reason, state->numFrames, state->numFrames,
+		TRACE_BUFFER_SIZE, TRACE_BUFFER_SIZE - state->used);
+	return (length < 0 || (uint32)length >= bufSize) ? bufSize - 1 : (uint32)length;
+}
+
+
+// *************************************************************************************************
+// **                                   Looking at the frames                                     **
+// *************************************************************************************************
+
+// Select a frame, as GDB asks with QTFrame, and return its number. The searches start with the frame
+// after the one selected. If no frame matches, none is selected, and the result is -1.
+//
+int32 traceFindFrame(struct TraceState *state, TraceFind how, uint32 a, uint32 b) {
+	int32 number = 0;
+	uint32 offset = 0, pc;
+	const uint8 *frame;
+	bool match;
+	if ( how != TRACE_FIND_NUMBER && state->current >= 0 ) {
+		number = state->current + 1;
+		offset = state->currentOffset + getLong(state->buffer + state->currentOffset + 2);
+	}
+	state->current = -1;
+	for ( ; offset < state->used; number++ ) {
+		frame = state->buffer + offset;
+		pc = getLong(frame + FRAME_HEADER + 1 + 4*PC) & 0x00FFFFFF;
+		switch ( how ) {
+		case TRACE_FIND_NUMBER:
+			match = ((uint32)number == a);
+			break;
+		case TRACE_FIND_PC:
+			match = (pc == a);
+			break;
+		case TRACE_FIND_TRACEPOINT:
+			match = (((uint32)frame[0] << 8 | frame[1]) == a);
+			break;
+		case TRACE_FIND_RANGE:
+			match = (pc >= a && pc <= b);
+			break;
+		default:
+			match = (pc < a || pc > b);
+			break;
+		}
+		if ( match ) {
+			state->current = number;
+			state->currentOffset = offset;
+			break;
+		}
+		offset += getLong(frame + 2);
+	}
+	return state->current;
+}
+
+// The number of the tracepoint which collected the selected frame.
+//
+uint32 traceFrameTracepoint(const struct TraceState *state) {
+	const uint8 *const frame = state->buffer + state->currentOffset;
+	return (uint32)frame[0] << 8 | frame[1];
+}
+
+// The registers collected in the selected frame.
+//
+void traceFrameRegisters(const struct TraceState *state, struct Registers *regs) {
+	const uint8 *const block = state->buffer + state->currentOffset + FRAME_HEADER + 1;
+	uint32 *const dst = &regs->d0;
+	uint32 i;
+	for ( i = 0; i < 18; i++ ) {
+		dst[i] = getLong(block + 4*i);
+	}
+}
+
+// Copy memory collected in the selected frame into buf, starting at address. Returns the number of
+// bytes copied, which is less than count if the frame doesn't have all of them.
+//
+uint32 traceFrameMemory(const struct TraceState *state, uint32 address, uint32 count, uint8 *buf) {
+	const uint8 *const frame = state->buffer + state->currentOffset;
+	const uint32 size = getLong(frame + 2);
+	uint32 offset, blockAddr, blockLength, chunkSize, done = 0;
+	bool found = true;
+	while ( done < count && found ) {
+		found = false;
+		for ( offset = FRAME_HEADER + REGS_BLOCK; offset < size; offset += MEMORY_HEADER + blockLength ) {
+			blockAddr = getLong(frame + offset + 1);
+			blockLength = getLong(frame + offset + 5);
+			if ( address + done >= blockAddr && address + done - blockAddr < blockLength ) {
+				chunkSize = blockLength - (address + done - blockAddr);
+				if ( chunkSize > count - done ) {
+					chunkSize = count - done;
+				}
+				memcpy(buf + done, frame + offset + MEMORY_HEADER + (address + done - blockAddr), chunkSize);
+				done += chunkSize;
+				found = true;
+				break;
+			}
+		}
+	}
+	return done;
+}
+
+
+// *************************************************************************************************
+// **                               Operations private to this file                               **
+// *************************************************************************************************
+
+// Find the tracepoint GDB is adding to. GDB numbers tracepoints itself, and gives the address too.
+//
+static struct Tracepoint *findPoint(struct TraceState *state, uint32 number, uint32 addr) {
+	uint32 i;
+	for ( i = 0; i < state->numPoints; i++ ) {
+		if ( state->points[i].number == number && state->points[i].addr == addr ) {
+			return state->points + i;
+		}
+	}
+	return NULL;
+}
+
+// Grow a malloc()'d array by count bytes, appending the given data. On failure the array is left
+// as it was.
+//
+static bool appendBytes(void **array, uint32 *length, const void *data, uint32 count) {
+	uint8 *const grown = (uint8 *)realloc(*array, *length + count);
+	if ( !grown && *length + count ) {
+		return false;
+	}
+	memcpy(grown + *length, data, count);
+	*array = grown;
+	*length += count;
+	return true;
+}
+
+// See whether the tracepoint's condition holds. One which can't be evaluated counts as true, so
+// the frame is collected anyway.
+//
+static bool testPoint(struct UmdkSession *session, const struct Tracepoint *tp, const struct Registers *regs) {
+	struct AgentEnv env = {session, regs, NULL, NULL};
+	const char *error = NULL;
+	int64 result;
+	if ( !tp->condLength ) {
+		return true;
+	}
+	if ( agentEval(tp->cond, tp->condLength, &env, &result, &error) ) {
+		flFreeError(error);
+		return true;
+	}
+	return result != 0;
+}
+
+// Append a frame for the given tracepoint to the buffer. The fixed ranges are fetched with one
+// scatter read straight into the frame; then the expressions add whatever they trace. Returns 1 if
+// the frame doesn't fit, in which case the buffer is left as it was.
+//
+static int collectFrame(
+	struct UmdkSession *session, const struct Tracepoint *tp, const struct Registers *regs,
+	const char **error)
+{
+	int retVal = 0, status;
+	struct TraceState *const state = &session->trace;
+	const uint32 start = state->used;
+	const uint32 *const src = &regs->d0;
+	struct MemVec *vec = NULL;
+	bool full = false;
+	struct AgentEnv env = {session, regs, collectMemory, &full};
+	uint8 *frame, *block;
+	const uint8 *ptr, *end;
+	uint32 i, size, address, length;
+	int64 result;
+
+	// Size up the header, registers and fixed ranges, checking as it goes so the sum can't wrap
+	size = FRAME_HEADER + REGS_BLOCK;
+	CHECK_STATUS(size > TRACE_BUFFER_SIZE - start, 1, cleanup);
+	for ( i = 0; i < tp->numRanges; i++ ) {
+		size += MEMORY_HEADER + tp->ranges[i].length;
+		CHECK_STATUS(size > TRACE_BUFFER_SIZE - start, 1, cleanup);
+	}
+	frame = state->buffer + start;
+	frame[0] = (uint8)(tp->number >> 8);
+	frame[1] = (uint8)tp->number;
+	block = frame + FRAME_HEADER;
+	*block++ = 'R';
+	for ( i = 0; i < 18; i++ ) {
+		putLong(block, src[i]);
+		block += 4;
+	}
+	if ( tp->numRanges ) {
+		vec = (struct MemVec *)malloc(tp->numRanges * sizeof(struct MemVec));
+		CHECK_STATUS(!vec, 2, cleanup, "traceHit(): Memory allocation error!");
+		for ( i = 0; i < tp->numRanges; i++ ) {
+			address = tp->ranges[i].offset;
+			if ( tp->ranges[i].basereg >= 0 && tp->ranges[i].basereg <= PC ) {
+				address += src[tp->ranges[i].basereg];
+			}
+			address &= 0x00FFFFFF;
+			*block = 'M';
+			putLong(block + 1, address);
+			putLong(block + 5, tp->ranges[i].length);
+			vec[i].address = address;
+			vec[i].length = tp->ranges[i].length;
+			vec[i].data = block + MEMORY_HEADER;
+			block += MEMORY_HEADER + tp->ranges[i].length;
+		}
+		status = umdkReadV(session, vec, tp->numRanges, error);
+		CHECK_STATUS(status, 3, cleanup);
+		for ( i = 0; i < tp->numRanges; i++ ) {
+			brkPatch(&session->breakpoints, vec[i].data, vec[i].address, vec[i].length);
+		}
+	}
+	state->used = start + size;
+
+	// Let the expressions trace what they like onto the end
+	ptr = tp->exprs;
+	end = ptr + tp->exprsLength;
+	while ( ptr < end ) {
+		length = (uint32)((ptr[0] << 8) | ptr[1]);
+		status = agentEval(ptr + 2, length, &env, &result, error);
+		CHECK_STATUS(status, full ? 1 : 4, cleanup);
+		ptr += 2 + length;
+	}
+	putLong(frame + 2, state->used - start);
+	state->numFrames++;
+cleanup:
+	if ( retVal ) {
+		state->used = start;
+	}
+	free(vec);
+	return retVal;
+}
+
+// Trace callback for the agent: append an 'M' block with the given memory to the frame being
+// collected. If it doesn't fit, the flag passed in the context is set, and evaluation fails.
+//
+static int collectMemory(struct AgentEnv *env, uint32 address, uint32 length, const char **error) {
+	int retVal = 0, status;
+	struct UmdkSession *const session = env->session;
+	struct TraceState *const state = &session->trace;
+	uint8 *const block = state->buffer + state->used;
+	address &= 0x00FFFFFF;
+	if (
+		state->used + MEMORY_HEADER > TRACE_BUFFER_SIZE ||
+		length > TRACE_BUFFER_SIZE - state->used - MEMORY_HEADER )
+	{
+		*(bool *)env->traceContext = true;
+		return 1;
+	}
+	status = umdkReadBytes(session, address, length, block + MEMORY_HEADER, error);
+	CHECK_STATUS(status, 3, cleanup);
+	brkPatch(&session->breakpoints, block + MEMORY_HEADER, address, length);
+	block[0] = 'M';
+	putLong(block + 1, address);
+	putLong(block + 5, length);
+	state->used += MEMORY_HEADER + length;
+cleanup:
+	return retVal;
+}
+
+static uint32 getLong(const uint8 *buf) {
+	return (uint32)buf[0] << 24 | (uint32)buf[1] << 16 | (uint32)buf[2] << 8 | buf[3];
+}
+
+static void putLong(uint8 *buf, uint32 value) {
+	buf[0] = (uint8)(value >> 24);
+	buf[1] = (uint8)(value >> 16);
+	buf[2] = (uint8)(value >> 8);
+	buf[3] = (uint8)value;
+}
@@ -0,0 +1,109 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <makestuff.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+	struct UmdkSession;
+	struct Registers;
+
+	// The most a trace may collect, over all its frames
+	#define TRACE_BUFFER_SIZE 0x100000
+
+	// A range of memory to collect: length bytes at offset from the value of register basereg, or at
+	// offset itself if basereg is negative.
+	struct TraceRange {
+		int32 basereg;
+		uint32 offset;
+		uint32 length;
+	};
+
+	// One tracepoint, as defined by GDB's QTDP packets. Every hit collects a frame holding all the
+	// registers, the memory ranges, and whatever the trace bytecodes in the expressions name.
+	struct Tracepoint {
+		uint32 number;
+		uint32 addr;
+		bool enabled;
+		uint32 step;           // while-stepping count: accepted, but no stepping frames are collected
+		uint32 pass;           // hits after which the trace stops, or zero for no limit
+		uint32 hits;
+		uint8 *cond;           // agent expression which must be true for a hit to count
+		uint32 condLength;     // zero if the tracepoint is unconditional
+		struct TraceRange *ranges;
+		uint32 numRanges;
+		uint8 *exprs;          // agent expressions, each preceded by its length as a big-endian word
+		uint32 exprsLength;
+	};
+
+	// How QTFrame chooses a frame
+	typedef enum {
+		TRACE_FIND_NUMBER,     // the frame numbered a
+		TRACE_FIND_PC,         // the next frame collected at a
+		TRACE_FIND_TRACEPOINT, // the next frame collected by tracepoint a
+		TRACE_FIND_RANGE,      // the next frame collected at a PC in [a, b]
+		TRACE_FIND_OUTSIDE     // the next frame collected at a PC outside [a, b]
+	} TraceFind;
+
+	// Tracepoints, and the frames they collected. Each frame is a header (the tracepoint number as a
+	// big-endian word, then the frame's total size as a big-endian long) followed by blocks: one 'R'
+	// block with the 18 registers as big-endian longs, then 'M' blocks, each the address and length
+	// of the memory as big-endian longs followed by the memory itself.
+	struct TraceState {
+		struct Tracepoint *points;
+		uint32 numPoints;
+		uint8 *buffer;           // TRACE_BUFFER_SIZE bytes, allocated when a trace first starts
+		uint32 used;
+		uint32 numFrames;
+		bool running;
+		const char *stopReason;  // why the last trace stopped, as qTStatus puts it
+		uint32 stopPoint;        // the tracepoint that stopped it, for tpasscount
+		int32 current;           // the selected frame, or -1 to look at the live MD
+		uint32 currentOffset;    // where the selected frame starts in the buffer
+		uint32 cursor;           // the next tracepoint for qTsP
+	};
+
+	// ---------------------------------------------------------------------------------------------
+	// Defining tracepoints
+	//
+	void traceReset(struct TraceState *state);
+	int traceCreate(
+		struct TraceState *state, uint32 number, uint32 addr, bool enabled, uint32 step, uint32 pass
+	) WARN_UNUSED_RESULT;
+	int traceSetCondition(
+		struct TraceState *state, uint32 number, uint32 addr, const uint8 *cond, uint32 condLength
+	) WARN_UNUSED_RESULT;
+	int traceAddRange(
+		struct TraceState *state, uint32 number, uint32 addr, int32 basereg, uint32 offset,
+		uint32 length
+	) WARN_UNUSED_RESULT;
+	int traceAddExpression(
+		struct TraceState *state, uint32 number, uint32 addr, const uint8 *code, uint32 length
+	) WARN_UNUSED_RESULT;
+	void traceDestroy(struct TraceState *state);
+
+	// ---------------------------------------------------------------------------------------------
+	// Running a trace
+	//
+	int traceStart(struct UmdkSession *session, const char **error) WARN_UNUSED_RESULT;
+	void traceStop(struct UmdkSession *session, const char *reason);
+	int traceHit(
+		struct UmdkSession *session, const struct Registers *regs, const char **error
+	) WARN_UNUSED_RESULT;
+	uint32 traceFormatStatus(const struct TraceState *state, char *buf, uint32 bufSize);
+
+	// ---------------------------------------------------------------------------------------------
+	// Looking at the frames
+	//
+	int32 traceFindFrame(struct TraceState *state, TraceFind how, uint32 a, uint32 b);
+	uint32 traceFrameTracepoint(const struct TraceState *state);
+	void traceFrameRegisters(const struct TraceState *state, struct Registers *regs);
+	uint32 traceFrameMemory(const struct TraceState *state, uint32 address, uint32 count, uint8 *buf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif